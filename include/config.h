@@ -0,0 +1,389 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// 检测器配置
+typedef struct
+{
+    char backend[32];     // 推理后端名称, 默认 opencv
+    char model_path[256]; // 模型文件路径
+    char labels_path[256]; // 类别名称文件, 为空时在模型旁查找或读取模型元数据
+    char dnn_backend[32]; // OpenCV DNN 计算后端: opencv / openvino / cuda
+    char dnn_target[32];  // OpenCV DNN 计算设备: cpu / opencl / opencl_fp16 / cuda / cuda_fp16
+    char precision[8];    // 推理精度: fp32 / fp16 / int8
+    char calibration_dir[256]; // INT8 校准图片目录, 模型未量化时用于在线量化
+    int calibration_images;    // 参与校准的最大图片数
+    int input_width;      // 网络输入宽度, 需为 32 的倍数
+    int input_height;     // 网络输入高度, 需为 32 的倍数
+    int detect_interval;  // 每隔多少帧推理一次, 其余帧由跟踪器推算
+    int max_batch;        // 单次前向的最大批量
+    int batch_wait_ms;    // 多路共享模型时, 为凑满批量等待其他摄像头请求的最长时间
+    int warmup_runs;      // 加载后预热推理的次数
+    float conf_threshold; // 默认置信度阈值
+    float nms_threshold;  // NMS 阈值
+    char classes[512];          // 参与检测的类别, 逗号分隔的名称或 ID, 空表示全部类别
+    char class_thresholds[512]; // 按类别覆盖置信度阈值, 形如 person:0.5,car:0.4
+    char warning_classes[256];  // 触发告警的类别, 格式同 classes
+} DetectorConfig;
+
+// 运动门控配置
+typedef struct
+{
+    int enabled;            // 是否启用运动门控
+    int pixel_threshold;    // 网格单元亮度变化阈值
+    float motion_ratio;     // 变化单元占比达到该值时放行推理
+    int keepalive_frames;   // 画面静止时每隔多少帧强制推理一次, 0 表示不保活
+    float background_alpha; // 背景模型更新速率
+} MotionGateConfig;
+
+// 跟踪器配置
+typedef struct
+{
+    int enabled;         // 是否启用跟踪
+    float iou_threshold; // 预测框与检测框匹配所需的最小 IoU
+    int max_misses;      // 连续多少轮检测未匹配后删除目标
+    int min_hits;        // 匹配多少次后确认目标
+} TrackerConfig;
+
+#define MAX_ROI_POLYGONS 8
+#define MAX_ROI_POINTS 16
+
+// 多边形, 坐标为相对画面宽高的归一化值 [0, 1]
+typedef struct
+{
+    int count;
+    float x[MAX_ROI_POINTS];
+    float y[MAX_ROI_POINTS];
+} RoiPolygon;
+
+// 感兴趣区域配置
+typedef struct
+{
+    int include_count;                     // 关注区域数量, 0 表示整帧
+    RoiPolygon include[MAX_ROI_POLYGONS];  // 关注区域, 只对其外接矩形做推理
+    int exclude_count;                     // 屏蔽区域数量
+    RoiPolygon exclude[MAX_ROI_POLYGONS];  // 屏蔽区域, 中心落在其中的检测被丢弃
+} RoiConfig;
+
+// 切片推理配置
+typedef struct
+{
+    int enabled;         // 是否启用切片推理
+    int cols;            // 切片列数, 0 表示按网络输入尺寸自动计算
+    int rows;            // 切片行数, 0 表示按网络输入尺寸自动计算
+    float overlap;       // 相邻切片的重叠比例
+    int full_frame;      // 是否额外对整帧推理一次, 用于检测大目标
+    int adaptive;        // 是否只推理有运动或有目标的切片
+    int full_refresh;    // 自适应模式下每隔多少轮推理一次全部切片
+    float nms_threshold; // 跨切片合并时的 NMS 阈值
+} TilingConfig;
+
+// 检测结果缓存配置
+typedef struct
+{
+    int enabled;        // 是否启用检测结果缓存
+    int hash_threshold; // 帧签名的最大汉明距离, 不超过该值视为近似重复帧
+    int max_age;        // 一条缓存结果最多被复用多少帧, 到期后强制重新推理
+} DetectionCacheConfig;
+
+// 检测帧率控制配置
+typedef struct
+{
+    int enabled;            // 是否按推理耗时和 CPU 余量自动调整检测步长
+    float target_load;      // 目标 CPU 占用率 (0, 1]
+    float min_fps;          // 每路保证的最低检测帧率
+    float boost_factor;     // 最近有检测结果的摄像头分配预算时的权重
+    int boost_seconds;      // 检测到目标后保持加权的秒数
+    int update_interval_ms; // 重新分配预算的间隔
+} RateControlConfig;
+
+// 流水线阶段, 每个阶段的线程可单独设置 CPU 亲和性和调度策略
+typedef enum
+{
+    STAGE_DECODE,     // 拉流解码
+    STAGE_DETECT,     // 各路的检测线程: 预处理、跟踪和发布结果
+    STAGE_INFERENCE,  // 推理服务的前向计算线程, 每个 NUMA 节点一个
+    STAGE_ENCODE,     // 推流和录像编码
+    STAGE_RENDER,     // 渲染
+    STAGE_BACKGROUND, // 后台任务
+    STAGE_COUNT,
+} PipelineStage;
+
+// 单个阶段的线程调度配置
+typedef struct
+{
+    char cpus[128];    // CPU 列表, 如 "0-3,6", 为空表示不限制
+    int nice;          // nice 值 [-20, 19], 0 表示不调整
+    int fifo_priority; // SCHED_FIFO 优先级 [1, 99], 0 表示使用普通调度
+} ThreadStageConfig;
+
+// numa_node 取值: 每路启动时分到当前摄像头最少的节点
+#define NUMA_NODE_AUTO -2
+
+// 线程配置
+typedef struct
+{
+    ThreadStageConfig stages[STAGE_COUNT];
+    int opencv_threads;  // OpenCV 内部线程池大小, 0 表示 OpenCV 默认
+    int decoder_threads; // FFmpeg 解码器内部线程数, 0 表示自动
+    int encoder_threads; // FFmpeg 编码器内部线程数, 0 表示自动
+    int numa_node;       // 解码/检测/推理/编码线程绑定的 NUMA 节点, -1 不绑定, NUMA_NODE_AUTO 自动均衡
+    int numa_memory;     // 同时让这些线程优先从该节点分配内存(帧缓冲等)
+} ThreadConfig;
+
+// 控制接口配置
+typedef struct
+{
+    char socket_path[108]; // UNIX 套接字路径, 为空表示不启用
+} ControlConfig;
+
+// 停止配置
+typedef struct
+{
+    int drain_timeout_ms; // 停止拉流后等待各阶段排空的总时长(所有阶段共用一个截止时间), 超时后丢弃剩余帧, 编码器仍会冲刷并写入文件尾
+} ShutdownConfig;
+
+// 阶段监管配置
+typedef struct
+{
+    int enabled;            // 阶段线程退出或停滞时单独重启该阶段
+    int stall_timeout_ms;   // 有待处理的数据但超过该时间没有心跳视为停滞
+    int backoff_initial_ms; // 首次重启前的等待时间, 连续失败时加倍
+    int backoff_max_ms;     // 重启等待时间上限; 阶段连续运行超过该时间后退避重置
+} SupervisorConfig;
+
+// 延迟跟踪配置
+typedef struct
+{
+    int enabled;           // 每帧记录各阶段的时间点并统计延迟直方图
+    int report_interval_s; // 打印直方图的间隔(秒), 0 表示只在退出时打印
+    int slow_frame_ms;     // 端到端超过该值的帧单独打印各段耗时, 0 表示不打印
+} TraceConfig;
+
+// 指标接口配置
+typedef struct
+{
+    char listen[64]; // HTTP 监听地址 host:port 或 port, 为空表示不启用
+} MetricsConfig;
+
+// 渲染窗口配置
+typedef struct
+{
+    int enabled; // 打开渲染窗口显示第一路视频流; 0 表示无显示运行, 不初始化 SDL, 也不为显示复制帧
+} DisplayConfig;
+
+// 单路视频流配置
+typedef struct
+{
+    char name[64];        // 名称, 用于日志
+    char input_url[512];  // 拉流地址
+    char output_url[512]; // 推流地址, "null" 表示编码后丢弃
+    char record_path[256]; // 录像文件名, strftime 格式, "null" 表示编码后丢弃
+    int realtime;          // 按输入的时间戳限速读包, 本地文件按原始帧率读出; 0 表示尽快读
+    int lossless;          // 流水线队列满时阻塞拉流(反压)而不是丢弃最旧的帧, 每帧都被检测和编码; 用于记录和回放
+    char detection_log[256]; // 逐帧检测结果的记录文件, 每次启动流水线时重写; 空表示不记录
+    DetectorConfig detector;
+    MotionGateConfig motion;
+    TrackerConfig tracker;
+    RoiConfig roi;
+    TilingConfig tiling;
+    DetectionCacheConfig cache;
+    RateControlConfig rate;
+    ThreadConfig threads;
+    ControlConfig control;
+    ShutdownConfig shutdown;
+    SupervisorConfig supervisor;
+    TraceConfig trace;
+    MetricsConfig metrics;
+    DisplayConfig display;
+} StreamConfig;
+
+// 单个进程最多处理的视频流数
+#define MAX_STREAMS 64
+
+// 进程配置: 全局节作为各路的默认值, 每个 [stream 名称] 节定义一路视频流
+typedef struct
+{
+    StreamConfig defaults; // 全局配置, 模型相关的 [detector] 键对所有视频流生效
+    StreamConfig *streams; // 各路配置
+    int stream_count;
+} ProcessConfig;
+
+/// @brief INI 解析回调
+/// @param user 用户数据
+/// @param section 当前节名, 无节时为空字符串
+/// @param key 键
+/// @param value 值
+/// @return 0 成功，-1 失败(终止解析)
+typedef int (*ConfigHandler)(void *user, const char *section, const char *key, const char *value);
+
+/// @brief 解析 INI 格式的配置文件
+/// @param path 文件路径
+/// @param handler 每个键值对的回调
+/// @param user 用户数据
+/// @return 0 成功，-1 失败
+int config_parse_ini(const char *path, ConfigHandler handler, void *user);
+
+/// @brief 设置默认配置
+/// @param cfg 配置指针
+void config_set_defaults(StreamConfig *cfg);
+
+/// @brief 设置检测器配置项
+/// @param detector 检测器配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_detector_option(DetectorConfig *detector, const char *key, const char *value);
+
+/// @brief 设置运动门控配置项
+/// @param motion 运动门控配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_motion_option(MotionGateConfig *motion, const char *key, const char *value);
+
+/// @brief 设置跟踪器配置项
+/// @param tracker 跟踪器配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_tracker_option(TrackerConfig *tracker, const char *key, const char *value);
+
+/// @brief 设置感兴趣区域配置项, include / exclude 可重复出现, 每次追加一个多边形
+/// @param roi 感兴趣区域配置
+/// @param key 键
+/// @param value 值, 形如 "0.1,0.2 0.6,0.2 0.6,0.9 0.1,0.9"
+/// @return 1 已识别，0 未知键或格式错误
+int config_set_roi_option(RoiConfig *roi, const char *key, const char *value);
+
+/// @brief 设置切片推理配置项
+/// @param tiling 切片推理配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_tiling_option(TilingConfig *tiling, const char *key, const char *value);
+
+/// @brief 设置检测结果缓存配置项
+/// @param cache 缓存配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_cache_option(DetectionCacheConfig *cache, const char *key, const char *value);
+
+/// @brief 设置检测帧率控制配置项
+/// @param rate 帧率控制配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_rate_option(RateControlConfig *rate, const char *key, const char *value);
+
+/// @brief 设置线程配置项, 阶段相关的键形如 inference_cpus / decode_nice / render_fifo
+/// @param threads 线程配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_threads_option(ThreadConfig *threads, const char *key, const char *value);
+
+/// @brief 设置控制接口配置项
+/// @param control 控制接口配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_control_option(ControlConfig *control, const char *key, const char *value);
+
+/// @brief 设置停止配置项
+/// @param shutdown 停止配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_shutdown_option(ShutdownConfig *shutdown, const char *key, const char *value);
+
+/// @brief 设置监管配置项
+/// @param supervisor 监管配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_supervisor_option(SupervisorConfig *supervisor, const char *key, const char *value);
+
+/// @brief 设置延迟跟踪配置项
+/// @param trace 跟踪配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_trace_option(TraceConfig *trace, const char *key, const char *value);
+
+/// @brief 设置指标接口配置项
+/// @param metrics 指标接口配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_metrics_option(MetricsConfig *metrics, const char *key, const char *value);
+
+/// @brief 设置渲染窗口配置项
+/// @param display 渲染窗口配置
+/// @param key 键
+/// @param value 值
+/// @return 1 已识别，0 未知键
+int config_set_display_option(DisplayConfig *display, const char *key, const char *value);
+
+/// @brief 覆盖单路配置的一个键, input_url / output_url / record_path / realtime / lossless / detection_log 直接给出, 其余键形如 motion.enabled;
+///        模型相关的 detector 键(backend / model_path / input_size 等)由所有视频流共享, 不能按路覆盖
+/// @param cfg 视频流配置
+/// @param key 键
+/// @param value 值
+/// @return 0 成功，-1 未知键或值无效
+int config_set_stream_override(StreamConfig *cfg, const char *key, const char *value);
+
+/// @brief 阶段名称
+/// @param stage 阶段
+/// @return 名称, 如 "inference"
+const char *pipeline_stage_name(PipelineStage stage);
+
+/// @brief 从文件加载配置, 文件中未出现的键保持原值
+/// @param path 文件路径
+/// @param cfg 配置指针
+/// @return 0 成功，-1 失败
+int config_load_file(const char *path, StreamConfig *cfg);
+
+/// @brief 向进程配置追加一路视频流, 其配置复制自全局默认值
+/// @param cfg 进程配置
+/// @param name 名称
+/// @return 新的视频流配置, 超过 MAX_STREAMS 或内存不足时返回 NULL
+StreamConfig *config_add_stream(ProcessConfig *cfg, const char *name);
+
+/// @brief 加载多路配置文件. 先读取全局节, 再为每个 [stream 名称] 节复制一份全局配置,
+///        节内的 input_url / output_url 以及形如 motion.enabled 的键覆盖该路的配置;
+///        没有具名视频流时, 以全局配置和 [stream] 节的地址组成单路配置
+/// @param path 文件路径
+/// @param cfg 进程配置, 调用前由 config_set_defaults 初始化 defaults
+/// @return 0 成功，-1 失败
+int config_load_process_file(const char *path, ProcessConfig *cfg);
+
+/// @brief 检查一路视频流是否可以启动: input_url 和 output_url 都不能为空(丢弃输出时写 null)
+/// @param cfg 视频流配置
+/// @param source 配置来源, 用于日志, 如配置文件路径
+/// @return 0 有效，-1 无效
+int config_validate_stream(const StreamConfig *cfg, const char *source);
+
+/// @brief 释放进程配置
+/// @param cfg 进程配置
+void config_free_process(ProcessConfig *cfg);
+
+// 打印配置
+void dump_stream_config(const StreamConfig *cfg);
+
+#endif // CONFIG_H
@@ -0,0 +1,54 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include <pthread.h>
+#include "pipeline.h"
+
+// 本地控制接口: UNIX 套接字(权限 0600, 只有运行进程的用户可以连接)上的文本协议, 每行一条命令, 每条命令回复以 OK 或 ERR 开头, 以空行结束
+//   list                         列出各路状态
+//   start|stop|restart <name>    启停单路, 其他视频流和共享模型不受影响
+//   add <name> <input> <output>  以全局配置新增一路并启动, 输出写 null 表示丢弃
+//   remove <name>                停止并删除一路
+//   set <name> <key> <value>     修改一路的配置项(如 motion.enabled), 运行中的流水线随即重启
+//   reload                       重新读取配置文件, 新增/变化/删除的视频流分别启动/重启/停止
+typedef struct
+{
+    char socket_path[108];
+    char config_path[256]; // reload 读取的配置文件, 为空时不支持 reload
+    StreamConfig defaults; // add 使用的全局配置, reload 成功后替换为配置文件中的新值
+    PipelineManager *manager;
+    int listen_fd;
+    volatile int running;
+    pthread_t thread;
+} ControlServer;
+
+/// @brief 创建监听套接字并启动控制线程
+/// @param server 控制接口
+/// @param socket_path 套接字路径, 已存在的同名文件会被替换
+/// @param config_path 配置文件路径, 可为 NULL
+/// @param defaults 全局配置, 复制一份保存
+/// @param manager 流水线管理器
+/// @return 0 成功，-1 失败
+int control_server_start(ControlServer *server, const char *socket_path, const char *config_path,
+                         const StreamConfig *defaults, PipelineManager *manager);
+
+/// @brief 停止控制线程并删除套接字文件
+/// @param server 控制接口
+void control_server_stop(ControlServer *server);
+
+#endif // CONTROL_SERVER_H
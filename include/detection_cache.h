@@ -0,0 +1,95 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DETECTION_CACHE_H
+#define DETECTION_CACHE_H
+
+#include <stdint.h>
+#include <vector>
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+#include "config.h"
+#include "frame_queue.h"
+
+// 帧签名: 17x16 亮度网格水平相邻单元比较得到的 256 位差分哈希
+#define FRAME_HASH_WORDS 4
+typedef struct
+{
+    uint64_t bits[FRAME_HASH_WORDS];
+} FrameHash;
+
+// 缓存条目数, 画面在少数几个状态之间切换(如开关灯)时也能命中
+#define DETECTION_CACHE_SIZE 4
+
+typedef struct
+{
+    FrameHash hash;
+    std::vector<Box> boxes; // 该帧的检测结果
+    int age;                // 已被复用的帧数
+    uint64_t last_used;     // 最近一次使用的序号, 用于淘汰
+    int valid;
+} DetectionCacheEntry;
+
+// 缓存统计
+typedef struct
+{
+    uint64_t lookups; // 查询次数
+    uint64_t hits;    // 命中次数
+    uint64_t expired; // 签名匹配但超过复用上限的次数
+} DetectionCacheStats;
+
+// 检测结果缓存: 近似重复帧直接返回上次的检测结果
+typedef struct
+{
+    DetectionCacheConfig config;
+    DetectionCacheEntry entries[DETECTION_CACHE_SIZE];
+    uint64_t clock;
+    int pending;        // 最近一次未命中的条目, 推理完成后写入
+    FrameHash pending_hash;
+    DetectionCacheStats stats;
+} DetectionCache;
+
+/// @brief 初始化缓存
+/// @param cache 缓存
+/// @param config 配置
+void detection_cache_init(DetectionCache *cache, const DetectionCacheConfig *config);
+
+/// @brief 计算帧签名
+/// @param frame 解码后的帧, 直接读取 data[0] 亮度平面
+/// @param hash 输出签名
+/// @return 0 成功，-1 帧格式不支持
+int frame_hash_compute(const AVFrame *frame, FrameHash *hash);
+
+/// @brief 两个签名的汉明距离
+int frame_hash_distance(const FrameHash *a, const FrameHash *b);
+
+/// @brief 查询缓存; 未命中时记住该帧签名, 推理后由 detection_cache_store 写入
+/// @param cache 缓存
+/// @param frame 解码后的帧
+/// @param boxes 命中时输出缓存的检测结果
+/// @return 1 命中，0 未命中
+int detection_cache_lookup(DetectionCache *cache, const AVFrame *frame, std::vector<Box> &boxes);
+
+/// @brief 写入最近一次未命中帧的检测结果
+/// @param cache 缓存
+/// @param boxes 检测结果
+void detection_cache_store(DetectionCache *cache, const std::vector<Box> &boxes);
+
+// 打印缓存命中率
+void detection_cache_dump_stats(const DetectionCache *cache);
+
+#endif // DETECTION_CACHE_H
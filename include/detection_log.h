@@ -0,0 +1,139 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DETECTION_LOG_H
+#define DETECTION_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <vector>
+#include "frame_queue.h"
+
+// 检测记录文件: 每帧的检测结果按 PTS 顺序写入紧凑的二进制文件, 回放同一输入时逐帧对比, 作为不依赖摄像头的回归基准
+// 格式(本机字节序): 文件头 DetectionLogFileHeader, 之后每帧一个 DetectionLogRecord 紧跟 box_count 个 DetectionLogBox
+#define DETECTION_LOG_MAGIC 0x54454459 // "YDET"
+#define DETECTION_LOG_VERSION 1
+// 对比结果中保留的不一致帧数, 超出的只计数
+#define DETECTION_LOG_MAX_MISMATCHES 100
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+} DetectionLogFileHeader;
+
+typedef struct
+{
+    int64_t pts;          // 帧的时间戳(输入流时间基)
+    float latency_ms;     // 该帧的推理耗时, 命中检测缓存时为 -1
+    uint32_t box_count;
+} DetectionLogRecord;
+
+typedef struct
+{
+    int32_t x, y, w, h;
+    float prop;
+    int32_t class_id;
+} DetectionLogBox;
+
+// 写入端, 由流水线打开, 检测线程写入
+typedef struct DetectionLogWriter
+{
+    FILE *file;
+    uint64_t frames;
+} DetectionLogWriter;
+
+// 读入的一帧
+typedef struct
+{
+    float latency_ms;
+    std::vector<DetectionLogBox> boxes;
+} DetectionLogFrame;
+
+// 读入的整个文件, 按 PTS 索引
+typedef struct
+{
+    std::map<int64_t, DetectionLogFrame> frames;
+    uint64_t duplicates; // 重复的 PTS(如输入重连后时间戳回绕), 只保留第一次出现的帧
+} DetectionLog;
+
+// 两个框视为一致的条件: 类别相同, 置信度之差不超过 score_delta, IoU 不低于 min_iou
+typedef struct
+{
+    float min_iou;
+    float score_delta;
+} DetectionLogTolerance;
+
+// 一帧的不一致
+typedef struct
+{
+    int64_t pts;
+    int golden_boxes;
+    int run_boxes;
+    int unmatched; // 基准中未找到对应框的个数加上本次多出的框数
+} DetectionLogMismatch;
+
+// 对比结果
+typedef struct
+{
+    uint64_t frames_compared;     // 两边都有的帧
+    uint64_t frames_mismatched;   // 其中检测结果不一致的帧
+    uint64_t frames_only_golden;  // 只在基准中的帧(本次被丢弃或跳过)
+    uint64_t frames_only_run;     // 只在本次运行中的帧
+    uint64_t boxes_golden;        // 对比帧中基准的框数
+    uint64_t boxes_run;           // 对比帧中本次的框数
+    uint64_t boxes_missing;       // 基准中有而本次没有的框
+    uint64_t boxes_extra;         // 本次多出的框
+    uint64_t latency_frames;      // 两边都有推理耗时的帧
+    double golden_latency_ms;     // 基准的平均推理耗时
+    double run_latency_ms;        // 本次的平均推理耗时
+    double latency_delta_p50_ms;  // 逐帧耗时差(本次 - 基准)的分位数
+    double latency_delta_p95_ms;
+    std::vector<DetectionLogMismatch> mismatches; // 前 DETECTION_LOG_MAX_MISMATCHES 个不一致的帧
+} DetectionLogDiff;
+
+/// @brief 创建记录文件, 已存在时覆盖
+/// @param path 文件路径
+/// @return 写入端, 失败返回 NULL
+DetectionLogWriter *detection_log_open(const char *path);
+
+/// @brief 写入一帧的检测结果
+/// @param writer 写入端
+/// @param pts 帧的时间戳
+/// @param latency_ms 推理耗时, 未实际推理时传负数
+/// @param boxes 检测结果
+/// @return 0 成功，-1 写入失败
+int detection_log_write(DetectionLogWriter *writer, int64_t pts, double latency_ms, const std::vector<Box> &boxes);
+
+/// @brief 写出缓冲并关闭文件
+/// @param writer 写入端, 可以为 NULL
+void detection_log_close(DetectionLogWriter *writer);
+
+/// @brief 读入记录文件; 文件末尾不完整的记录(写入中途退出)被忽略
+/// @param path 文件路径
+/// @param log 输出
+/// @return 0 成功，-1 无法打开或格式不符
+int detection_log_load(const char *path, DetectionLog *log);
+
+/// @brief 逐帧对比两次运行的检测结果
+/// @param golden 基准
+/// @param run 本次运行
+/// @param tolerance 框一致的条件
+/// @param diff 输出对比结果
+void detection_log_compare(const DetectionLog *golden, const DetectionLog *run, const DetectionLogTolerance *tolerance,
+                           DetectionLogDiff *diff);
+
+#endif // DETECTION_LOG_H
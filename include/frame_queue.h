@@ -25,6 +25,7 @@ extern "C"
 #include <libavcodec/avcodec.h>
 #include <libavutil/frame.h>
 }
+#include "latency_trace.h"
 typedef enum
 {
     ONLY_FRAME,
@@ -38,6 +39,8 @@ typedef struct Box
     int x, y, w, h;
     float prop;
     char label[40];
+    int track_id; // 跟踪 ID, 0 表示未跟踪
+    int class_id; // 类别 ID, 类别比较统一使用 ID
 } Box;
 
 typedef struct QueueItem
@@ -46,6 +49,7 @@ typedef struct QueueItem
     void *data;
     int box_count;
     Box Boxes[20];
+    FrameTrace trace; // 帧的延迟跟踪记录, 每个消费方各自一份
 } QueueItem;
 // 释放队列节点
 void free_queue_node(QueueItem *item);
@@ -62,8 +66,14 @@ typedef struct FrameQueue
     QueueNode *rear;
     pthread_mutex_t lock;
     pthread_cond_t cond;
+    pthread_cond_t space_cond; // 出队腾出空位, 唤醒阻塞在满队列上的生产者
     int size;
     int max_size;
+    int block_timeout_ms; // 队列满时生产者最多阻塞的时间, 超时后再丢弃队首; 0 表示立即丢弃队首
+    int closed; // 已关闭: 不再接受新元素, 取空后 dequeue 立即返回
+    // 统计, 持锁更新, 指标抓取时不加锁读取
+    uint64_t enqueued; // 入队的元素数
+    uint64_t dropped;  // 队列已满时丢弃的队首元素数和内存不足时丢弃的元素数
 } FrameQueue;
 
 /// @brief 初始化队列
@@ -71,19 +81,30 @@ typedef struct FrameQueue
 /// @param max_size 队列最大容量
 void frame_queue_init(FrameQueue *q, int max_size);
 
-/// @brief  入队操作
+/// @brief 设置队列满时的行为: 默认丢弃最旧的元素, 保证实时性; 记录和回放时改为阻塞生产者(反压), 不丢帧
+/// @param q 队列指针
+/// @param timeout_ms 生产者最多阻塞的时间, 消费者退出时不会永远卡住; 0 恢复为直接丢弃队首
+void frame_queue_set_block_timeout(FrameQueue *q, int timeout_ms);
+
+/// @brief  入队操作, 队列满时按 block_timeout_ms 等待空位或丢弃队首
 /// @param q
 /// @param item
-/// @return
+/// @return 1 成功，0 队列已关闭或内存不足, 由调用方释放元素
 int enqueue(FrameQueue *q, QueueItem item);
 
-// 出队操作
+// 出队操作, 队列为空时阻塞; 队列已关闭且为空时返回 0
 int dequeue(FrameQueue *q, QueueItem *item);
 // 出队操作
 // @param q 队列指针
 // @param item 出队元素
 // @return 1 成功，-1 队列为空，0 失败
 int async_dequeue(FrameQueue *q, QueueItem *item);
+/// @brief 关闭队列, 唤醒阻塞在 dequeue 上的线程, 用于停止单路流水线
+/// @param q 队列指针
+void frame_queue_close(FrameQueue *q);
+/// @brief 重新打开已关闭的队列, 用于重启单个阶段; 队列中剩余的元素保留
+/// @param q 队列指针
+void frame_queue_reopen(FrameQueue *q);
 /// 销毁队列
 /// @param q 队列指针
 /// @return 0 成功，-1 失败
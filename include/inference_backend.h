@@ -0,0 +1,68 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INFERENCE_BACKEND_H
+#define INFERENCE_BACKEND_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "config.h"
+
+// 推理后端能力描述
+typedef struct
+{
+    int max_batch_size; // 单次前向支持的最大批量
+    int dynamic_input;  // 是否支持动态输入尺寸
+    int supports_fp16;  // 是否支持 FP16 推理
+    int supports_int8;  // 是否支持 INT8 推理
+    char device[32];    // 实际运行的设备
+    char precision[8];  // 实际生效的推理精度
+} BackendCapabilities;
+
+// 推理后端接口; 后端只负责张量级别的前向计算,
+// 预处理和后处理由 yolov8.cc 统一完成, 新增后端不需要改动流水线
+typedef struct InferenceBackend InferenceBackend;
+struct InferenceBackend
+{
+    const char *name;
+    // 加载模型
+    int (*load)(InferenceBackend *backend, const DetectorConfig *config);
+    // 用空输入预热, 避免第一帧的初始化开销落在实时流上
+    int (*warmup)(InferenceBackend *backend, int batch, int width, int height);
+    // 对 NCHW 输入张量执行一次前向, outputs 为网络输出
+    int (*infer)(InferenceBackend *backend, const cv::Mat &blob, std::vector<cv::Mat> &outputs);
+    // 查询后端能力
+    void (*get_capabilities)(InferenceBackend *backend, BackendCapabilities *caps);
+    // 释放模型
+    void (*release)(InferenceBackend *backend);
+    void *priv;
+};
+
+// 已注册的后端, 各自在后端源文件中定义; 声明为 extern 保证 const 定义具有外部链接
+extern const InferenceBackend opencv_dnn_backend;
+
+/// @brief 根据名称创建推理后端实例
+/// @param name 后端名称
+/// @return 后端实例, 未找到时返回 NULL
+InferenceBackend *create_inference_backend(const char *name);
+
+/// @brief 销毁推理后端实例
+/// @param backend 后端实例
+void destroy_inference_backend(InferenceBackend *backend);
+
+// 打印已注册的推理后端
+void list_inference_backends();
+
+#endif // INFERENCE_BACKEND_H
@@ -0,0 +1,133 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef INFERENCE_SERVICE_H
+#define INFERENCE_SERVICE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "config.h"
+#include "frame_queue.h"
+#include "thread_utils.h"
+#include "metrics.h"
+#include "yolov8.h"
+
+// 一次推理请求, 由提交方在栈上分配, 完成前一直阻塞
+typedef struct InferenceRequest
+{
+    const cv::Mat *frame;
+    const std::vector<cv::Rect> *regions;
+    std::vector<Box> *boxes;
+    const Yolov8Postprocess *post; // 该路的类别过滤和 NMS 阈值, 为 NULL 时使用全局 [detector] 的设置
+    FrameTrace *trace; // 记录预处理、前向、后处理完成的时间, 可为 NULL
+    int ret;
+    int done;
+    struct InferenceRequest *next;
+} InferenceRequest;
+
+// 推理统计
+typedef struct
+{
+    uint64_t requests; // 完成的请求数
+    uint64_t batches;  // 前向调用次数(合批后)
+    uint64_t images;   // 送入网络的图像数(含切片和关注区域裁剪)
+} InferenceServiceStats;
+
+// 推理服务: 一个模型和一个推理线程, 由推理线程把提交到该服务的各路请求合成批次
+typedef struct InferenceService
+{
+    Yolov8Model model;
+    const DetectorConfig *detector; // 模型配置, 推理线程启动后据此加载模型
+    ThreadConfig threads;           // 推理线程的线程配置, numa_node 为该服务绑定的节点
+    int load_ret;                   // 推理线程加载模型的结果
+    int loaded;                     // 推理线程已完成加载(无论成功与否)
+    int batch_wait_ms; // 为凑满批量等待的最长时间
+    pthread_mutex_t lock;
+    pthread_cond_t request_cond; // 有新请求
+    pthread_cond_t done_cond;    // 有请求完成
+    InferenceRequest *head;
+    InferenceRequest *tail;
+    int running;
+    pthread_t thread;
+    InferenceServiceStats stats;
+    // 导出的指标
+    Metric *requests_total;
+    Metric *batches_total;
+    Metric *images_total;
+    Metric *errors_total;
+    Metric *batch_latency; // 一次合批前向(含预处理和后处理)的耗时
+} InferenceService;
+
+// 按 NUMA 节点划分的推理服务: 每个用到的节点一份模型和一个推理线程, 各路摄像头只向所在节点的服务提交,
+// 帧、模型权重和前向计算都留在同一节点; 不绑定节点的摄像头共用一个不绑定的服务
+typedef struct
+{
+    DetectorConfig detector;
+    ThreadConfig threads;
+    InferenceService *services[NUMA_MAX_NODES + 1]; // [0] 不绑定节点, [n + 1] 绑定节点 n; NULL 表示尚未创建
+    pthread_mutex_t lock;
+} InferencePool;
+
+/// @brief 启动推理线程, 推理线程按 inference 阶段和 numa_node 绑定后再加载模型, 权重分配在该节点上
+/// @param service 推理服务
+/// @param detector 检测器配置, 模型相关的键对所有视频流生效; 须在服务停止前保持有效
+/// @param threads 线程配置, 推理线程按 inference 阶段设置亲和性和调度策略
+/// @param numa_node 推理线程绑定的 NUMA 节点, -1 不绑定
+/// @return 0 成功，-1 失败
+int inference_service_init(InferenceService *service, const DetectorConfig *detector, const ThreadConfig *threads,
+                           int numa_node);
+
+/// @brief 提交一帧并等待结果; 多路同时提交时合并为一次前向
+/// @param service 推理服务
+/// @param frame RGB 图像
+/// @param regions 推理区域, 为空时对整帧推理
+/// @param post 该路的后处理参数, 为 NULL 时使用模型的默认值
+/// @param boxes 检测结果, 坐标已映射回整帧
+/// @param trace 帧的跟踪记录, 可为 NULL
+/// @return 0 成功，-1 失败或服务已停止
+int inference_service_submit(InferenceService *service, const cv::Mat &frame, const std::vector<cv::Rect> &regions,
+                             const Yolov8Postprocess *post, std::vector<Box> &boxes, FrameTrace *trace);
+
+/// @brief 停止推理线程, 未完成的请求以失败返回, 然后释放模型
+/// @param service 推理服务
+void inference_service_stop(InferenceService *service);
+
+// 打印合批统计
+void inference_service_dump_stats(InferenceService *service);
+
+/// @brief 初始化推理服务池, 并为全局 numa_node 预先创建服务: none 或单节点机器时一个不绑定的服务,
+///        auto 时每个节点一个, 指定节点时该节点一个; 模型无效时在这里失败
+/// @param pool 服务池
+/// @param detector 检测器配置
+/// @param threads 全局线程配置
+/// @return 0 成功，-1 失败
+int inference_pool_init(InferencePool *pool, const DetectorConfig *detector, const ThreadConfig *threads);
+
+/// @brief 取节点对应的推理服务, 尚未创建时加载一份模型; 加载失败时退回已有的服务
+/// @param pool 服务池
+/// @param numa_node 摄像头所在节点, -1 不绑定
+/// @return 推理服务, 没有可用服务时返回 NULL
+InferenceService *inference_pool_get(InferencePool *pool, int numa_node);
+
+/// @brief 停止所有推理服务并释放模型
+/// @param pool 服务池
+void inference_pool_stop(InferencePool *pool);
+
+// 打印各服务的合批统计
+void inference_pool_dump_stats(InferencePool *pool);
+
+#endif // INFERENCE_SERVICE_H
@@ -0,0 +1,74 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef LABEL_MAP_H
+#define LABEL_MAP_H
+
+#define MAX_LABEL_LENGTH 40
+
+// 类别 ID 到名称的映射
+typedef struct
+{
+    int count;                        // 类别数
+    char (*names)[MAX_LABEL_LENGTH];  // 类别名称
+    char source[256];                 // 映射来源, 用于日志
+} LabelMap;
+
+/// @brief 加载类别映射, 依次尝试:
+///        1. labels_path 指定的文件
+///        2. 模型同名的 .names / .yaml 文件, 以及模型目录下的 data.yaml
+///        3. ONNX 模型的 metadata_props 中的 names (Ultralytics 导出时写入)
+///        4. 内置的 COCO 80 类
+/// @param map 类别映射
+/// @param labels_path 标签文件路径, 可为空字符串
+/// @param model_path 模型文件路径
+/// @return 0 成功，-1 失败
+int label_map_load(LabelMap *map, const char *labels_path, const char *model_path);
+
+/// @brief 从文件加载类别映射, .yaml / .yml 按 YAML 的 names 字段解析, 其他按每行一个名称解析
+/// @param map 类别映射
+/// @param path 文件路径
+/// @return 0 成功，-1 失败
+int label_map_load_file(LabelMap *map, const char *path);
+
+/// @brief 释放类别映射
+/// @param map 类别映射
+void label_map_free(LabelMap *map);
+
+/// @brief 按 ID 取类别名称
+/// @param map 类别映射
+/// @param id 类别 ID
+/// @return 类别名称, 越界时返回 "unknown"
+const char *label_map_name(const LabelMap *map, int id);
+
+/// @brief 按名称查找类别 ID
+/// @param map 类别映射
+/// @param name 类别名称
+/// @return 类别 ID, 未找到返回 -1
+int label_map_find(const LabelMap *map, const char *name);
+
+/// @brief 解析类别列表, 以逗号分隔, 每项为类别名称或数字 ID
+/// @param map 类别映射
+/// @param list 类别列表, 如 "person, car, 7"
+/// @param num_classes 模型输出的类别数, ID 必须小于该值
+/// @param ids 输出类别 ID
+/// @param max_ids ids 容量
+/// @return 解析出的类别数, 有无法识别或越界的类别时返回 -1
+int label_map_parse_class_list(const LabelMap *map, const char *list, int num_classes, int *ids, int max_ids);
+
+// 打印类别映射
+void label_map_dump(const LabelMap *map);
+
+#endif // LABEL_MAP_H
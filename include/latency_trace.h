@@ -0,0 +1,127 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <stdint.h>
+#include "config.h"
+
+// 帧经过的时间点
+typedef enum
+{
+    TRACE_DEMUX,       // 读到数据包
+    TRACE_DECODE,      // 解码完成
+    TRACE_ENQUEUE,     // 放入下游队列
+    TRACE_DEQUEUE,     // 消费方取出, 每个消费方各自一份
+    TRACE_PREPROCESS,  // 输入张量就绪
+    TRACE_INFER,       // 前向完成
+    TRACE_POSTPROCESS, // 检测框解码完成
+    TRACE_ENCODE,      // 编码器输出数据包
+    TRACE_MUX,         // 数据包写入输出
+    TRACE_POINT_COUNT
+} TracePoint;
+
+// 随帧传递的跟踪记录, 由 QueueItem 按值复制给各个消费方
+typedef struct
+{
+    uint64_t seq;                       // 该路视频流内的帧序号
+    uint64_t stamps[TRACE_POINT_COUNT]; // 跟踪时钟刻度, 0 表示未经过该点
+} FrameTrace;
+
+// 统计的区间
+typedef enum
+{
+    SPAN_DECODE,             // 读包到解码完成
+    SPAN_QUEUE_RENDER,       // 入队到被渲染线程取出
+    SPAN_QUEUE_PUSH,         // 入队到被推流线程取出
+    SPAN_QUEUE_RECORD,       // 入队到被录像线程取出
+    SPAN_QUEUE_DETECT,       // 入队到被检测线程取出
+    SPAN_DETECT_PREPROCESS,  // 取出到输入张量就绪(含格式转换、合批等待)
+    SPAN_DETECT_INFER,       // 前向
+    SPAN_DETECT_POSTPROCESS, // 检测框解码和 NMS
+    SPAN_PUSH_ENCODE,        // 推流: 取出到编码完成
+    SPAN_PUSH_MUX,           // 推流: 编码完成到写入输出
+    SPAN_RECORD_ENCODE,      // 录像: 取出到编码完成
+    SPAN_RECORD_MUX,         // 录像: 编码完成到写入文件
+    SPAN_E2E_PUSH,           // 读包到推流写入输出
+    SPAN_E2E_DETECT,         // 读包到检测结果就绪
+    TRACE_SPAN_COUNT
+} TraceSpan;
+
+// 对数直方图(微秒): 每个 2 倍区间再等分为 4 个桶, 相对误差不超过 25%; 0~3 微秒各占一个桶
+#define TRACE_BUCKETS 128
+typedef struct
+{
+    uint64_t buckets[TRACE_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+} TraceHistogram;
+
+/// @brief 微秒数所在的直方图桶
+int trace_bucket_index(uint64_t us);
+
+/// @brief 桶的上界(微秒, 不含)
+double trace_bucket_upper_us(int bucket);
+
+/// @brief 初始化跟踪: 检查 TSC 是否恒定速率并校准, 否则使用 CLOCK_MONOTONIC
+/// @param config 跟踪配置
+void latency_trace_init(const TraceConfig *config);
+
+// 是否启用跟踪
+int latency_trace_enabled();
+
+/// @brief 读取跟踪时钟
+/// @return 刻度, 由 trace_ticks_to_us 换算
+uint64_t trace_now();
+
+/// @brief 刻度换算为微秒
+double trace_ticks_to_us(uint64_t ticks);
+
+/// @brief 记录当前时间到帧的某个时间点; 未启用或 trace 为 NULL 时忽略
+void trace_stamp(FrameTrace *trace, TracePoint point);
+
+/// @brief 把区间 [from, to] 的耗时计入调用线程自己的直方图, 不加锁; 任一时间点缺失时忽略
+/// @param span 区间
+/// @param trace 跟踪记录
+/// @param from 起点
+/// @param to 终点
+void trace_record(TraceSpan span, const FrameTrace *trace, TracePoint from, TracePoint to);
+
+/// @brief 端到端耗时超过 slow_frame_ms 时打印该帧各段的耗时
+/// @param stream 视频流名称
+/// @param trace 跟踪记录
+/// @param end 终点
+void trace_report_slow(const char *stream, const FrameTrace *trace, TracePoint end);
+
+/// @brief 汇总所有线程(含已退出线程)的直方图
+/// @param out 输出, TRACE_SPAN_COUNT 个
+void latency_trace_snapshot(TraceHistogram *out);
+
+/// @brief 直方图的分位数
+/// @param histogram 直方图
+/// @param quantile 0~1
+/// @return 微秒, 取所在桶的上界
+double trace_histogram_quantile(const TraceHistogram *histogram, double quantile);
+
+// 区间名称, 用于日志和指标
+const char *trace_span_name(TraceSpan span);
+
+// 打印各区间的样本数、平均值和分位数
+void latency_trace_dump();
+
+#endif // LATENCY_TRACE_H
@@ -22,16 +22,27 @@ extern "C"
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
-#include <SDL2/SDL.h>
 }
 #include "frame_queue.h"
+#include "context.h"
 // 获取错误字符串的全局缓冲区实现
 const char *get_av_error(int errnum);
 
+// FFmpeg 中断回调, opaque 为 Context; 上下文被取消后阻塞中的网络读写立即返回
+int context_interrupt_callback(void *opaque);
+
+/// @brief 打开输入; "lavfi:<滤镜图>" 使用 FFmpeg 的 lavfi 测试源(如 lavfi:testsrc2=size=1280x720:rate=25:duration=30),
+///        其余按普通地址(RTSP、本地文件等)打开
+/// @param fmt_ctx 已分配的格式上下文, 失败时由 FFmpeg 释放并置空
+/// @param url 输入地址
+/// @return 0 成功，负数为 FFmpeg 错误码
+int open_input_stream(AVFormatContext **fmt_ctx, const char *url);
+
+/// @brief 输出地址对应的封装格式: "null" 为丢弃数据的空封装(仍然完整编码, 用于压测), 其余为 flv
+const char *output_format_name(const char *url);
+
 // 截图
 void save_frame_as_bmp(AVFrame *frame, const char *filename);
 //
-Box InterpolateBox(Box prevBox, Box currentBox, float t);
-//
 void copy_codec_context_properties(AVCodecContext *src_ctx, AVCodecContext *dst_ctx);
 #endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "latency_trace.h"
+
+// 指标类型
+typedef enum
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} MetricType;
+
+// 一条指标(名称 + 标签), 注册后常驻到 metrics_unregister_label 删除或进程退出; 热路径只做原子加减, 不加锁
+typedef struct Metric
+{
+    char name[64];
+    char labels[128]; // 如 stream="cam1",queue="detect", 可为空
+    const char *help;
+    MetricType type;
+    int64_t value;            // 计数器和仪表盘的值
+    TraceHistogram histogram; // 直方图, 桶与延迟跟踪相同(微秒, 每个 2 倍区间 4 个桶)
+    struct Metric *next;
+} Metric;
+
+// 抓取时输出的文本
+typedef struct
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+    int failed; // 内存不足, 输出不完整
+} MetricsBuffer;
+
+// 抓取时调用的采集函数, 用于队列深度等需要现场读取的值
+typedef void (*MetricsCollector)(MetricsBuffer *out, void *arg);
+
+/// @brief 查找或注册计数器; 名称和标签都相同时返回同一条指标, 重启的线程可继续累加
+/// @param name 指标名
+/// @param help 说明, 须为常量字符串
+/// @param labels 标签, 可为 NULL
+/// @return 指标, 内存不足时返回 NULL(各更新函数忽略 NULL)
+Metric *metrics_counter(const char *name, const char *help, const char *labels);
+
+/// @brief 查找或注册仪表盘, 参数同 metrics_counter
+Metric *metrics_gauge(const char *name, const char *help, const char *labels);
+
+/// @brief 查找或注册直方图(以秒为单位输出), 参数同 metrics_counter
+Metric *metrics_histogram(const char *name, const char *help, const char *labels);
+
+/// @brief 查找已注册的指标, 不存在时不注册
+/// @return 指标, 不存在时返回 NULL
+Metric *metrics_find(const char *name, const char *labels);
+
+/// @brief 删除标签中含有 label 的全部指标, 如删除视频流时传入 stream="cam1"
+/// @param label 完整的一个标签, 形如 key="value"
+/// @return 删除的条数
+/// @note 调用前须确保没有线程还持有这些指标的指针(对应的线程已全部退出)
+int metrics_unregister_label(const char *label);
+
+// 计数器或仪表盘的当前值, metric 为 NULL 时返回 0
+int64_t metric_value(const Metric *metric);
+
+// 计数器或仪表盘加 n
+void metric_add(Metric *metric, int64_t n);
+
+// 设置仪表盘的值
+void metric_set(Metric *metric, int64_t value);
+
+// 直方图记录一个样本(微秒)
+void metric_observe_us(Metric *metric, uint64_t us);
+
+/// @brief 注册采集函数
+/// @param collect 采集函数, 在抓取线程中调用, 不能再注册指标
+/// @param arg 参数
+void metrics_register_collector(MetricsCollector collect, void *arg);
+
+/// @brief 注销采集函数; 返回后该函数不会再被调用
+void metrics_unregister_collector(MetricsCollector collect, void *arg);
+
+/// @brief 输出一个指标族的 HELP 和 TYPE 行, 供采集函数使用
+void metrics_write_header(MetricsBuffer *out, const char *name, const char *help, MetricType type);
+
+/// @brief 输出一个样本, 供采集函数使用
+/// @param out 输出
+/// @param name 指标名
+/// @param labels 标签, 可为 NULL
+/// @param value 值
+void metrics_write_sample(MetricsBuffer *out, const char *name, const char *labels, double value);
+
+/// @brief 输出一个直方图的 _bucket/_sum/_count 样本(秒), 供采集函数使用
+void metrics_write_histogram(MetricsBuffer *out, const char *name, const char *labels,
+                             const TraceHistogram *histogram);
+
+/// @brief 按 Prometheus 文本格式输出全部指标
+/// @param out 输出, 由调用方 metrics_buffer_free
+/// @return 0 成功，-1 内存不足
+int metrics_render(MetricsBuffer *out);
+
+// 释放输出文本
+void metrics_buffer_free(MetricsBuffer *out);
+
+#endif // METRICS_H
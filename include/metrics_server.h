@@ -0,0 +1,41 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <pthread.h>
+
+// 指标接口: 极简 HTTP/1.0 服务, GET /metrics 返回 Prometheus 文本格式, 每个连接只处理一个请求
+typedef struct
+{
+    char listen_addr[64];
+    int listen_fd;
+    volatile int running;
+    pthread_t thread;
+} MetricsServer;
+
+/// @brief 创建监听套接字并启动指标线程
+/// @param server 指标接口
+/// @param listen_addr 监听地址, host:port 或 port(监听所有地址)
+/// @return 0 成功，-1 失败
+int metrics_server_start(MetricsServer *server, const char *listen_addr);
+
+/// @brief 停止指标线程
+/// @param server 指标接口
+void metrics_server_stop(MetricsServer *server);
+
+#endif // METRICS_SERVER_H
@@ -0,0 +1,88 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <stdint.h>
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+#include "config.h"
+
+// 亮度降采样网格尺寸
+#define MOTION_GRID_WIDTH 64
+#define MOTION_GRID_HEIGHT 36
+
+// 运动门控统计
+typedef struct
+{
+    uint64_t frames_total;     // 检查过的帧数
+    uint64_t frames_inferred;  // 门控放行的帧数(是否推理还取决于帧率控制)
+    uint64_t frames_skipped;   // 因画面静止跳过的帧数
+    uint64_t keepalive_frames; // 因保活放行的帧数
+    float last_motion_ratio;   // 最近一帧的运动单元比例
+} MotionGateStats;
+
+// 运动门控: 在降采样的亮度网格上维护滑动平均背景,
+// 变化单元比例超过阈值或到达保活间隔时才放行推理
+typedef struct
+{
+    MotionGateConfig config;
+    float background[MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT];
+    uint8_t changed[MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT]; // 上次推理以来发生过变化的网格单元
+    int width;
+    int height;
+    int initialized;
+    int frames_since_infer;
+    int pending; // 上次推理以来出现过运动或到达保活间隔, 推理后由 motion_gate_consume 清除
+    MotionGateStats stats;
+} MotionGate;
+
+/// @brief 判断帧的 data[0] 是否为 8 位亮度平面
+/// @param frame 解码后的帧
+/// @return 1 是，0 否
+int frame_has_luma_plane(const AVFrame *frame);
+
+/// @brief 初始化运动门控
+/// @param gate 门控
+/// @param config 配置
+void motion_gate_init(MotionGate *gate, const MotionGateConfig *config);
+
+/// @brief 每帧调用一次, 更新背景模型并判断上次推理以来是否需要推理;
+///        运动和保活在推理前保持放行, 背景更新速率和保活间隔与帧率控制的步长无关
+/// @param gate 门控
+/// @param frame 解码后的帧, 直接读取 data[0] 亮度平面
+/// @return 1 需要推理，0 跳过
+int motion_gate_check(MotionGate *gate, const AVFrame *frame);
+
+/// @brief 实际推理(或命中缓存)后调用, 清除累积的运动状态并重新开始保活计数
+/// @param gate 门控
+void motion_gate_consume(MotionGate *gate);
+
+/// @brief 查询画面中的矩形区域在上次推理以来是否有运动
+/// @param gate 门控
+/// @param x 区域左上角 x(像素)
+/// @param y 区域左上角 y(像素)
+/// @param w 区域宽度
+/// @param h 区域高度
+/// @return 1 有运动或门控未启用，0 静止
+int motion_gate_region_active(const MotionGate *gate, int x, int y, int w, int h);
+
+// 打印门控统计
+void motion_gate_dump_stats(const MotionGate *gate);
+
+#endif // MOTION_GATE_H
@@ -0,0 +1,52 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef NMS_H
+#define NMS_H
+
+#include <vector>
+
+// NMS 候选框, 按列存储(SoA), 便于编译器对 IoU 计算做向量化
+typedef struct
+{
+    std::vector<float> x1, y1, x2, y2; // 左上角和右下角
+    std::vector<float> score;          // 置信度
+    std::vector<int> class_id;         // 类别 ID
+    std::vector<int> image;            // 批量模式下所属的图片序号, 单图时为 0
+} NmsCandidates;
+
+/// @brief 清空候选框, 保留已分配的内存
+/// @param candidates 候选框
+void nms_candidates_clear(NmsCandidates *candidates);
+
+/// @brief 追加一个候选框
+/// @param candidates 候选框
+/// @param x 左上角 x
+/// @param y 左上角 y
+/// @param w 宽
+/// @param h 高
+/// @param score 置信度
+/// @param class_id 类别 ID
+/// @param image 所属图片序号
+void nms_candidates_add(NmsCandidates *candidates, float x, float y, float w, float h, float score, int class_id,
+                        int image);
+
+/// @brief 按类别(批量模式下按图片和类别)做非极大值抑制, 不同类别、不同图片的框互不抑制
+/// @param candidates 候选框, 应已按置信度阈值过滤
+/// @param iou_threshold IoU 超过该值的低分框被抑制
+/// @param keep 输出保留的候选框下标, 按置信度降序
+void nms_run(const NmsCandidates *candidates, float iou_threshold, std::vector<int> &keep);
+
+#endif // NMS_H
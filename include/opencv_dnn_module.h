@@ -24,10 +24,13 @@
 // 初始化YOLOv8模型
 int Init_CV_ONNX_DNN_Yolov8(const char *model_path, cv::dnn::Net *net);
 
-// 执行YOLOv8推理
-int Infer_CV_ONNX_DNN_Yolov8(cv::dnn::Net *net, cv::Mat frame, std::vector<Box> &boxes);
-
 // 释放模型资源
 int Release_CV_ONNX_DNN_Yolov8(cv::dnn::Net *net);
 
+// OpenCV DNN 计算后端名称转换: opencv / openvino / cuda / default
+int CV_DNN_Backend_From_Name(const char *name);
+
+// OpenCV DNN 计算设备名称转换: cpu / opencl / opencl_fp16 / cuda / cuda_fp16
+int CV_DNN_Target_From_Name(const char *name);
+
 #endif // OPENCV_DNN_MODULE_H
@@ -15,6 +15,7 @@
 #ifndef OPENCV_UTILS_H
 #define OPENCV_UTILS_H
 #include <opencv2/opencv.hpp>
+#include "nms.h"
 extern "C"
 {
 #include <libavutil/frame.h>
@@ -35,6 +36,16 @@ typedef struct
     float score;
     int class_id;
 } DnnResult;
+
+#define MAX_DETECTION_CLASSES 1024
+
+// 后处理的类别过滤: 只有列出的类别参与打分, 未列出的类别不会成为候选框
+typedef struct
+{
+    int count;                               // 参与打分的类别数
+    int ids[MAX_DETECTION_CLASSES];          // 类别 ID, 升序
+    float thresholds[MAX_DETECTION_CLASSES]; // 对应类别的置信度阈值
+} ClassFilter;
 /// @brief 将AVFrame转换为cv::Mat
 /// @param frame AVFrame指针
 /// @return
@@ -45,13 +56,20 @@ cv::Mat AVFrameToCVMat(AVFrame *frame);
 /// @return
 BestResult getBestFromConfidenceValue(float confidenceValues[], size_t size);
 
-/// @brief postprocess
-/// @param frame
-/// @param outs
-/// @param confThreshold
-/// @param nmsThreshold
-/// @return
-std::vector<DnnResult> postprocess(cv::Mat &frame, const std::vector<cv::Mat> &outs, float confThreshold, float nmsThreshold);
+/// @brief 从单张图片的网络输出中收集通过类别过滤和阈值的候选框
+/// @param out 网络输出, [4 + 类别数, 锚点数] 或 [1, 4 + 类别数, 锚点数]
+/// @param filter 参与打分的类别及其阈值
+/// @param image 图片序号, 用于批量 NMS
+/// @param candidates 追加候选框
+void yolov8_collect_candidates(const cv::Mat &out, const ClassFilter *filter, int image, NmsCandidates *candidates);
+
+/// @brief YOLOv8 后处理: 按类别过滤和阈值打分, 再做非极大值抑制
+/// @param frame 输入图像
+/// @param outs 网络输出
+/// @param filter 参与打分的类别及其置信度阈值
+/// @param nmsThreshold NMS 阈值
+/// @return 检测结果
+std::vector<DnnResult> postprocess(cv::Mat &frame, const std::vector<cv::Mat> &outs, const ClassFilter *filter, float nmsThreshold);
 // 函数：计算宽度和高度的缩放比例
 // @param original_width 原始图像的宽度
 // @param original_height 原始图像的高度
@@ -85,4 +103,11 @@ void letterbox(const cv::Mat *src, cv::Mat *dst, int new_width, int new_height,
 // @param letterboxed_size 经过 letterbox 处理后的图像尺寸
 // @return 原始图像上的矩形
 cv::Rect map_box_to_original(cv::Rect box, cv::Size original_size, cv::Size letterboxed_size);
+// YOLOv8 预处理: 逐张 letterbox 后打包为 NCHW 张量
+// @param frames 输入图像数组
+// @param count 图像数量
+// @param input_width 网络输入宽度
+// @param input_height 网络输入高度
+// @param blob 输出张量
+void yolov8_preprocess(const cv::Mat *frames, int count, int input_width, int input_height, cv::Mat &blob);
 #endif
\ No newline at end of file
@@ -0,0 +1,138 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include "config.h"
+#include "context.h"
+#include "frame_queue.h"
+#include "thread_args.h"
+#include "inference_service.h"
+#include "supervisor.h"
+#include "detection_log.h"
+
+// 每路流水线自有的队列: 检测、推流、录像、推理; 渲染队列由渲染线程所有
+#define PIPELINE_QUEUE_COUNT 4
+// 每个队列的最大长度
+#define PIPELINE_QUEUE_SIZE 60
+// lossless 时队列满后拉流最多阻塞的时间, 超过说明下游阶段已停止, 退回丢帧
+#define PIPELINE_BLOCK_TIMEOUT_MS 10000
+
+// 单路视频流的流水线: 拉流解码线程(再派生推流和录像线程)和检测线程, 推理由所在 NUMA 节点的推理服务完成
+typedef struct
+{
+    StreamConfig source; // 配置文件中的原始配置, reload 时据此判断是否变化
+    StreamConfig config; // 运行时配置(已确定 NUMA 节点), 线程参数指向这里
+    FrameQueue queues[PIPELINE_QUEUE_COUNT];
+    Context *ctx;       // 停止拉流, 其余阶段排空队列后退出; 每次重启拉流时更换
+    Context *abort_ctx; // 排空超时后强制检测线程退出
+    ThreadArgs args;
+    ThreadArgs detection_args;
+    SupervisedStage decode;    // 拉流解码线程, 它再监管推流和录像线程
+    SupervisedStage detection; // 检测线程
+    DetectionLogWriter *detection_log; // 检测结果记录, 检测线程重启时继续写入同一文件
+    struct timespec drain_deadline; // 停止时拉流、推流、录像和检测共用的排空截止时间, 由 pipeline_cancel 设置
+    int stopping;              // 已通知停止, 不再重启阶段
+    int started;
+} Pipeline;
+
+/// @brief 启动一路流水线
+/// @param pipeline 流水线, source 已设置; 启动后地址不能变化(线程参数指向其内部)
+/// @param pool 推理服务池, 检测线程使用该路所在 NUMA 节点的服务
+/// @param video_queue 渲染队列, 为 NULL 时不显示
+/// @param box_queue 检测框队列, 为 NULL 时不显示
+/// @return 0 成功，-1 失败
+int pipeline_start(Pipeline *pipeline, InferencePool *pool, FrameQueue *video_queue, FrameQueue *box_queue);
+
+/// @brief 通知流水线停止拉流; 队列中剩余的帧继续处理, 编码器冲刷后写入文件尾
+/// @param pipeline 流水线
+/// @param deadline 所有阶段排空的截止时间, 为 NULL 时取现在起 shutdown.drain_timeout_ms
+void pipeline_cancel(Pipeline *pipeline, const struct timespec *deadline);
+
+/// @brief 等待流水线的线程结束并释放队列和上下文; 超过 pipeline_cancel 确定的截止时间时强制退出
+/// @param pipeline 流水线
+void pipeline_join(Pipeline *pipeline);
+
+/// @brief 检查拉流和检测阶段: 停滞的拉流被中断, 已退出的阶段按退避单独重启, 其余阶段继续运行
+/// @param pipeline 流水线, 调用方持有管理器的 lock
+void pipeline_supervise(Pipeline *pipeline);
+
+// 流水线管理器: 运行时按名称增删、启停和重新配置单路流水线, 已加载的模型和渲染窗口保持不变
+typedef struct
+{
+    Pipeline *pipelines[MAX_STREAMS]; // 单独分配, 保证运行中的流水线地址不变; NULL 表示空槽
+    InferencePool *inference_pool;
+    FrameQueue *video_queue; // 渲染窗口的队列, 同一时间只属于一路
+    FrameQueue *box_queue;
+    char display[64];        // 显示在渲染窗口的视频流名称
+    pthread_mutex_t lock;
+    pthread_t supervisor_thread; // 定期对各路调用 pipeline_supervise
+    Context *supervisor_ctx;
+} PipelineManager;
+
+/// @brief 初始化管理器并启动监管线程
+/// @param manager 管理器
+/// @param inference_pool 推理服务池
+/// @param video_queue 渲染队列, 为 NULL 时(无显示模式)各路都不显示
+/// @param box_queue 检测框队列, 为 NULL 时不显示
+/// @param threads 线程配置, 监管线程按后台任务阶段设置
+/// @return 0 成功，-1 失败
+int pipeline_manager_init(PipelineManager *manager, InferencePool *inference_pool,
+                          FrameQueue *video_queue, FrameQueue *box_queue, const ThreadConfig *threads);
+
+/// @brief 新增一路流水线; 第一路新增的视频流显示在渲染窗口
+/// @param manager 管理器
+/// @param config 配置, name 不能与已有的重复
+/// @param start 是否立即启动
+/// @return 0 成功，-1 失败
+int pipeline_manager_add(PipelineManager *manager, const StreamConfig *config, int start);
+
+/// @brief 停止并删除一路流水线
+/// @return 0 成功，-1 不存在
+int pipeline_manager_remove(PipelineManager *manager, const char *name);
+
+/// @brief 启动已停止的流水线
+/// @return 0 成功，-1 不存在或启动失败
+int pipeline_manager_start(PipelineManager *manager, const char *name);
+
+/// @brief 停止流水线, 保留其配置
+/// @return 0 成功，-1 不存在
+int pipeline_manager_stop(PipelineManager *manager, const char *name);
+
+/// @brief 重启流水线
+/// @return 0 成功，-1 不存在或启动失败
+int pipeline_manager_restart(PipelineManager *manager, const char *name);
+
+/// @brief 修改一路的一个配置项, 运行中的流水线随即重启生效
+/// @param key 键, 形如 input_url 或 motion.enabled
+/// @return 0 成功，-1 不存在、键无效或启动失败
+int pipeline_manager_set(PipelineManager *manager, const char *name, const char *key, const char *value);
+
+/// @brief 按新的进程配置调整: 新增的视频流启动, 配置变化的重启, 已不存在的删除
+/// @return 0 成功，-1 部分视频流启动失败
+int pipeline_manager_apply(PipelineManager *manager, const ProcessConfig *process);
+
+/// @brief 列出各路的名称、状态和地址, 每行一路
+/// @param buffer 输出缓冲区
+/// @param size 缓冲区大小
+void pipeline_manager_list(PipelineManager *manager, char *buffer, size_t size);
+
+/// @brief 停止并删除所有流水线; 各路共用一个排空截止时间, 总等待不超过 drain_timeout_ms
+void pipeline_manager_destroy(PipelineManager *manager);
+
+#endif // PIPELINE_H
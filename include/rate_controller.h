@@ -0,0 +1,71 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RATE_CONTROLLER_H
+#define RATE_CONTROLLER_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define MAX_RATE_STREAMS 64
+
+// 单路摄像头的检测帧率状态
+typedef struct
+{
+    char name[64];
+    RateControlConfig config;
+    int fallback_stride;      // 未启用或尚无耗时数据时的步长(detect_interval)
+    int stride;               // 当前检测步长, 每 stride 帧推理一次
+    int frames_since_detect;  // 距上次放行的帧数
+    double fps;               // 输入帧率估计
+    double latency_ms;        // 单次推理耗时的滑动平均
+    double last_frame_time;   // 上一帧的时间戳(秒)
+    double last_hit_time;     // 最近一次检测到目标的时间(秒)
+    uint64_t frames_total;    // 到达的帧数
+    uint64_t frames_detected; // 放行推理的帧数
+    int active;
+} RateStream;
+
+/// @brief 初始化全局帧率控制器, 所有摄像头共享同一份 CPU 预算
+/// @param config 全局配置(target_load, update_interval_ms)
+void rate_controller_init(const RateControlConfig *config);
+
+/// @brief 注册一路摄像头
+/// @param name 名称, 用于日志
+/// @param config 该路的配置(min_fps, boost_factor, boost_seconds)
+/// @param fallback_stride 未启用控制或尚无耗时数据时使用的步长
+/// @return 摄像头状态, 已满时返回 NULL
+RateStream *rate_controller_register(const char *name, const RateControlConfig *config, int fallback_stride);
+
+/// @brief 注销一路摄像头, 其预算分给其他摄像头
+/// @param stream 摄像头状态
+void rate_controller_unregister(RateStream *stream);
+
+/// @brief 每帧到达时调用, 更新帧率估计并判断该帧是否推理
+/// @param stream 摄像头状态
+/// @param timestamp 帧的显示时间(秒), 由 pts 换算; 未知时传负数, 退化为按到达时间估计
+/// @return 1 推理，0 跳过
+int rate_controller_should_detect(RateStream *stream, double timestamp);
+
+/// @brief 上报一次检测的结果
+/// @param stream 摄像头状态
+/// @param latency_ms 推理耗时, 未实际推理(如命中缓存)时传负数
+/// @param detections 检测到的目标数
+void rate_controller_report(RateStream *stream, double latency_ms, int detections);
+
+// 打印各路的检测步长和帧率
+void rate_controller_dump_stats();
+
+#endif // RATE_CONTROLLER_H
@@ -0,0 +1,38 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ROI_H
+#define ROI_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "config.h"
+#include "frame_queue.h"
+
+/// @brief 计算需要推理的裁剪区域: 关注区域的外接矩形, 相互重叠的矩形会合并
+/// @param roi 感兴趣区域配置
+/// @param width 画面宽度
+/// @param height 画面高度
+/// @param crops 输出裁剪区域, 未配置关注区域时为空(整帧推理)
+void roi_compute_crops(const RoiConfig *roi, int width, int height, std::vector<cv::Rect> &crops);
+
+/// @brief 过滤检测结果: 中心不在任何关注区域内或落在屏蔽区域内的检测被丢弃
+/// @param roi 感兴趣区域配置
+/// @param width 画面宽度
+/// @param height 画面高度
+/// @param boxes 检测结果, 原地过滤
+void roi_filter_detections(const RoiConfig *roi, int width, int height, std::vector<Box> &boxes);
+
+#endif // ROI_H
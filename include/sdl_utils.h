@@ -23,6 +23,48 @@ extern "C"
 #include <SDL2/SDL_ttf.h>
 }
 #include "frame_queue.h"
+
+// 字形图集: 可打印 ASCII 字符启动时一次性渲染到同一张纹理,
+// 绘制文本时逐字符从子区域 SDL_RenderCopy, 每帧不再为每个标签创建表面、上传纹理
+#define GLYPH_ATLAS_FIRST 32 // ' '
+#define GLYPH_ATLAS_COUNT 95 // ' ' 到 '~'
+// 图集纹理的最大宽度, 超出时换行
+#define GLYPH_ATLAS_MAX_WIDTH 1024
+
+typedef struct
+{
+    SDL_Texture *texture;              // 白色字形, 绘制时按颜色调制
+    SDL_Rect glyphs[GLYPH_ATLAS_COUNT]; // 各字形在纹理中的位置
+    int advance[GLYPH_ATLAS_COUNT];    // 绘制后笔位置的前进量
+    int height;                        // 行高
+} GlyphAtlas;
+
+/// @brief 渲染字形图集
+/// @param atlas 图集
+/// @param renderer 渲染器
+/// @param font 字体
+/// @return 0 成功，-1 失败
+int glyph_atlas_init(GlyphAtlas *atlas, SDL_Renderer *renderer, TTF_Font *font);
+
+/// @brief 释放图集纹理
+/// @param atlas 图集
+void glyph_atlas_destroy(GlyphAtlas *atlas);
+
+/// @brief 文本绘制后的宽度
+/// @param atlas 图集
+/// @param text 文本, 图集外的字符按 '?' 计算
+/// @return 宽度(像素)
+int glyph_atlas_text_width(const GlyphAtlas *atlas, const char *text);
+
+/// @brief 绘制一行文本
+/// @param atlas 图集
+/// @param renderer 渲染器
+/// @param text 文本, 图集外的字符显示为 '?'
+/// @param x 左上角 x
+/// @param y 左上角 y
+/// @param color 文本颜色
+void glyph_atlas_draw(GlyphAtlas *atlas, SDL_Renderer *renderer, const char *text, int x, int y, SDL_Color color);
+
 /// @brief
 /// @param y_plane
 /// @param uv_plane
@@ -42,33 +84,30 @@ void SDLDisplayNV12Frame(SDL_Renderer *renderer, SDL_Texture *texture, AVFrame *
 
 /// @brief
 /// @param renderer
-/// @param texture
-/// @param font
+/// @param atlas
 /// @param text
 /// @param x
 /// @param y
-void SDLDrawText(SDL_Renderer *renderer, SDL_Texture *texture, TTF_Font *font,
-                 const char *text, int x, int y);
+void SDLDrawText(SDL_Renderer *renderer, GlyphAtlas *atlas, const char *text, int x, int y);
 
 /// @brief
 /// @param renderer
-/// @param texture
-/// @param font
+/// @param atlas
 /// @param text
 /// @param x
 /// @param y
-void SDLDrawLabel(SDL_Renderer *renderer, TTF_Font *font, const char *text,
+void SDLDrawLabel(SDL_Renderer *renderer, GlyphAtlas *atlas, const char *text,
                   int x, int y, SDL_Color textColor, SDL_Color backgroundColor);
 /// @brief
 /// @param renderer
-/// @param font
+/// @param atlas
 /// @param text
 /// @param x
 /// @param y
 /// @param w
 /// @param h
 /// @param thickness
-void SDLDrawBox(SDL_Renderer *renderer, TTF_Font *font, const char *text,
+void SDLDrawBox(SDL_Renderer *renderer, GlyphAtlas *atlas, const char *text,
                 int x, int y, int w, int h, int thickness);
 
 /// @brief
@@ -0,0 +1,84 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <pthread.h>
+#include <time.h>
+#include "config.h"
+#include "metrics.h"
+
+// 受监管的阶段线程: 线程函数通过心跳报告进度, 结束(包括 pthread_exit)时自动标记,
+// 由所属方检测退出或停滞, 并按指数退避单独重启该阶段
+typedef struct SupervisedStage
+{
+    char name[32];             // 阶段名称, 用于日志
+    pthread_t thread;
+    volatile int running;      // 线程运行中, 线程结束时清零
+    volatile int idle;         // 正在等待输入, 此时没有心跳不算停滞
+    volatile double last_beat; // 最近一次心跳, CLOCK_MONOTONIC 秒
+    int joinable;              // 线程已创建且尚未回收
+    int stalled;               // 已报告停滞, 下次心跳时清除
+    double started_at;         // 本次启动的时间
+    double restart_at;         // 允许重启的时间, 0 表示尚未安排
+    int backoff_ms;            // 本次重启前的等待时间
+    int restarts;              // 重启次数
+    Metric *restarts_total;    // 导出的重启次数, 同名阶段重新初始化后继续累加
+    Metric *stalls_total;      // 导出的停滞次数
+} SupervisedStage;
+
+/// @brief 初始化阶段状态
+/// @param stage 阶段
+/// @param name 名称, 用于日志和指标, 形如 "视频流/阶段"
+void supervised_stage_init(SupervisedStage *stage, const char *name);
+
+/// @brief 按阶段配置启动线程, 线程结束时自动清除 running
+/// @param stage 阶段
+/// @param pipeline_stage 流水线阶段, 决定 CPU 亲和性和调度策略
+/// @param config 线程配置
+/// @param start_routine 线程函数
+/// @param arg 线程参数
+/// @return 0 成功，-1 失败(稍后由 supervised_stage_due 安排重试)
+int supervised_stage_start(SupervisedStage *stage, PipelineStage pipeline_stage, const ThreadConfig *config,
+                           void *(*start_routine)(void *), void *arg);
+
+/// @brief 线程函数每处理一个单元调用一次, 报告仍在前进; stage 为 NULL 时忽略
+void stage_heartbeat(SupervisedStage *stage);
+
+/// @brief 线程即将阻塞等待输入时调用, 等待期间不计入停滞; stage 为 NULL 时忽略
+void stage_wait(SupervisedStage *stage);
+
+/// @brief 判断阶段是否停滞: 运行中、不在等待输入, 且超过 stall_timeout_ms 没有心跳; 每次停滞只报告一次
+/// @param stage 阶段
+/// @param config 监管配置
+/// @return 1 停滞，0 正常
+int supervised_stage_stalled(SupervisedStage *stage, const SupervisorConfig *config);
+
+/// @brief 线程已退出时回收线程并安排重启: 首次等待 backoff_initial_ms, 连续失败时加倍,
+///        上限 backoff_max_ms; 上次运行超过 backoff_max_ms 时退避重置
+/// @param stage 阶段
+/// @param config 监管配置
+/// @return 1 应当立即重启，0 仍在运行或仍在退避中
+int supervised_stage_due(SupervisedStage *stage, const SupervisorConfig *config);
+
+/// @brief 在截止时间前等待线程结束
+/// @param stage 阶段
+/// @param deadline 截止时间, 为 NULL 时一直等待
+/// @return 0 已结束或未启动，-1 超时
+int supervised_stage_join(SupervisedStage *stage, const struct timespec *deadline);
+
+#endif // SUPERVISOR_H
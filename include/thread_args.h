@@ -15,8 +15,10 @@
 
 #ifndef THREAD_ARGS
 #define THREAD_ARGS
+#include <time.h>
 #include "frame_queue.h"
 #include "context.h"
+#include "config.h"
 
 typedef struct
 {
@@ -30,6 +32,11 @@ typedef struct
     FrameQueue *infer_frame_queue;
     AVStream *input_stream;
     Context *ctx;
+    const StreamConfig *config;
+    struct InferenceService *inference; // 所在 NUMA 节点的推理服务
+    struct SupervisedStage *health;     // 本线程的心跳, 不受监管时为 NULL
+    struct DetectionLogWriter *detection_log; // 检测结果记录, 不记录时为 NULL
+    const struct timespec *drain_deadline;    // 停止时各阶段共用的排空截止时间, 在 ctx->mtx 下读取, tv_sec 为 0 表示未设置
 
 } ThreadArgs;
 
@@ -0,0 +1,83 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef THREAD_UTILS_H
+#define THREAD_UTILS_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "config.h"
+
+// 参与 NUMA 放置的最大节点数
+#define NUMA_MAX_NODES 64
+
+/// @brief 解析 CPU 列表, 如 "0-3,6"
+/// @param list CPU 列表
+/// @param set 输出 CPU 集合
+/// @return 0 成功，-1 格式错误或为空
+int parse_cpu_list(const char *list, cpu_set_t *set);
+
+/// @brief 系统的 NUMA 节点数
+/// @return 节点数, 无法读取 sysfs 时返回 1
+int numa_node_count();
+
+/// @brief 读取 NUMA 节点包含的 CPU
+/// @param node 节点编号
+/// @param set 输出 CPU 集合
+/// @return 0 成功，-1 失败
+int numa_node_cpus(int node, cpu_set_t *set);
+
+/// @brief 为一路摄像头确定 NUMA 节点并计入该节点的摄像头数; NUMA_NODE_AUTO 时选摄像头最少的节点
+/// @param requested 配置的节点
+/// @return 节点编号, 单节点机器或配置无效时返回 -1 (不绑定)
+int numa_assign_node(int requested);
+
+/// @brief 流水线停止时归还 numa_assign_node 分配的节点
+/// @param node 节点编号, 负数时忽略
+void numa_release_node(int node);
+
+/// @brief 按阶段配置创建线程: 新线程启动时先设置线程名、CPU 亲和性、SCHED_FIFO 或 nice 值,
+///        再执行线程函数; 没有实时调度权限时退回普通调度.
+///        解码/推理/编码阶段在配置了 numa_node 时绑定到该节点的 CPU, 并优先从该节点分配内存
+/// @param thread 线程句柄
+/// @param stage 流水线阶段
+/// @param config 线程配置, 为 NULL 时使用默认属性
+/// @param start_routine 线程函数
+/// @param arg 线程参数
+/// @return 0 成功，-1 失败
+int create_stage_thread(pthread_t *thread, PipelineStage stage, const ThreadConfig *config,
+                        void *(*start_routine)(void *), void *arg);
+
+/// @brief 计算从现在起 timeout_ms 毫秒后的截止时间(CLOCK_REALTIME, 供 pthread_timedjoin_np 等使用)
+/// @param deadline 输出截止时间
+/// @param timeout_ms 毫秒数
+void deadline_after_ms(struct timespec *deadline, int timeout_ms);
+
+/// @brief 在截止时间前等待线程结束
+/// @param thread 线程句柄
+/// @param deadline 截止时间, 由 deadline_after_ms 计算
+/// @return 0 已结束，-1 超时(线程仍可再次等待)
+int join_thread_until(pthread_t thread, const struct timespec *deadline);
+
+/// @brief 把阶段配置应用到当前线程, 之后由当前线程创建的线程(如 OpenCV / FFmpeg 内部线程)继承亲和性
+/// @param stage 流水线阶段
+/// @param config 线程配置
+void apply_stage_to_current_thread(PipelineStage stage, const ThreadConfig *config);
+
+#endif // THREAD_UTILS_H
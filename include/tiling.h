@@ -0,0 +1,45 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TILING_H
+#define TILING_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "config.h"
+#include "frame_queue.h"
+#include "motion_gate.h"
+
+/// @brief 把区域切分为相互重叠的切片
+/// @param config 切片配置
+/// @param area 被切分的区域(整帧或关注区域)
+/// @param tile_width 自动计算网格时的目标切片宽度, 一般为网络输入宽度
+/// @param tile_height 自动计算网格时的目标切片高度
+/// @param tiles 输出切片
+void tiling_compute_tiles(const TilingConfig *config, cv::Rect area, int tile_width, int tile_height,
+                          std::vector<cv::Rect> &tiles);
+
+/// @brief 自适应切片: 只保留有运动或与已有目标相交的切片
+/// @param gate 运动门控, 提供网格级别的运动信息
+/// @param previous 上一轮的检测结果
+/// @param tiles 切片, 原地过滤
+void tiling_select_active(const MotionGate *gate, const std::vector<Box> &previous, std::vector<cv::Rect> &tiles);
+
+/// @brief 合并各切片的检测结果: 按类别做跨切片 NMS
+/// @param boxes 检测结果, 原地合并
+/// @param nms_threshold NMS 阈值
+void tiling_merge_detections(std::vector<Box> &boxes, float nms_threshold);
+
+#endif // TILING_H
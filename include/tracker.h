@@ -0,0 +1,68 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "config.h"
+#include "frame_queue.h"
+
+// 单个跟踪目标
+typedef struct
+{
+    int id;                // 跟踪 ID, 从 1 开始
+    cv::KalmanFilter kf;   // 状态 [cx, cy, w, h, vx, vy, vw, vh], 匀速模型
+    char label[40];        // 类别名称
+    int class_id;          // 类别 ID
+    float prop;            // 最近一次匹配的置信度
+    int hits;              // 累计匹配次数
+    int misses;            // 连续未匹配的检测轮数
+    int warned;            // 是否已经产生过告警
+} Track;
+
+// SORT 风格的多目标跟踪器: 卡尔曼预测 + 按 IoU 贪心匹配
+typedef struct
+{
+    TrackerConfig config;
+    std::vector<Track> tracks;
+    int next_id;
+    int rounds; // 已处理的检测轮数
+} Tracker;
+
+/// @brief 初始化跟踪器
+/// @param tracker 跟踪器
+/// @param config 配置
+void tracker_init(Tracker *tracker, const TrackerConfig *config);
+
+/// @brief 用一轮检测结果更新跟踪器
+/// @param tracker 跟踪器
+/// @param detections 当前帧的检测结果
+/// @param tracked 输出已确认的目标, 带跟踪 ID
+void tracker_update(Tracker *tracker, const std::vector<Box> &detections, std::vector<Box> &tracked);
+
+/// @brief 未推理的帧上推算目标位置
+/// @param tracker 跟踪器
+/// @param tracked 输出已确认目标的预测位置
+void tracker_predict(Tracker *tracker, std::vector<Box> &tracked);
+
+/// @brief 每个已确认的目标只告警一次: 确认后首次调用返回 1, 之后返回 0
+/// @param tracker 跟踪器
+/// @param track_id 跟踪 ID
+/// @return 1 需要告警，0 已告警过
+int tracker_claim_warning(Tracker *tracker, int track_id);
+
+#endif // TRACKER_H
@@ -41,6 +41,7 @@ typedef struct
     AVStream *video_stream;
     AVCodecContext *codec_ctx;
     AVStream *input_stream;
+    int thread_count; // 编码器内部线程数, 0 表示自动
 } Mp4StreamContext;
 
 /// @brief
@@ -51,10 +52,11 @@ typedef struct
 /// @param fps
 /// @return
 int init_mp4_stream(Mp4StreamContext *ctx, const char *output_url, int width, int height, int fps);
-/// @brief
+/// @brief 编码一帧并写出
 /// @param ctx
-/// @param frame
-void save_mp4(Mp4StreamContext *ctx, AVFrame *frame);
+/// @param frame 为 NULL 时冲刷编码器, 停止前调用以免丢失编码器缓存的帧
+/// @param trace 该帧的跟踪记录, 记录编码器输出数据包和写入输出的时间; 可为 NULL
+void save_mp4(Mp4StreamContext *ctx, AVFrame *frame, FrameTrace *trace);
 
 /// @brief
 /// @param arg
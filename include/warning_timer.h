@@ -43,6 +43,9 @@ int warning_timer_init(uint32_t interval_ms, uint32_t threshold, void (*callback
 // type: 告警类型
 // timestamp: 告警时间戳
 void warning_timer_record_warning(char label[40], int timestamp, AVFrame *frame);
+
+// 记录一个已确认的告警目标(如跟踪器确认的轨迹), 每个目标只记录一次, 单独即达到本周期的告警次数阈值
+void warning_timer_record_confirmed(char label[40], int timestamp, AVFrame *frame);
 // 停止告警计时器
 void warning_timer_stop();
 
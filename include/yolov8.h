@@ -15,10 +15,89 @@
 #ifndef _RKNN_DEMO_YOLOV8_H_
 #define _RKNN_DEMO_YOLOV8_H_
 
-int init_yolov8_model();
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "config.h"
+#include "frame_queue.h"
+#include "inference_backend.h"
+#include "opencv_utils.h"
+#include "label_map.h"
 
-int release_yolov8_model();
+// 最近一次调用各步骤的耗时(跟踪时钟刻度), 分块执行时累加
+typedef struct
+{
+    uint64_t preprocess_ticks;
+    uint64_t infer_ticks;
+    uint64_t postprocess_ticks;
+} Yolov8Timing;
 
-int inference_yolov8_model();
+// YOLOv8 模型, 具体的前向计算由推理后端完成
+typedef struct
+{
+    InferenceBackend *backend;
+    BackendCapabilities caps;
+    int input_width;
+    int input_height;
+    LabelMap labels;     // 类别名称
+    int num_classes;     // 加载时由校验推理的输出形状得到的类别数
+    ClassFilter filter;  // 参与打分的类别及其阈值
+    float nms_threshold; // NMS 阈值
+    Yolov8Timing timing; // 最近一次推理的分步耗时, 供延迟跟踪使用
+} Yolov8Model;
 
-#endif //_RKNN_DEMO_YOLOV8_H_
\ No newline at end of file
+// 单张图像的后处理参数: 多路合批时每路使用各自的类别过滤和 NMS 阈值
+typedef struct
+{
+    const ClassFilter *filter;
+    float nms_threshold;
+} Yolov8Postprocess;
+
+/// @brief 由检测器配置的 classes / conf_threshold / class_thresholds 生成类别过滤
+/// @param config 检测器配置
+/// @param labels 模型的类别名称
+/// @param num_classes 模型输出的类别数
+/// @param filter 输出类别过滤
+/// @return 0 成功，-1 类别名称无效或 ID 越界
+int yolov8_build_class_filter(const DetectorConfig *config, const LabelMap *labels, int num_classes,
+                              ClassFilter *filter);
+
+/// @brief 按配置选择推理后端并加载模型
+/// @param config 检测器配置
+/// @param model 模型
+/// @return 0 成功，-1 失败
+int init_yolov8_model(const DetectorConfig *config, Yolov8Model *model);
+
+/// @brief 释放模型和推理后端
+/// @param model 模型
+/// @return 0 成功
+int release_yolov8_model(Yolov8Model *model);
+
+/// @brief 批量推理, 结果坐标已映射回原图
+/// @param model 模型
+/// @param frames RGB 图像数组
+/// @param count 图像数量
+/// @param results 每张图像的检测结果, 长度为 count
+/// @return 0 成功，-1 失败
+int inference_yolov8_model(Yolov8Model *model, const cv::Mat *frames, int count, std::vector<Box> *results);
+
+/// @brief 只对画面中的若干区域推理, 各区域作为一个批次送入网络, 结果坐标映射回整帧
+/// @param model 模型
+/// @param frame RGB 图像
+/// @param regions 推理区域, 为空时对整帧推理
+/// @param boxes 检测结果
+/// @return 0 成功，-1 失败
+int inference_yolov8_regions(Yolov8Model *model, const cv::Mat &frame, const std::vector<cv::Rect> &regions,
+                             std::vector<Box> &boxes);
+
+/// @brief 对多张图像各自的若干区域推理, 所有区域拼成一个批次(按后端最大批量分块), 用于多路摄像头合批
+/// @param model 模型
+/// @param frames RGB 图像数组
+/// @param regions 每张图像的推理区域, 为空时对整帧推理
+/// @param count 图像数量
+/// @param post 每张图像的后处理参数, 为 NULL 时都使用模型的默认值
+/// @param boxes 每张图像的检测结果, 坐标映射回各自的整帧
+/// @return 0 成功，-1 失败
+int inference_yolov8_batch_regions(Yolov8Model *model, const cv::Mat *frames, const std::vector<cv::Rect> *regions,
+                                   int count, const Yolov8Postprocess *post, std::vector<Box> *boxes);
+
+#endif //_RKNN_DEMO_YOLOV8_H_
@@ -112,9 +112,9 @@ void print_coco_names()
 
 const char *get_coco_name(int id)
 {
-    if (id < 0 || id > 80)
+    if (id < 0 || id >= 80)
     {
         return (const char *)"unknown";
     }
     return coco_names[id];
-}
\ No newline at end of file
+}
@@ -0,0 +1,1075 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "logger.h"
+
+// 去掉字符串首尾空白
+static char *trim(char *s)
+{
+    while (*s && isspace((unsigned char)*s))
+    {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+    {
+        end--;
+    }
+    *end = '\0';
+    return s;
+}
+
+// 安全复制字符串, 先清零整个缓冲区, 旧值残留在结尾 '\0' 之后会让逐字节比较配置误判为变化
+static void copy_string(char *dst, size_t size, const char *src)
+{
+    memset(dst, 0, size);
+    snprintf(dst, size, "%s", src);
+}
+
+int config_parse_ini(const char *path, ConfigHandler handler, void *user)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        log_error("Failed to open config file: %s", path);
+        return -1;
+    }
+    char line[1024];
+    char section[64] = "";
+    int line_no = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        line_no++;
+        char *s = trim(line);
+        // 空行和注释
+        if (*s == '\0' || *s == '#' || *s == ';')
+        {
+            continue;
+        }
+        if (*s == '[')
+        {
+            char *end = strchr(s, ']');
+            if (!end)
+            {
+                log_error("%s:%d: unterminated section", path, line_no);
+                ret = -1;
+                break;
+            }
+            *end = '\0';
+            copy_string(section, sizeof(section), trim(s + 1));
+            continue;
+        }
+        char *eq = strchr(s, '=');
+        if (!eq)
+        {
+            log_error("%s:%d: expected key = value", path, line_no);
+            ret = -1;
+            break;
+        }
+        *eq = '\0';
+        char *key = trim(s);
+        char *value = trim(eq + 1);
+        if (handler(user, section, key, value) != 0)
+        {
+            log_error("%s:%d: invalid option [%s] %s = %s", path, line_no, section, key, value);
+            ret = -1;
+            break;
+        }
+    }
+    fclose(file);
+    return ret;
+}
+
+void config_set_defaults(StreamConfig *cfg)
+{
+    memset(cfg, 0, sizeof(StreamConfig));
+    copy_string(cfg->record_path, sizeof(cfg->record_path), "./local_%Y%m%d_%H%M%S.mp4");
+    copy_string(cfg->detector.backend, sizeof(cfg->detector.backend), "opencv");
+    copy_string(cfg->detector.model_path, sizeof(cfg->detector.model_path), "./yolov8n.onnx");
+    copy_string(cfg->detector.dnn_backend, sizeof(cfg->detector.dnn_backend), "opencv");
+    copy_string(cfg->detector.dnn_target, sizeof(cfg->detector.dnn_target), "cpu");
+    copy_string(cfg->detector.precision, sizeof(cfg->detector.precision), "fp32");
+    cfg->detector.calibration_images = 32;
+    cfg->detector.input_width = 640;
+    cfg->detector.input_height = 640;
+    cfg->detector.detect_interval = 1;
+    cfg->detector.max_batch = 1;
+    cfg->detector.batch_wait_ms = 5;
+    cfg->detector.warmup_runs = 1;
+    cfg->detector.conf_threshold = 0.25f;
+    cfg->detector.nms_threshold = 0.5f;
+    copy_string(cfg->detector.warning_classes, sizeof(cfg->detector.warning_classes), "person");
+    cfg->motion.enabled = 0;
+    cfg->motion.pixel_threshold = 12;
+    cfg->motion.motion_ratio = 0.005f;
+    cfg->motion.keepalive_frames = 50;
+    cfg->motion.background_alpha = 0.05f;
+    cfg->tracker.enabled = 0;
+    cfg->tracker.iou_threshold = 0.3f;
+    cfg->tracker.max_misses = 3;
+    cfg->tracker.min_hits = 2;
+    cfg->tiling.enabled = 0;
+    cfg->tiling.overlap = 0.2f;
+    cfg->tiling.full_frame = 1;
+    cfg->tiling.adaptive = 0;
+    cfg->tiling.full_refresh = 10;
+    cfg->tiling.nms_threshold = 0.5f;
+    cfg->cache.enabled = 0;
+    cfg->cache.hash_threshold = 4;
+    cfg->cache.max_age = 25;
+    cfg->rate.enabled = 0;
+    cfg->rate.target_load = 0.7f;
+    cfg->rate.min_fps = 1.0f;
+    cfg->rate.boost_factor = 2.0f;
+    cfg->rate.boost_seconds = 10;
+    cfg->rate.update_interval_ms = 1000;
+    cfg->threads.numa_node = -1;
+    cfg->threads.numa_memory = 1;
+    cfg->shutdown.drain_timeout_ms = 5000;
+    cfg->supervisor.enabled = 1;
+    cfg->supervisor.stall_timeout_ms = 10000;
+    cfg->supervisor.backoff_initial_ms = 1000;
+    cfg->supervisor.backoff_max_ms = 30000;
+    cfg->trace.enabled = 1;
+    cfg->trace.report_interval_s = 60;
+    cfg->trace.slow_frame_ms = 0;
+#ifdef HEADLESS
+    cfg->display.enabled = 0;
+#else
+    cfg->display.enabled = 1;
+#endif
+}
+
+int config_set_detector_option(DetectorConfig *detector, const char *key, const char *value)
+{
+    if (strcmp(key, "backend") == 0)
+    {
+        copy_string(detector->backend, sizeof(detector->backend), value);
+    }
+    else if (strcmp(key, "model_path") == 0)
+    {
+        copy_string(detector->model_path, sizeof(detector->model_path), value);
+    }
+    else if (strcmp(key, "labels") == 0)
+    {
+        copy_string(detector->labels_path, sizeof(detector->labels_path), value);
+    }
+    else if (strcmp(key, "dnn_backend") == 0)
+    {
+        copy_string(detector->dnn_backend, sizeof(detector->dnn_backend), value);
+    }
+    else if (strcmp(key, "dnn_target") == 0)
+    {
+        copy_string(detector->dnn_target, sizeof(detector->dnn_target), value);
+    }
+    else if (strcmp(key, "precision") == 0)
+    {
+        if (strcmp(value, "fp32") != 0 && strcmp(value, "fp16") != 0 && strcmp(value, "int8") != 0)
+        {
+            return 0;
+        }
+        copy_string(detector->precision, sizeof(detector->precision), value);
+    }
+    else if (strcmp(key, "calibration_dir") == 0)
+    {
+        copy_string(detector->calibration_dir, sizeof(detector->calibration_dir), value);
+    }
+    else if (strcmp(key, "calibration_images") == 0)
+    {
+        detector->calibration_images = atoi(value) > 0 ? atoi(value) : 1;
+    }
+    else if (strcmp(key, "input_size") == 0)
+    {
+        // 支持 640 或 640x384 两种写法
+        int width = 0, height = 0;
+        int n = sscanf(value, "%dx%d", &width, &height);
+        if (n == 1)
+        {
+            height = width;
+        }
+        if (n < 1 || width <= 0 || height <= 0 || width % 32 != 0 || height % 32 != 0)
+        {
+            return 0;
+        }
+        detector->input_width = width;
+        detector->input_height = height;
+    }
+    else if (strcmp(key, "detect_interval") == 0)
+    {
+        detector->detect_interval = atoi(value) > 0 ? atoi(value) : 1;
+    }
+    else if (strcmp(key, "max_batch") == 0)
+    {
+        detector->max_batch = atoi(value) > 0 ? atoi(value) : 1;
+    }
+    else if (strcmp(key, "batch_wait_ms") == 0)
+    {
+        detector->batch_wait_ms = atoi(value) >= 0 ? atoi(value) : 0;
+    }
+    else if (strcmp(key, "warmup_runs") == 0)
+    {
+        detector->warmup_runs = atoi(value) >= 0 ? atoi(value) : 0;
+    }
+    else if (strcmp(key, "conf_threshold") == 0)
+    {
+        float threshold = atof(value);
+        if (threshold < 0 || threshold > 1)
+        {
+            return 0;
+        }
+        detector->conf_threshold = threshold;
+    }
+    else if (strcmp(key, "nms_threshold") == 0)
+    {
+        float threshold = atof(value);
+        if (threshold <= 0 || threshold > 1)
+        {
+            return 0;
+        }
+        detector->nms_threshold = threshold;
+    }
+    // 类别名称在模型加载后才能解析为 ID, 这里只保存原始字符串
+    else if (strcmp(key, "classes") == 0)
+    {
+        copy_string(detector->classes, sizeof(detector->classes), value);
+    }
+    else if (strcmp(key, "class_thresholds") == 0)
+    {
+        copy_string(detector->class_thresholds, sizeof(detector->class_thresholds), value);
+    }
+    else if (strcmp(key, "warning_classes") == 0)
+    {
+        copy_string(detector->warning_classes, sizeof(detector->warning_classes), value);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int config_set_motion_option(MotionGateConfig *motion, const char *key, const char *value)
+{
+    if (strcmp(key, "enabled") == 0)
+    {
+        motion->enabled = atoi(value) != 0;
+    }
+    else if (strcmp(key, "pixel_threshold") == 0)
+    {
+        motion->pixel_threshold = atoi(value);
+    }
+    else if (strcmp(key, "motion_ratio") == 0)
+    {
+        motion->motion_ratio = atof(value);
+    }
+    else if (strcmp(key, "keepalive_frames") == 0)
+    {
+        motion->keepalive_frames = atoi(value);
+    }
+    else if (strcmp(key, "background_alpha") == 0)
+    {
+        float alpha = atof(value);
+        if (alpha <= 0 || alpha > 1)
+        {
+            return 0;
+        }
+        motion->background_alpha = alpha;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int config_set_tracker_option(TrackerConfig *tracker, const char *key, const char *value)
+{
+    if (strcmp(key, "enabled") == 0)
+    {
+        tracker->enabled = atoi(value) != 0;
+    }
+    else if (strcmp(key, "iou_threshold") == 0)
+    {
+        tracker->iou_threshold = atof(value);
+    }
+    else if (strcmp(key, "max_misses") == 0)
+    {
+        tracker->max_misses = atoi(value) >= 0 ? atoi(value) : 0;
+    }
+    else if (strcmp(key, "min_hits") == 0)
+    {
+        tracker->min_hits = atoi(value) > 0 ? atoi(value) : 1;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+// 解析多边形: 以空白或分号分隔的 x,y 点列表
+static int parse_polygon(const char *value, RoiPolygon *polygon)
+{
+    memset(polygon, 0, sizeof(RoiPolygon));
+    const char *p = value;
+    while (*p)
+    {
+        while (*p && (isspace((unsigned char)*p) || *p == ';'))
+        {
+            p++;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        float x, y;
+        int consumed = 0;
+        if (sscanf(p, "%f,%f%n", &x, &y, &consumed) != 2 || polygon->count >= MAX_ROI_POINTS ||
+            x < 0 || x > 1 || y < 0 || y > 1)
+        {
+            return -1;
+        }
+        polygon->x[polygon->count] = x;
+        polygon->y[polygon->count] = y;
+        polygon->count++;
+        p += consumed;
+    }
+    return polygon->count >= 3 ? 0 : -1;
+}
+
+int config_set_roi_option(RoiConfig *roi, const char *key, const char *value)
+{
+    if (strcmp(key, "include") == 0)
+    {
+        if (roi->include_count >= MAX_ROI_POLYGONS || parse_polygon(value, &roi->include[roi->include_count]) != 0)
+        {
+            return 0;
+        }
+        roi->include_count++;
+    }
+    else if (strcmp(key, "exclude") == 0)
+    {
+        if (roi->exclude_count >= MAX_ROI_POLYGONS || parse_polygon(value, &roi->exclude[roi->exclude_count]) != 0)
+        {
+            return 0;
+        }
+        roi->exclude_count++;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int config_set_tiling_option(TilingConfig *tiling, const char *key, const char *value)
+{
+    if (strcmp(key, "enabled") == 0)
+    {
+        tiling->enabled = atoi(value) != 0;
+    }
+    else if (strcmp(key, "grid") == 0)
+    {
+        // 形如 3x2, 0 表示自动
+        int cols = 0, rows = 0;
+        if (sscanf(value, "%dx%d", &cols, &rows) != 2 || cols < 0 || rows < 0)
+        {
+            return 0;
+        }
+        tiling->cols = cols;
+        tiling->rows = rows;
+    }
+    else if (strcmp(key, "overlap") == 0)
+    {
+        float overlap = atof(value);
+        if (overlap < 0 || overlap >= 0.9f)
+        {
+            return 0;
+        }
+        tiling->overlap = overlap;
+    }
+    else if (strcmp(key, "full_frame") == 0)
+    {
+        tiling->full_frame = atoi(value) != 0;
+    }
+    else if (strcmp(key, "adaptive") == 0)
+    {
+        tiling->adaptive = atoi(value) != 0;
+    }
+    else if (strcmp(key, "full_refresh") == 0)
+    {
+        tiling->full_refresh = atoi(value) > 0 ? atoi(value) : 1;
+    }
+    else if (strcmp(key, "nms_threshold") == 0)
+    {
+        tiling->nms_threshold = atof(value);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int config_set_cache_option(DetectionCacheConfig *cache, const char *key, const char *value)
+{
+    if (strcmp(key, "enabled") == 0)
+    {
+        cache->enabled = atoi(value) != 0;
+    }
+    else if (strcmp(key, "hash_threshold") == 0)
+    {
+        cache->hash_threshold = atoi(value) >= 0 ? atoi(value) : 0;
+    }
+    else if (strcmp(key, "max_age") == 0)
+    {
+        cache->max_age = atoi(value) > 0 ? atoi(value) : 1;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int config_set_rate_option(RateControlConfig *rate, const char *key, const char *value)
+{
+    if (strcmp(key, "enabled") == 0)
+    {
+        rate->enabled = atoi(value) != 0;
+    }
+    else if (strcmp(key, "target_load") == 0)
+    {
+        float load = atof(value);
+        if (load <= 0 || load > 1)
+        {
+            return 0;
+        }
+        rate->target_load = load;
+    }
+    else if (strcmp(key, "min_fps") == 0)
+    {
+        rate->min_fps = atof(value) > 0 ? atof(value) : 0.1f;
+    }
+    else if (strcmp(key, "boost_factor") == 0)
+    {
+        rate->boost_factor = atof(value) >= 1 ? atof(value) : 1.0f;
+    }
+    else if (strcmp(key, "boost_seconds") == 0)
+    {
+        rate->boost_seconds = atoi(value) >= 0 ? atoi(value) : 0;
+    }
+    else if (strcmp(key, "update_interval_ms") == 0)
+    {
+        rate->update_interval_ms = atoi(value) >= 100 ? atoi(value) : 100;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static const char *stage_names[STAGE_COUNT] = {"decode", "detect", "inference", "encode", "render", "background"};
+
+const char *pipeline_stage_name(PipelineStage stage)
+{
+    return stage >= 0 && stage < STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+int config_set_threads_option(ThreadConfig *threads, const char *key, const char *value)
+{
+    if (strcmp(key, "opencv_threads") == 0)
+    {
+        threads->opencv_threads = atoi(value) >= 0 ? atoi(value) : 0;
+        return 1;
+    }
+    if (strcmp(key, "decoder_threads") == 0)
+    {
+        threads->decoder_threads = atoi(value) >= 0 ? atoi(value) : 0;
+        return 1;
+    }
+    if (strcmp(key, "encoder_threads") == 0)
+    {
+        threads->encoder_threads = atoi(value) >= 0 ? atoi(value) : 0;
+        return 1;
+    }
+    if (strcmp(key, "numa_node") == 0)
+    {
+        if (strcmp(value, "auto") == 0)
+        {
+            threads->numa_node = NUMA_NODE_AUTO;
+        }
+        else if (strcmp(value, "none") == 0 || strcmp(value, "") == 0)
+        {
+            threads->numa_node = -1;
+        }
+        else
+        {
+            threads->numa_node = atoi(value) >= 0 ? atoi(value) : -1;
+        }
+        return 1;
+    }
+    if (strcmp(key, "numa_memory") == 0)
+    {
+        threads->numa_memory = atoi(value) != 0;
+        return 1;
+    }
+    // <阶段>_cpus / <阶段>_nice / <阶段>_fifo
+    const char *underscore = strrchr(key, '_');
+    if (!underscore)
+    {
+        return 0;
+    }
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        size_t len = strlen(stage_names[i]);
+        if ((size_t)(underscore - key) != len || strncmp(key, stage_names[i], len) != 0)
+        {
+            continue;
+        }
+        ThreadStageConfig *stage = &threads->stages[i];
+        const char *option = underscore + 1;
+        if (strcmp(option, "cpus") == 0)
+        {
+            copy_string(stage->cpus, sizeof(stage->cpus), value);
+            return 1;
+        }
+        if (strcmp(option, "nice") == 0)
+        {
+            int nice = atoi(value);
+            if (nice < -20 || nice > 19)
+            {
+                return 0;
+            }
+            stage->nice = nice;
+            return 1;
+        }
+        if (strcmp(option, "fifo") == 0)
+        {
+            int priority = atoi(value);
+            if (priority < 0 || priority > 99)
+            {
+                return 0;
+            }
+            stage->fifo_priority = priority;
+            return 1;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+int config_set_control_option(ControlConfig *control, const char *key, const char *value)
+{
+    if (strcmp(key, "socket") == 0)
+    {
+        copy_string(control->socket_path, sizeof(control->socket_path), value);
+        return 1;
+    }
+    return 0;
+}
+
+int config_set_shutdown_option(ShutdownConfig *shutdown, const char *key, const char *value)
+{
+    if (strcmp(key, "drain_timeout_ms") == 0)
+    {
+        shutdown->drain_timeout_ms = atoi(value) >= 0 ? atoi(value) : 0;
+        return 1;
+    }
+    return 0;
+}
+
+int config_set_supervisor_option(SupervisorConfig *supervisor, const char *key, const char *value)
+{
+    if (strcmp(key, "enabled") == 0)
+    {
+        supervisor->enabled = atoi(value) != 0;
+        return 1;
+    }
+    if (strcmp(key, "stall_timeout_ms") == 0)
+    {
+        supervisor->stall_timeout_ms = atoi(value) > 0 ? atoi(value) : 0;
+        return 1;
+    }
+    if (strcmp(key, "backoff_initial_ms") == 0)
+    {
+        supervisor->backoff_initial_ms = atoi(value) > 0 ? atoi(value) : 1;
+        return 1;
+    }
+    if (strcmp(key, "backoff_max_ms") == 0)
+    {
+        supervisor->backoff_max_ms = atoi(value) > 0 ? atoi(value) : 1;
+        return 1;
+    }
+    return 0;
+}
+
+int config_set_trace_option(TraceConfig *trace, const char *key, const char *value)
+{
+    if (strcmp(key, "enabled") == 0)
+    {
+        trace->enabled = atoi(value) != 0;
+        return 1;
+    }
+    if (strcmp(key, "report_interval_s") == 0)
+    {
+        trace->report_interval_s = atoi(value) > 0 ? atoi(value) : 0;
+        return 1;
+    }
+    if (strcmp(key, "slow_frame_ms") == 0)
+    {
+        trace->slow_frame_ms = atoi(value) > 0 ? atoi(value) : 0;
+        return 1;
+    }
+    return 0;
+}
+
+int config_set_metrics_option(MetricsConfig *metrics, const char *key, const char *value)
+{
+    if (strcmp(key, "listen") == 0)
+    {
+        copy_string(metrics->listen, sizeof(metrics->listen), value);
+        return 1;
+    }
+    return 0;
+}
+
+int config_set_display_option(DisplayConfig *display, const char *key, const char *value)
+{
+    if (strcmp(key, "enabled") == 0)
+    {
+        display->enabled = atoi(value) != 0;
+        return 1;
+    }
+    return 0;
+}
+
+// 单路配置文件的键值回调
+static int stream_config_handler(void *user, const char *section, const char *key, const char *value)
+{
+    StreamConfig *cfg = (StreamConfig *)user;
+    if (strcmp(section, "stream") == 0)
+    {
+        if (strcmp(key, "input_url") == 0)
+        {
+            copy_string(cfg->input_url, sizeof(cfg->input_url), value);
+            return 0;
+        }
+        if (strcmp(key, "output_url") == 0)
+        {
+            copy_string(cfg->output_url, sizeof(cfg->output_url), value);
+            return 0;
+        }
+        if (strcmp(key, "record_path") == 0)
+        {
+            copy_string(cfg->record_path, sizeof(cfg->record_path), value);
+            return 0;
+        }
+        if (strcmp(key, "realtime") == 0)
+        {
+            cfg->realtime = atoi(value) != 0;
+            return 0;
+        }
+        if (strcmp(key, "lossless") == 0)
+        {
+            cfg->lossless = atoi(value) != 0;
+            return 0;
+        }
+        if (strcmp(key, "detection_log") == 0)
+        {
+            copy_string(cfg->detection_log, sizeof(cfg->detection_log), value);
+            return 0;
+        }
+    }
+    else if (strcmp(section, "detector") == 0)
+    {
+        if (config_set_detector_option(&cfg->detector, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "motion") == 0)
+    {
+        if (config_set_motion_option(&cfg->motion, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "tracker") == 0)
+    {
+        if (config_set_tracker_option(&cfg->tracker, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "roi") == 0)
+    {
+        if (config_set_roi_option(&cfg->roi, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "tiling") == 0)
+    {
+        if (config_set_tiling_option(&cfg->tiling, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "cache") == 0)
+    {
+        if (config_set_cache_option(&cfg->cache, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "rate") == 0)
+    {
+        if (config_set_rate_option(&cfg->rate, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "threads") == 0)
+    {
+        if (config_set_threads_option(&cfg->threads, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "control") == 0)
+    {
+        if (config_set_control_option(&cfg->control, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "shutdown") == 0)
+    {
+        if (config_set_shutdown_option(&cfg->shutdown, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "supervisor") == 0)
+    {
+        if (config_set_supervisor_option(&cfg->supervisor, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "trace") == 0)
+    {
+        if (config_set_trace_option(&cfg->trace, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "metrics") == 0)
+    {
+        if (config_set_metrics_option(&cfg->metrics, key, value))
+        {
+            return 0;
+        }
+    }
+    else if (strcmp(section, "display") == 0)
+    {
+        if (config_set_display_option(&cfg->display, key, value))
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int config_load_file(const char *path, StreamConfig *cfg)
+{
+    return config_parse_ini(path, stream_config_handler, cfg);
+}
+
+// 具名视频流节的前缀, 形如 [stream cam1]
+#define STREAM_SECTION_PREFIX "stream "
+
+// 具名视频流节的名称, 不是具名视频流节时返回 NULL
+static const char *stream_section_name(const char *section)
+{
+    size_t len = strlen(STREAM_SECTION_PREFIX);
+    if (strncmp(section, STREAM_SECTION_PREFIX, len) != 0)
+    {
+        return NULL;
+    }
+    const char *name = section + len;
+    while (isspace((unsigned char)*name))
+    {
+        name++;
+    }
+    return *name ? name : NULL;
+}
+
+// 第一遍: 只读取全局节
+static int process_defaults_handler(void *user, const char *section, const char *key, const char *value)
+{
+    ProcessConfig *cfg = (ProcessConfig *)user;
+    if (stream_section_name(section))
+    {
+        return 0;
+    }
+    return stream_config_handler(&cfg->defaults, section, key, value);
+}
+
+// 第二遍的解析状态: 记录各路是否已在视频流节中写过 roi.include / roi.exclude
+typedef struct
+{
+    ProcessConfig *cfg;
+    int roi_include_set[MAX_STREAMS];
+    int roi_exclude_set[MAX_STREAMS];
+} StreamsParseState;
+
+// 第二遍: 读取具名视频流节, 首次出现时复制全局配置
+static int process_streams_handler(void *user, const char *section, const char *key, const char *value)
+{
+    StreamsParseState *state = (StreamsParseState *)user;
+    ProcessConfig *cfg = state->cfg;
+    const char *name = stream_section_name(section);
+    if (!name)
+    {
+        return 0;
+    }
+    int index = -1;
+    for (int i = 0; i < cfg->stream_count; i++)
+    {
+        if (strcmp(cfg->streams[i].name, name) == 0)
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        if (!config_add_stream(cfg, name))
+        {
+            return -1;
+        }
+        index = cfg->stream_count - 1;
+    }
+    StreamConfig *stream = &cfg->streams[index];
+    // 多边形键可重复, 视频流节中第一次出现时替换而不是追加到继承的全局多边形后面
+    if (strcmp(key, "roi.include") == 0 && !state->roi_include_set[index])
+    {
+        state->roi_include_set[index] = 1;
+        stream->roi.include_count = 0;
+        memset(stream->roi.include, 0, sizeof(stream->roi.include));
+    }
+    else if (strcmp(key, "roi.exclude") == 0 && !state->roi_exclude_set[index])
+    {
+        state->roi_exclude_set[index] = 1;
+        stream->roi.exclude_count = 0;
+        memset(stream->roi.exclude, 0, sizeof(stream->roi.exclude));
+    }
+    return config_set_stream_override(stream, key, value);
+}
+
+// 模型相关的检测器键: 所有视频流共享一个模型和推理线程, 只能在全局 [detector] 节设置
+static const char *shared_detector_keys[] = {
+    "backend", "model_path", "labels", "dnn_backend", "dnn_target", "precision",
+    "calibration_dir", "calibration_images", "input_size", "max_batch", "batch_wait_ms", "warmup_runs",
+};
+
+int config_set_stream_override(StreamConfig *cfg, const char *key, const char *value)
+{
+    if (strncmp(key, "detector.", 9) == 0)
+    {
+        for (size_t i = 0; i < sizeof(shared_detector_keys) / sizeof(shared_detector_keys[0]); i++)
+        {
+            if (strcmp(key + 9, shared_detector_keys[i]) == 0)
+            {
+                log_error("%s is shared by all streams and can only be set in the global [detector] section", key);
+                return -1;
+            }
+        }
+    }
+    // input_url / output_url / record_path / realtime / lossless / detection_log 属于 [stream] 节, 其余键以 "节名.键" 覆盖
+    const char *dot = strchr(key, '.');
+    if (!dot)
+    {
+        return stream_config_handler(cfg, "stream", key, value);
+    }
+    char sub_section[64];
+    size_t len = (size_t)(dot - key) < sizeof(sub_section) ? (size_t)(dot - key) : sizeof(sub_section) - 1;
+    memcpy(sub_section, key, len);
+    sub_section[len] = '\0';
+    return stream_config_handler(cfg, sub_section, dot + 1, value);
+}
+
+StreamConfig *config_add_stream(ProcessConfig *cfg, const char *name)
+{
+    if (cfg->stream_count >= MAX_STREAMS)
+    {
+        log_error("Too many streams, at most %d are supported", MAX_STREAMS);
+        return NULL;
+    }
+    StreamConfig *streams = (StreamConfig *)realloc(cfg->streams, sizeof(StreamConfig) * (cfg->stream_count + 1));
+    if (!streams)
+    {
+        return NULL;
+    }
+    cfg->streams = streams;
+    StreamConfig *stream = &cfg->streams[cfg->stream_count++];
+    *stream = cfg->defaults;
+    copy_string(stream->name, sizeof(stream->name), name);
+    return stream;
+}
+
+int config_load_process_file(const char *path, ProcessConfig *cfg)
+{
+    cfg->streams = NULL;
+    cfg->stream_count = 0;
+    StreamsParseState state;
+    memset(&state, 0, sizeof(StreamsParseState));
+    state.cfg = cfg;
+    if (config_parse_ini(path, process_defaults_handler, cfg) != 0 ||
+        config_parse_ini(path, process_streams_handler, &state) != 0)
+    {
+        config_free_process(cfg);
+        return -1;
+    }
+    // 兼容单路配置文件
+    if (cfg->stream_count == 0 && cfg->defaults.input_url[0])
+    {
+        if (!config_add_stream(cfg, "default"))
+        {
+            log_error("%s: failed to add the default stream", path);
+            config_free_process(cfg);
+            return -1;
+        }
+    }
+    for (int i = 0; i < cfg->stream_count; i++)
+    {
+        if (config_validate_stream(&cfg->streams[i], path) != 0)
+        {
+            config_free_process(cfg);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int config_validate_stream(const StreamConfig *cfg, const char *source)
+{
+    // 推流线程总会启动, 地址为空时会反复初始化失败; 不需要推流时应写 null
+    if (!cfg->input_url[0] || !cfg->output_url[0])
+    {
+        log_error("%s: stream %s has no %s", source, cfg->name, cfg->input_url[0] ? "output_url" : "input_url");
+        return -1;
+    }
+    return 0;
+}
+
+void config_free_process(ProcessConfig *cfg)
+{
+    free(cfg->streams);
+    cfg->streams = NULL;
+    cfg->stream_count = 0;
+}
+
+void dump_stream_config(const StreamConfig *cfg)
+{
+    log_info("=== dump_stream_config ===");
+    log_info("name=%s", cfg->name);
+    log_info("input_url=%s", cfg->input_url);
+    log_info("output_url=%s", cfg->output_url);
+    log_info("record_path=%s", cfg->record_path);
+    log_info("realtime=%d", cfg->realtime);
+    log_info("lossless=%d", cfg->lossless);
+    log_info("detection_log=%s", cfg->detection_log[0] ? cfg->detection_log : "none");
+    log_info("detector.backend=%s", cfg->detector.backend);
+    log_info("detector.model_path=%s", cfg->detector.model_path);
+    log_info("detector.labels=%s", cfg->detector.labels_path[0] ? cfg->detector.labels_path : "auto");
+    log_info("detector.dnn_backend=%s", cfg->detector.dnn_backend);
+    log_info("detector.dnn_target=%s", cfg->detector.dnn_target);
+    log_info("detector.precision=%s", cfg->detector.precision);
+    log_info("detector.calibration_dir=%s", cfg->detector.calibration_dir);
+    log_info("detector.calibration_images=%d", cfg->detector.calibration_images);
+    log_info("detector.input_size=%dx%d", cfg->detector.input_width, cfg->detector.input_height);
+    log_info("detector.detect_interval=%d", cfg->detector.detect_interval);
+    log_info("detector.max_batch=%d", cfg->detector.max_batch);
+    log_info("detector.batch_wait_ms=%d", cfg->detector.batch_wait_ms);
+    log_info("detector.warmup_runs=%d", cfg->detector.warmup_runs);
+    log_info("detector.conf_threshold=%.2f", cfg->detector.conf_threshold);
+    log_info("detector.nms_threshold=%.2f", cfg->detector.nms_threshold);
+    log_info("detector.classes=%s", cfg->detector.classes[0] ? cfg->detector.classes : "all");
+    log_info("detector.class_thresholds=%s", cfg->detector.class_thresholds);
+    log_info("detector.warning_classes=%s", cfg->detector.warning_classes);
+    log_info("motion.enabled=%d", cfg->motion.enabled);
+    log_info("motion.pixel_threshold=%d", cfg->motion.pixel_threshold);
+    log_info("motion.motion_ratio=%.4f", cfg->motion.motion_ratio);
+    log_info("motion.keepalive_frames=%d", cfg->motion.keepalive_frames);
+    log_info("motion.background_alpha=%.3f", cfg->motion.background_alpha);
+    log_info("tracker.enabled=%d", cfg->tracker.enabled);
+    log_info("tracker.iou_threshold=%.2f", cfg->tracker.iou_threshold);
+    log_info("tracker.max_misses=%d", cfg->tracker.max_misses);
+    log_info("tracker.min_hits=%d", cfg->tracker.min_hits);
+    log_info("roi.include=%d polygons, roi.exclude=%d polygons", cfg->roi.include_count, cfg->roi.exclude_count);
+    log_info("tiling.enabled=%d", cfg->tiling.enabled);
+    log_info("tiling.grid=%dx%d", cfg->tiling.cols, cfg->tiling.rows);
+    log_info("tiling.overlap=%.2f", cfg->tiling.overlap);
+    log_info("tiling.full_frame=%d", cfg->tiling.full_frame);
+    log_info("tiling.adaptive=%d", cfg->tiling.adaptive);
+    log_info("tiling.full_refresh=%d", cfg->tiling.full_refresh);
+    log_info("tiling.nms_threshold=%.2f", cfg->tiling.nms_threshold);
+    log_info("cache.enabled=%d", cfg->cache.enabled);
+    log_info("cache.hash_threshold=%d", cfg->cache.hash_threshold);
+    log_info("cache.max_age=%d", cfg->cache.max_age);
+    log_info("rate.enabled=%d", cfg->rate.enabled);
+    log_info("rate.target_load=%.2f", cfg->rate.target_load);
+    log_info("rate.min_fps=%.2f", cfg->rate.min_fps);
+    log_info("rate.boost_factor=%.2f", cfg->rate.boost_factor);
+    log_info("rate.boost_seconds=%d", cfg->rate.boost_seconds);
+    log_info("rate.update_interval_ms=%d", cfg->rate.update_interval_ms);
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        const ThreadStageConfig *stage = &cfg->threads.stages[i];
+        log_info("threads.%s: cpus=%s, nice=%d, fifo=%d", stage_names[i],
+                 stage->cpus[0] ? stage->cpus : "all", stage->nice, stage->fifo_priority);
+    }
+    log_info("threads.opencv_threads=%d", cfg->threads.opencv_threads);
+    log_info("threads.decoder_threads=%d", cfg->threads.decoder_threads);
+    log_info("threads.encoder_threads=%d", cfg->threads.encoder_threads);
+    if (cfg->threads.numa_node == NUMA_NODE_AUTO)
+    {
+        log_info("threads.numa_node=auto");
+    }
+    else
+    {
+        log_info("threads.numa_node=%d", cfg->threads.numa_node);
+    }
+    log_info("threads.numa_memory=%d", cfg->threads.numa_memory);
+    log_info("control.socket=%s", cfg->control.socket_path);
+    log_info("shutdown.drain_timeout_ms=%d", cfg->shutdown.drain_timeout_ms);
+    log_info("supervisor.enabled=%d, stall_timeout_ms=%d, backoff_initial_ms=%d, backoff_max_ms=%d",
+             cfg->supervisor.enabled, cfg->supervisor.stall_timeout_ms, cfg->supervisor.backoff_initial_ms,
+             cfg->supervisor.backoff_max_ms);
+    log_info("trace.enabled=%d, report_interval_s=%d, slow_frame_ms=%d", cfg->trace.enabled,
+             cfg->trace.report_interval_s, cfg->trace.slow_frame_ms);
+    log_info("metrics.listen=%s", cfg->metrics.listen);
+    log_info("display.enabled=%d", cfg->display.enabled);
+}
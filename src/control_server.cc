@@ -0,0 +1,302 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "control_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "thread_utils.h"
+#include "logger.h"
+
+// 检查停止标志的间隔(毫秒)
+#define CONTROL_POLL_MS 500
+// 单条命令的最大长度
+#define CONTROL_LINE_SIZE 1024
+// list 回复的最大长度
+#define CONTROL_REPLY_SIZE 16384
+
+// 发送完整的回复
+static void send_reply(int fd, const char *reply)
+{
+    size_t len = strlen(reply);
+    while (len > 0)
+    {
+        ssize_t n = send(fd, reply, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return;
+        }
+        reply += n;
+        len -= (size_t)n;
+    }
+}
+
+// 需要视频流名称的命令
+static const char *stream_commands[] = {"start", "stop", "restart", "remove", "add", "set"};
+
+static int is_stream_command(const char *command)
+{
+    for (size_t i = 0; i < sizeof(stream_commands) / sizeof(stream_commands[0]); i++)
+    {
+        if (strcmp(command, stream_commands[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 执行一条命令, 回复写入 reply
+static void handle_command(ControlServer *server, char *line, char *reply, size_t size)
+{
+    char *saveptr = NULL;
+    const char *command = strtok_r(line, " \t", &saveptr);
+    const char *name = strtok_r(NULL, " \t", &saveptr);
+    if (!command)
+    {
+        snprintf(reply, size, "ERR empty command\n\n");
+        return;
+    }
+    log_info("Control command: %s %s", command, name ? name : "");
+    int ret = -1;
+    if (strcmp(command, "list") == 0)
+    {
+        int used = snprintf(reply, size, "OK\n");
+        pipeline_manager_list(server->manager, reply + used, size - used - 1);
+        strncat(reply, "\n", size - strlen(reply) - 1);
+        return;
+    }
+    if (strcmp(command, "reload") == 0)
+    {
+        if (!server->config_path[0])
+        {
+            snprintf(reply, size, "ERR started without a config file\n\n");
+            return;
+        }
+        ProcessConfig process;
+        config_set_defaults(&process.defaults);
+        if (config_load_process_file(server->config_path, &process) != 0)
+        {
+            snprintf(reply, size, "ERR failed to load %s\n\n", server->config_path);
+            return;
+        }
+        // 模型已加载并由所有视频流共享, 全局 [detector] 的模型相关键需要重启进程才能生效
+        ret = pipeline_manager_apply(server->manager, &process);
+        // 之后 add 的视频流使用新的全局配置; 命令在控制线程内串行执行, 不需要加锁
+        server->defaults = process.defaults;
+        config_free_process(&process);
+    }
+    else if (!is_stream_command(command))
+    {
+        snprintf(reply, size, "ERR unknown command %s\n\n", command);
+        return;
+    }
+    else if (!name)
+    {
+        snprintf(reply, size, "ERR missing stream name\n\n");
+        return;
+    }
+    else if (strcmp(command, "start") == 0)
+    {
+        ret = pipeline_manager_start(server->manager, name);
+    }
+    else if (strcmp(command, "stop") == 0)
+    {
+        ret = pipeline_manager_stop(server->manager, name);
+    }
+    else if (strcmp(command, "restart") == 0)
+    {
+        ret = pipeline_manager_restart(server->manager, name);
+    }
+    else if (strcmp(command, "remove") == 0)
+    {
+        ret = pipeline_manager_remove(server->manager, name);
+    }
+    else if (strcmp(command, "add") == 0)
+    {
+        const char *input_url = strtok_r(NULL, " \t", &saveptr);
+        const char *output_url = strtok_r(NULL, " \t", &saveptr);
+        if (!input_url)
+        {
+            snprintf(reply, size, "ERR usage: add <name> <input_url> <output_url>\n\n");
+            return;
+        }
+        StreamConfig config = server->defaults;
+        // 清零后再写, 与配置文件解析出的同名流逐字节比较时不受旧值残留影响
+        memset(config.name, 0, sizeof(config.name));
+        memset(config.input_url, 0, sizeof(config.input_url));
+        memset(config.output_url, 0, sizeof(config.output_url));
+        snprintf(config.name, sizeof(config.name), "%s", name);
+        snprintf(config.input_url, sizeof(config.input_url), "%s", input_url);
+        snprintf(config.output_url, sizeof(config.output_url), "%s", output_url ? output_url : "");
+        // 与加载配置文件时的检查一致; 不沿用全局的 output_url, 多路不能推到同一地址
+        if (config_validate_stream(&config, "control") != 0)
+        {
+            snprintf(reply, size, "ERR add needs an output_url (null to discard)\n\n");
+            return;
+        }
+        ret = pipeline_manager_add(server->manager, &config, 1);
+    }
+    else if (strcmp(command, "set") == 0)
+    {
+        const char *key = strtok_r(NULL, " \t", &saveptr);
+        const char *value = strtok_r(NULL, "", &saveptr);
+        if (!key || !value)
+        {
+            snprintf(reply, size, "ERR usage: set <name> <key> <value>\n\n");
+            return;
+        }
+        ret = pipeline_manager_set(server->manager, name, key, value);
+    }
+    snprintf(reply, size, ret == 0 ? "OK\n\n" : "ERR %s failed\n\n", command);
+}
+
+// 处理一个连接上的全部命令, 直到对端关闭
+static void serve_client(ControlServer *server, int fd)
+{
+    char buffer[CONTROL_LINE_SIZE];
+    size_t used = 0;
+    char *reply = (char *)malloc(CONTROL_REPLY_SIZE);
+    if (!reply)
+    {
+        return;
+    }
+    while (server->running)
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, CONTROL_POLL_MS);
+        if (ready == 0)
+        {
+            continue;
+        }
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        ssize_t n = ready > 0 ? recv(fd, buffer + used, sizeof(buffer) - used - 1, 0) : -1;
+        if (n <= 0)
+        {
+            break;
+        }
+        used += (size_t)n;
+        buffer[used] = '\0';
+        char *line = buffer;
+        char *newline;
+        while ((newline = strchr(line, '\n')) != NULL)
+        {
+            *newline = '\0';
+            if (newline > line && newline[-1] == '\r')
+            {
+                newline[-1] = '\0';
+            }
+            handle_command(server, line, reply, CONTROL_REPLY_SIZE);
+            send_reply(fd, reply);
+            line = newline + 1;
+        }
+        used = strlen(line);
+        memmove(buffer, line, used);
+        if (used >= sizeof(buffer) - 1)
+        {
+            send_reply(fd, "ERR line too long\n\n");
+            break;
+        }
+    }
+    free(reply);
+}
+
+static void *control_server_thread(void *arg)
+{
+    ControlServer *server = (ControlServer *)arg;
+    while (server->running)
+    {
+        struct pollfd pfd = {server->listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, CONTROL_POLL_MS) <= 0)
+        {
+            continue;
+        }
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            continue;
+        }
+        serve_client(server, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int control_server_start(ControlServer *server, const char *socket_path, const char *config_path,
+                         const StreamConfig *defaults, PipelineManager *manager)
+{
+    memset(server, 0, sizeof(ControlServer));
+    server->listen_fd = -1;
+    snprintf(server->socket_path, sizeof(server->socket_path), "%s", socket_path);
+    snprintf(server->config_path, sizeof(server->config_path), "%s", config_path ? config_path : "");
+    server->defaults = *defaults;
+    server->manager = manager;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0)
+    {
+        log_error("Failed to create control socket: %s", strerror(errno));
+        return -1;
+    }
+    unlink(socket_path);
+    // 控制命令可以增删视频流, 套接字只允许运行进程的用户连接; 在 listen 之前收紧权限, 不留可连接的窗口
+    if (bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || chmod(socket_path, 0600) != 0 ||
+        listen(server->listen_fd, 4) != 0)
+    {
+        log_error("Failed to listen on control socket %s: %s", socket_path, strerror(errno));
+        close(server->listen_fd);
+        server->listen_fd = -1;
+        unlink(socket_path);
+        return -1;
+    }
+    server->running = 1;
+    if (create_stage_thread(&server->thread, STAGE_BACKGROUND, &server->defaults.threads, control_server_thread,
+                            server) != 0)
+    {
+        log_error("Failed to create control thread");
+        server->running = 0;
+        close(server->listen_fd);
+        server->listen_fd = -1;
+        unlink(socket_path);
+        return -1;
+    }
+    log_info("Control socket listening on %s", socket_path);
+    return 0;
+}
+
+void control_server_stop(ControlServer *server)
+{
+    if (server->listen_fd < 0)
+    {
+        return;
+    }
+    server->running = 0;
+    pthread_join(server->thread, NULL);
+    close(server->listen_fd);
+    server->listen_fd = -1;
+    unlink(server->socket_path);
+}
@@ -0,0 +1,189 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "detection_cache.h"
+#include <string.h>
+#include "motion_gate.h"
+#include "logger.h"
+
+// 签名网格尺寸, 每行 17 个单元产生 16 个比较位
+#define HASH_GRID_WIDTH 17
+#define HASH_GRID_HEIGHT 16
+// 每个网格单元内的采样步长
+#define HASH_SAMPLE_STEP 4
+
+void detection_cache_init(DetectionCache *cache, const DetectionCacheConfig *config)
+{
+    cache->config = *config;
+    for (int i = 0; i < DETECTION_CACHE_SIZE; i++)
+    {
+        memset(&cache->entries[i].hash, 0, sizeof(FrameHash));
+        cache->entries[i].boxes.clear();
+        cache->entries[i].age = 0;
+        cache->entries[i].last_used = 0;
+        cache->entries[i].valid = 0;
+    }
+    cache->clock = 0;
+    cache->pending = -1;
+    memset(&cache->pending_hash, 0, sizeof(FrameHash));
+    memset(&cache->stats, 0, sizeof(DetectionCacheStats));
+}
+
+int frame_hash_compute(const AVFrame *frame, FrameHash *hash)
+{
+    if (!frame || !frame_has_luma_plane(frame) || frame->width < HASH_GRID_WIDTH || frame->height < HASH_GRID_HEIGHT)
+    {
+        return -1;
+    }
+    const uint8_t *luma = frame->data[0];
+    int stride = frame->linesize[0];
+    uint32_t grid[HASH_GRID_HEIGHT][HASH_GRID_WIDTH];
+    for (int gy = 0; gy < HASH_GRID_HEIGHT; gy++)
+    {
+        int y0 = gy * frame->height / HASH_GRID_HEIGHT;
+        int y1 = (gy + 1) * frame->height / HASH_GRID_HEIGHT;
+        for (int gx = 0; gx < HASH_GRID_WIDTH; gx++)
+        {
+            int x0 = gx * frame->width / HASH_GRID_WIDTH;
+            int x1 = (gx + 1) * frame->width / HASH_GRID_WIDTH;
+            uint32_t sum = 0;
+            uint32_t count = 0;
+            for (int y = y0; y < y1; y += HASH_SAMPLE_STEP)
+            {
+                const uint8_t *row = luma + (size_t)y * stride;
+                for (int x = x0; x < x1; x += HASH_SAMPLE_STEP)
+                {
+                    sum += row[x];
+                    count++;
+                }
+            }
+            // 放大后取整, 保留小数部分的差异
+            grid[gy][gx] = count ? sum * 16 / count : 0;
+        }
+    }
+    memset(hash, 0, sizeof(FrameHash));
+    int bit = 0;
+    for (int gy = 0; gy < HASH_GRID_HEIGHT; gy++)
+    {
+        for (int gx = 0; gx < HASH_GRID_WIDTH - 1; gx++, bit++)
+        {
+            if (grid[gy][gx] < grid[gy][gx + 1])
+            {
+                hash->bits[bit / 64] |= 1ULL << (bit % 64);
+            }
+        }
+    }
+    return 0;
+}
+
+int frame_hash_distance(const FrameHash *a, const FrameHash *b)
+{
+    int distance = 0;
+    for (int i = 0; i < FRAME_HASH_WORDS; i++)
+    {
+        distance += __builtin_popcountll(a->bits[i] ^ b->bits[i]);
+    }
+    return distance;
+}
+
+int detection_cache_lookup(DetectionCache *cache, const AVFrame *frame, std::vector<Box> &boxes)
+{
+    cache->pending = -1;
+    if (!cache->config.enabled)
+    {
+        return 0;
+    }
+    FrameHash hash;
+    if (frame_hash_compute(frame, &hash) != 0)
+    {
+        return 0;
+    }
+    cache->stats.lookups++;
+    cache->clock++;
+    // 找签名最接近的条目
+    int best = -1;
+    int best_distance = cache->config.hash_threshold + 1;
+    for (int i = 0; i < DETECTION_CACHE_SIZE; i++)
+    {
+        if (!cache->entries[i].valid)
+        {
+            continue;
+        }
+        int distance = frame_hash_distance(&hash, &cache->entries[i].hash);
+        if (distance < best_distance)
+        {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    if (best >= 0)
+    {
+        DetectionCacheEntry *entry = &cache->entries[best];
+        if (entry->age < cache->config.max_age)
+        {
+            entry->age++;
+            entry->last_used = cache->clock;
+            boxes = entry->boxes;
+            cache->stats.hits++;
+            return 1;
+        }
+        // 复用次数到达上限, 重新推理并刷新该条目
+        cache->stats.expired++;
+        cache->pending = best;
+    }
+    else
+    {
+        // 优先使用空闲条目, 否则淘汰最久未使用的条目
+        cache->pending = 0;
+        for (int i = 0; i < DETECTION_CACHE_SIZE; i++)
+        {
+            if (!cache->entries[i].valid)
+            {
+                cache->pending = i;
+                break;
+            }
+            if (cache->entries[i].last_used < cache->entries[cache->pending].last_used)
+            {
+                cache->pending = i;
+            }
+        }
+    }
+    cache->pending_hash = hash;
+    return 0;
+}
+
+void detection_cache_store(DetectionCache *cache, const std::vector<Box> &boxes)
+{
+    if (cache->pending < 0)
+    {
+        return;
+    }
+    DetectionCacheEntry *entry = &cache->entries[cache->pending];
+    entry->hash = cache->pending_hash;
+    entry->boxes = boxes;
+    entry->age = 0;
+    entry->last_used = cache->clock;
+    entry->valid = 1;
+    cache->pending = -1;
+}
+
+void detection_cache_dump_stats(const DetectionCache *cache)
+{
+    const DetectionCacheStats *stats = &cache->stats;
+    double hit_rate = stats->lookups ? 100.0 * stats->hits / stats->lookups : 0;
+    log_info("Detection cache: lookups=%llu, hits=%llu (%.1f%%), expired=%llu",
+             (unsigned long long)stats->lookups, (unsigned long long)stats->hits, hit_rate,
+             (unsigned long long)stats->expired);
+}
@@ -0,0 +1,254 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "detection_log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "logger.h"
+
+DetectionLogWriter *detection_log_open(const char *path)
+{
+    DetectionLogWriter *writer = (DetectionLogWriter *)calloc(1, sizeof(DetectionLogWriter));
+    if (!writer)
+    {
+        return NULL;
+    }
+    writer->file = fopen(path, "wb");
+    if (!writer->file)
+    {
+        log_error("Failed to create detection log %s", path);
+        free(writer);
+        return NULL;
+    }
+    DetectionLogFileHeader header = {DETECTION_LOG_MAGIC, DETECTION_LOG_VERSION};
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1)
+    {
+        log_error("Failed to write detection log %s", path);
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int detection_log_write(DetectionLogWriter *writer, int64_t pts, double latency_ms, const std::vector<Box> &boxes)
+{
+    DetectionLogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.pts = pts;
+    record.latency_ms = latency_ms >= 0 ? (float)latency_ms : -1.0f;
+    record.box_count = (uint32_t)boxes.size();
+    if (fwrite(&record, sizeof(record), 1, writer->file) != 1)
+    {
+        return -1;
+    }
+    for (const Box &box : boxes)
+    {
+        DetectionLogBox entry = {box.x, box.y, box.w, box.h, box.prop, box.class_id};
+        if (fwrite(&entry, sizeof(entry), 1, writer->file) != 1)
+        {
+            return -1;
+        }
+    }
+    writer->frames++;
+    return 0;
+}
+
+void detection_log_close(DetectionLogWriter *writer)
+{
+    if (!writer)
+    {
+        return;
+    }
+    if (fclose(writer->file) != 0)
+    {
+        log_error("Failed to flush detection log");
+    }
+    log_info("Detection log closed, %llu frames recorded", (unsigned long long)writer->frames);
+    free(writer);
+}
+
+int detection_log_load(const char *path, DetectionLog *log)
+{
+    log->frames.clear();
+    log->duplicates = 0;
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        log_error("Failed to open detection log %s", path);
+        return -1;
+    }
+    DetectionLogFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != DETECTION_LOG_MAGIC ||
+        header.version != DETECTION_LOG_VERSION)
+    {
+        log_error("%s is not a detection log of version %d", path, DETECTION_LOG_VERSION);
+        fclose(file);
+        return -1;
+    }
+    DetectionLogRecord record;
+    while (fread(&record, sizeof(record), 1, file) == 1)
+    {
+        DetectionLogFrame frame;
+        frame.latency_ms = record.latency_ms;
+        frame.boxes.resize(record.box_count);
+        if (record.box_count > 0 &&
+            fread(frame.boxes.data(), sizeof(DetectionLogBox), record.box_count, file) != record.box_count)
+        {
+            log_warn("Detection log %s is truncated at pts %lld", path, (long long)record.pts);
+            break;
+        }
+        if (!log->frames.insert(std::make_pair(record.pts, frame)).second)
+        {
+            log->duplicates++;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static float box_iou(const DetectionLogBox &a, const DetectionLogBox &b)
+{
+    float x1 = std::max(a.x, b.x);
+    float y1 = std::max(a.y, b.y);
+    float x2 = std::min(a.x + a.w, b.x + b.w);
+    float y2 = std::min(a.y + a.h, b.y + b.h);
+    float inter = std::max(0.0f, x2 - x1) * std::max(0.0f, y2 - y1);
+    float uni = (float)a.w * a.h + (float)b.w * b.h - inter;
+    return uni > 0 ? inter / uni : 1.0f;
+}
+
+// 贪心匹配: 每个基准框取同类别且置信度接近的框中 IoU 最大的一个; 返回未匹配的基准框数, 本次多出的框数写入 extra
+static int match_boxes(const std::vector<DetectionLogBox> &golden, const std::vector<DetectionLogBox> &run,
+                       const DetectionLogTolerance *tolerance, int *extra)
+{
+    std::vector<unsigned char> used(run.size(), 0);
+    int missing = 0;
+    int matched = 0;
+    for (const DetectionLogBox &g : golden)
+    {
+        int best = -1;
+        float best_iou = tolerance->min_iou;
+        for (size_t i = 0; i < run.size(); i++)
+        {
+            if (used[i] || run[i].class_id != g.class_id || fabsf(run[i].prop - g.prop) > tolerance->score_delta)
+            {
+                continue;
+            }
+            float iou = box_iou(g, run[i]);
+            if (iou >= best_iou)
+            {
+                best = (int)i;
+                best_iou = iou;
+            }
+        }
+        if (best >= 0)
+        {
+            used[best] = 1;
+            matched++;
+        }
+        else
+        {
+            missing++;
+        }
+    }
+    *extra = (int)run.size() - matched;
+    return missing;
+}
+
+// 已排序数组的分位数(线性插值)
+static double sorted_quantile(const std::vector<double> &values, double q)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    double pos = q * (values.size() - 1);
+    size_t lower = (size_t)pos;
+    size_t upper = std::min(lower + 1, values.size() - 1);
+    return values[lower] + (values[upper] - values[lower]) * (pos - lower);
+}
+
+void detection_log_compare(const DetectionLog *golden, const DetectionLog *run, const DetectionLogTolerance *tolerance,
+                           DetectionLogDiff *diff)
+{
+    diff->frames_compared = 0;
+    diff->frames_mismatched = 0;
+    diff->frames_only_golden = 0;
+    diff->frames_only_run = 0;
+    diff->boxes_golden = 0;
+    diff->boxes_run = 0;
+    diff->boxes_missing = 0;
+    diff->boxes_extra = 0;
+    diff->latency_frames = 0;
+    diff->golden_latency_ms = 0;
+    diff->run_latency_ms = 0;
+    diff->latency_delta_p50_ms = 0;
+    diff->latency_delta_p95_ms = 0;
+    diff->mismatches.clear();
+    std::vector<double> deltas;
+    for (const auto &entry : golden->frames)
+    {
+        auto it = run->frames.find(entry.first);
+        if (it == run->frames.end())
+        {
+            diff->frames_only_golden++;
+            continue;
+        }
+        const DetectionLogFrame &g = entry.second;
+        const DetectionLogFrame &r = it->second;
+        diff->frames_compared++;
+        diff->boxes_golden += g.boxes.size();
+        diff->boxes_run += r.boxes.size();
+        int extra = 0;
+        int missing = match_boxes(g.boxes, r.boxes, tolerance, &extra);
+        if (missing > 0 || extra > 0)
+        {
+            diff->frames_mismatched++;
+            diff->boxes_missing += missing;
+            diff->boxes_extra += extra;
+            if (diff->mismatches.size() < DETECTION_LOG_MAX_MISMATCHES)
+            {
+                DetectionLogMismatch mismatch = {entry.first, (int)g.boxes.size(), (int)r.boxes.size(),
+                                                 missing + extra};
+                diff->mismatches.push_back(mismatch);
+            }
+        }
+        if (g.latency_ms >= 0 && r.latency_ms >= 0)
+        {
+            diff->latency_frames++;
+            diff->golden_latency_ms += g.latency_ms;
+            diff->run_latency_ms += r.latency_ms;
+            deltas.push_back(r.latency_ms - g.latency_ms);
+        }
+    }
+    for (const auto &entry : run->frames)
+    {
+        if (golden->frames.find(entry.first) == golden->frames.end())
+        {
+            diff->frames_only_run++;
+        }
+    }
+    if (diff->latency_frames > 0)
+    {
+        diff->golden_latency_ms /= diff->latency_frames;
+        diff->run_latency_ms /= diff->latency_frames;
+        std::sort(deltas.begin(), deltas.end());
+        diff->latency_delta_p50_ms = sorted_quantile(deltas, 0.5);
+        diff->latency_delta_p95_ms = sorted_quantile(deltas, 0.95);
+    }
+}
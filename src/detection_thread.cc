@@ -18,22 +18,168 @@
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
-#include "opencv_dnn_module.h"
+#include "inference_service.h"
 #include "opencv_utils.h"
+#include "motion_gate.h"
+#include "tracker.h"
+#include "roi.h"
+#include "tiling.h"
+#include "detection_cache.h"
+#include "detection_log.h"
+#include "rate_controller.h"
+#include "supervisor.h"
+#include "metrics.h"
 #include "warning_timer.h"
 #include "timestamp_utils.h"
 #include "logger.h"
+
+// 运动门控、缓存和帧率控制统计的打印间隔(秒)
+#define STATS_INTERVAL 60
+
+// 计算本轮推理的区域: 关注区域裁剪, 启用切片时再把每个区域切分为重叠的切片
+// 切片尺寸按共享模型的实际输入尺寸计算
+static void compute_inference_regions(const StreamConfig *config, cv::Size input_size, const cv::Mat &frame,
+                                      const MotionGate *gate, const std::vector<Box> &previous, uint64_t round,
+                                      std::vector<cv::Rect> &regions)
+{
+    roi_compute_crops(&config->roi, frame.cols, frame.rows, regions);
+    if (!config->tiling.enabled)
+    {
+        return;
+    }
+    std::vector<cv::Rect> areas = regions;
+    if (areas.empty())
+    {
+        areas.push_back(cv::Rect(0, 0, frame.cols, frame.rows));
+    }
+    regions.clear();
+    for (const cv::Rect &area : areas)
+    {
+        std::vector<cv::Rect> tiles;
+        tiling_compute_tiles(&config->tiling, area, input_size.width, input_size.height, tiles);
+        // 自适应模式只推理有运动或有目标的切片, 定期全量刷新以发现静止的新目标
+        if (config->tiling.adaptive && round % config->tiling.full_refresh != 0)
+        {
+            tiling_select_active(gate, previous, tiles);
+        }
+        regions.insert(regions.end(), tiles.begin(), tiles.end());
+        if (config->tiling.full_frame && tiles.size() > 1)
+        {
+            regions.push_back(area);
+        }
+    }
+}
+
+// 发布检测结果到渲染队列, 并对告警类别记录告警
+// 启用跟踪时每个目标只告警一次, 静止不动的同一个人不会被重复计数
+static void publish_detections(const ThreadArgs *args, const std::vector<Box> &outputs, AVFrame *detection_frame,
+                               const std::vector<unsigned char> &warning_classes, Tracker *tracker)
+{
+    QueueItem boxes_item;
+    memset(&boxes_item, 0, sizeof(QueueItem));
+    boxes_item.box_count = (outputs.size() > 20) ? 20 : outputs.size();
+    boxes_item.type = ONLY_BOXES;
+    boxes_item.data = NULL;
+    for (int i = 0; i < boxes_item.box_count; ++i)
+    {
+        // 存储检测框信息
+        boxes_item.Boxes[i].x = outputs[i].x;
+        boxes_item.Boxes[i].y = outputs[i].y;
+        boxes_item.Boxes[i].w = outputs[i].w;
+        boxes_item.Boxes[i].h = outputs[i].h;
+        boxes_item.Boxes[i].prop = outputs[i].prop;
+        boxes_item.Boxes[i].track_id = outputs[i].track_id;
+        boxes_item.Boxes[i].class_id = outputs[i].class_id;
+        strcpy(boxes_item.Boxes[i].label, outputs[i].label);
+        // 检测到告警类别以后 POST 具体的识别JSON
+        int class_id = outputs[i].class_id;
+        // 跟踪时每个目标只记录一次, 但单独即可触发告警; 未跟踪时按帧计数, 由告警计时器的次数阈值过滤误检
+        if (class_id >= 0 && class_id < (int)warning_classes.size() && warning_classes[class_id] &&
+            detection_frame->width > 0 && detection_frame->height > 0)
+        {
+            if (tracker == NULL)
+            {
+                warning_timer_record_warning(boxes_item.Boxes[i].label, get_current_timestamp(), detection_frame);
+            }
+            else if (tracker_claim_warning(tracker, outputs[i].track_id))
+            {
+                warning_timer_record_confirmed(boxes_item.Boxes[i].label, get_current_timestamp(), detection_frame);
+            }
+        }
+    }
+    // 不显示的视频流没有渲染队列
+    if (args->box_queue)
+    {
+        enqueue(args->box_queue, boxes_item);
+    }
+}
+
 void *frame_detection_thread(void *arg)
 {
     const ThreadArgs *args = (ThreadArgs *)arg;
-    const char *modelPath = "./yolov8n.onnx";
-    cv::dnn::Net net;
-    if (Init_CV_ONNX_DNN_Yolov8(modelPath, &net) != 0)
+    // 模型由同一 NUMA 节点的各路共享, 本线程只负责门控、缓存、跟踪等单路逻辑
+    InferenceService *inference = args->inference;
+    std::vector<int> warning_ids(MAX_DETECTION_CLASSES);
+    int warning_count = label_map_parse_class_list(&inference->model.labels, args->config->detector.warning_classes,
+                                                   inference->model.num_classes, warning_ids.data(),
+                                                   MAX_DETECTION_CLASSES);
+    std::vector<unsigned char> warning_classes(MAX_DETECTION_CLASSES, 0);
+    for (int i = 0; i < warning_count; i++)
+    {
+        if (warning_ids[i] < MAX_DETECTION_CLASSES)
+        {
+            warning_classes[warning_ids[i]] = 1;
+        }
+    }
+    // 本路的类别过滤和阈值, 与其他路合批时各自做后处理
+    cv::Size model_input(inference->model.input_width, inference->model.input_height);
+    ClassFilter *filter = (ClassFilter *)malloc(sizeof(ClassFilter));
+    Yolov8Postprocess post = {&inference->model.filter, args->config->detector.nms_threshold};
+    if (filter && yolov8_build_class_filter(&args->config->detector, &inference->model.labels,
+                                            inference->model.num_classes, filter) == 0)
+    {
+        post.filter = filter;
+    }
+    else
+    {
+        log_error("Stream %s: invalid detector.classes or class_thresholds, using the global classes",
+                  args->config->name);
+    }
+    MotionGate motion_gate;
+    motion_gate_init(&motion_gate, &args->config->motion);
+    if (args->config->tiling.enabled && args->config->tiling.adaptive && !args->config->motion.enabled)
+    {
+        log_warn("Stream %s: adaptive tiling needs motion.enabled = 1, every tile will be inferred",
+                 args->config->name);
+    }
+    if (args->config->tiling.enabled && inference->model.caps.max_batch_size <= 1)
     {
-        log_info( "Error: Failed to initialize the YOLOv8 ONNX DNN model.");
-        pthread_exit(NULL);
-        return NULL;
+        log_info("Stream %s: max_batch is 1, tiles are inferred one forward pass each", args->config->name);
     }
+    Tracker tracker;
+    tracker_init(&tracker, &args->config->tracker);
+    Tracker *active_tracker = args->config->tracker.enabled ? &tracker : NULL;
+    DetectionCache detection_cache;
+    detection_cache_init(&detection_cache, &args->config->cache);
+    RateStream *rate_stream = rate_controller_register(args->config->name, &args->config->rate,
+                                                       args->config->detector.detect_interval);
+    // 不推理的帧: 启用跟踪时由跟踪器推算位置, 否则沿用最近一次推理的结果
+    std::vector<Box> last_outputs;
+    std::vector<Box> tracked;
+    std::vector<cv::Rect> regions;
+    uint64_t inference_round = 0;
+    time_t last_stats_time = time(NULL);
+    char labels[96];
+    snprintf(labels, sizeof(labels), "stream=\"%s\"", args->config->name);
+    Metric *frames_total = metrics_counter("detection_frames_total", "Frames taken by the detection stage", labels);
+    Metric *inferred_total = metrics_counter("detection_inferred_total", "Frames sent to the inference service", labels);
+    Metric *skipped_total = metrics_counter("detection_skipped_total",
+                                            "Frames skipped by the rate controller or the motion gate", labels);
+    Metric *cache_lookups = metrics_counter("detection_cache_lookups_total", "Detection cache lookups", labels);
+    Metric *cache_hits = metrics_counter("detection_cache_hits_total", "Detection cache hits that skipped inference",
+                                         labels);
+    Metric *latency = metrics_histogram("detection_latency_seconds",
+                                        "Inference latency of one frame including conversion and queueing", labels);
 
     while (1)
     {
@@ -44,48 +190,154 @@ void *frame_detection_thread(void *arg)
 
         QueueItem detection_item;
         memset(&detection_item, 0, sizeof(QueueItem));
+        stage_wait(args->health);
         if (dequeue(args->detection_queue, &detection_item))
         {
+            stage_heartbeat(args->health);
+            trace_stamp(&detection_item.trace, TRACE_DEQUEUE);
+            trace_record(SPAN_QUEUE_DETECT, &detection_item.trace, TRACE_ENQUEUE, TRACE_DEQUEUE);
             if (detection_item.type == ONLY_FRAME)
             {
                 AVFrame *detection_frame = (AVFrame *)detection_item.data;
-                cv::Mat detection_mat = AVFrameToCVMat(detection_frame);
-                if (!detection_mat.empty())
+                int64_t frame_pts = detection_frame->pts != AV_NOPTS_VALUE ? detection_frame->pts
+                                                                           : detection_frame->best_effort_timestamp;
+                double frame_time = frame_pts != AV_NOPTS_VALUE && detection_frame->time_base.den > 0
+                                        ? frame_pts * av_q2d(detection_frame->time_base)
+                                        : -1;
+                // 门控每帧都要检查, 背景模型和保活计数才与帧率控制的步长无关
+                int rate_pass = rate_controller_should_detect(rate_stream, frame_time);
+                int motion_pass = motion_gate_check(&motion_gate, detection_frame);
+                int detect = rate_pass && motion_pass;
+                std::vector<Box> outputs;
+                int detected = 0;
+                double infer_latency_ms = -1;
+                metric_add(frames_total, 1);
+                metric_add(skipped_total, detect ? 0 : 1);
+                metric_add(cache_lookups, detect && args->config->cache.enabled ? 1 : 0);
+                // 近似重复帧直接复用缓存的检测结果, 不做前向
+                if (detect && detection_cache_lookup(&detection_cache, detection_frame, outputs))
                 {
-                    std::vector<Box> outputs;
-                    Infer_CV_ONNX_DNN_Yolov8(&net, detection_mat, outputs);
-                    QueueItem boxes_item;
-                    memset(&boxes_item, 0, sizeof(QueueItem));
-                    boxes_item.box_count = (outputs.size() > 20) ? 20 : outputs.size();
-                    boxes_item.type = ONLY_BOXES;
-                    boxes_item.data = NULL;
-                    for (int i = 0; i < boxes_item.box_count; ++i)
+                    detected = 1;
+                    metric_add(cache_hits, 1);
+                    rate_controller_report(rate_stream, -1, (int)outputs.size());
+                }
+                else if (detect)
+                {
+                    struct timespec infer_start, infer_end;
+                    clock_gettime(CLOCK_MONOTONIC, &infer_start);
+                    cv::Mat detection_mat = AVFrameToCVMat(detection_frame);
+                    if (!detection_mat.empty())
                     {
-                        // 存储检测框信息
-                        boxes_item.Boxes[i].x = outputs[i].x;
-                        boxes_item.Boxes[i].y = outputs[i].y;
-                        boxes_item.Boxes[i].w = outputs[i].w;
-                        boxes_item.Boxes[i].h = outputs[i].h;
-                        boxes_item.Boxes[i].prop = outputs[i].prop;
-                        strcpy(boxes_item.Boxes[i].label, outputs[i].label);
-                        // 测试：检测到人以后 POST 具体的识别JSON
-                        if (strcmp(boxes_item.Boxes[i].label, "person") == 0)
+                        // 只对关注区域(或其切片)推理, 再丢弃区域外和屏蔽区域内的检测
+                        compute_inference_regions(args->config, model_input, detection_mat, &motion_gate,
+                                                  active_tracker ? tracked : last_outputs, inference_round++, regions);
+                        int failed = 0;
+                        int skipped = args->config->tiling.enabled && regions.empty();
+                        if (!skipped)
                         {
-                            if (detection_frame->width > 0 && detection_frame->height > 0)
+                            FrameTrace *trace = &detection_item.trace;
+                            failed = inference_service_submit(inference, detection_mat, regions, &post, outputs,
+                                                              trace) != 0;
+                            metric_add(inferred_total, 1);
+                            trace_record(SPAN_DETECT_PREPROCESS, trace, TRACE_DEQUEUE, TRACE_PREPROCESS);
+                            trace_record(SPAN_DETECT_INFER, trace, TRACE_PREPROCESS, TRACE_INFER);
+                            trace_record(SPAN_DETECT_POSTPROCESS, trace, TRACE_INFER, TRACE_POSTPROCESS);
+                            trace_record(SPAN_E2E_DETECT, trace, TRACE_DEMUX, TRACE_POSTPROCESS);
+                        }
+                        if (skipped)
+                        {
+                            // 自适应切片没有选中任何切片: 本帧没有推理, 不能当作"没有目标"写入缓存、记录和跟踪器
+                            outputs.clear();
+                        }
+                        else if (failed)
+                        {
+                            // 推理失败不等于没有目标: 不写缓存、记录和跟踪器, 按跳过的帧处理
+                            log_warn("Stream %s: inference failed, reusing the previous detections",
+                                     args->config->name);
+                            outputs.clear();
+                        }
+                        else
+                        {
+                            if (args->config->tiling.enabled)
                             {
-                                warning_timer_record_warning(boxes_item.Boxes[i].label, get_current_timestamp(), detection_frame);
+                                tiling_merge_detections(outputs, args->config->tiling.nms_threshold);
                             }
+                            roi_filter_detections(&args->config->roi, detection_mat.cols, detection_mat.rows, outputs);
+                            detection_cache_store(&detection_cache, outputs);
+                            detected = 1;
+                            clock_gettime(CLOCK_MONOTONIC, &infer_end);
+                            infer_latency_ms = (infer_end.tv_sec - infer_start.tv_sec) * 1000.0 +
+                                               (infer_end.tv_nsec - infer_start.tv_nsec) / 1000000.0;
+                            rate_controller_report(rate_stream, infer_latency_ms, (int)outputs.size());
+                            metric_observe_us(latency, (uint64_t)(infer_latency_ms * 1000));
                         }
                     }
-                    enqueue(args->box_queue, boxes_item);
+                }
+                if (detected)
+                {
+                    motion_gate_consume(&motion_gate);
+                }
+                if (detected && args->detection_log)
+                {
+                    // 记录跟踪之前的检测结果, 与帧一一对应, 回放时可逐帧对比
+                    if (detection_log_write(args->detection_log, frame_pts, infer_latency_ms, outputs) != 0)
+                    {
+                        log_error("Stream %s: failed to write detection log", args->config->name);
+                    }
+                }
+                if (detected)
+                {
+                    if (active_tracker)
+                    {
+                        tracker_update(active_tracker, outputs, tracked);
+                        publish_detections(args, tracked, detection_frame, warning_classes, active_tracker);
+                    }
+                    else
+                    {
+                        last_outputs = outputs;
+                        publish_detections(args, outputs, detection_frame, warning_classes, NULL);
+                    }
+                }
+                else if (active_tracker)
+                {
+                    tracker_predict(active_tracker, tracked);
+                    publish_detections(args, tracked, detection_frame, warning_classes, active_tracker);
+                }
+                else
+                {
+                    publish_detections(args, last_outputs, detection_frame, warning_classes, NULL);
                 }
                 av_frame_free(&detection_frame);
             }
         }
+        else
+        {
+            // 拉流线程停止后关闭队列, 剩余的帧已处理完
+            goto END;
+        }
+        if (time(NULL) - last_stats_time >= STATS_INTERVAL)
+        {
+            if (args->config->motion.enabled)
+            {
+                motion_gate_dump_stats(&motion_gate);
+            }
+            if (args->config->cache.enabled)
+            {
+                detection_cache_dump_stats(&detection_cache);
+            }
+            if (args->config->rate.enabled)
+            {
+                rate_controller_dump_stats();
+            }
+            last_stats_time = time(NULL);
+        }
     }
 
 END:
-    Release_CV_ONNX_DNN_Yolov8(&net);
+    motion_gate_dump_stats(&motion_gate);
+    detection_cache_dump_stats(&detection_cache);
+    rate_controller_unregister(rate_stream);
+    free(filter);
     pthread_exit(NULL);
     return NULL;
-}
\ No newline at end of file
+}
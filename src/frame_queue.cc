@@ -13,6 +13,7 @@
 // You should have received a copy of the GNU Affero General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "frame_queue.h"
+#include <time.h>
 #include "logger.h"
 
 void free_queue_node(QueueItem *item)
@@ -34,8 +35,20 @@ void frame_queue_init(FrameQueue *q, int max_size)
     q->rear = NULL;
     pthread_mutex_init(&q->lock, NULL);
     pthread_cond_init(&q->cond, NULL);
+    pthread_cond_init(&q->space_cond, NULL);
     q->size = 0;
     q->max_size = max_size;
+    q->block_timeout_ms = 0;
+    q->closed = 0;
+    q->enqueued = 0;
+    q->dropped = 0;
+}
+// 设置队列满时的等待时间
+void frame_queue_set_block_timeout(FrameQueue *q, int timeout_ms)
+{
+    pthread_mutex_lock(&q->lock);
+    q->block_timeout_ms = timeout_ms > 0 ? timeout_ms : 0;
+    pthread_mutex_unlock(&q->lock);
 }
 // 入队操作
 // @param q 队列指针
@@ -45,6 +58,30 @@ void frame_queue_init(FrameQueue *q, int max_size)
 int enqueue(FrameQueue *q, QueueItem item)
 {
     pthread_mutex_lock(&q->lock);
+    if (q->size >= q->max_size && q->block_timeout_ms > 0 && !q->closed)
+    {
+        // 反压: 等消费者腾出空位; 超时说明消费者已停止, 退回丢弃队首, 生产者不会永远阻塞
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += q->block_timeout_ms / 1000;
+        deadline.tv_nsec += (long)(q->block_timeout_ms % 1000) * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (q->size >= q->max_size && !q->closed)
+        {
+            if (pthread_cond_timedwait(&q->space_cond, &q->lock, &deadline) != 0)
+            {
+                log_warn("Queue still full after %d ms, dropping the oldest item", q->block_timeout_ms);
+                break;
+            }
+        }
+    }
+    if (q->closed)
+    {
+        // 消费者已退出, 由调用方释放元素
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+    }
     if (q->size >= q->max_size)
     {
         // 队列已满，移除队首元素
@@ -55,6 +92,7 @@ int enqueue(FrameQueue *q, QueueItem item)
             q->rear = NULL;
         }
         q->size--;
+        __atomic_store_n(&q->dropped, q->dropped + 1, __ATOMIC_RELAXED);
         // 释放 AVFrame 资源（如果有的话）
         if (temp->item.data != NULL)
         {
@@ -66,9 +104,11 @@ int enqueue(FrameQueue *q, QueueItem item)
     QueueNode *newNode = (QueueNode *)malloc(sizeof(QueueNode));
     if (newNode == NULL)
     {
+        // 内存不足时丢弃该元素, 由调用方释放, 不影响其他阶段
         log_error( "malloc failed");
+        __atomic_store_n(&q->dropped, q->dropped + 1, __ATOMIC_RELAXED);
         pthread_mutex_unlock(&q->lock);
-        exit(EXIT_FAILURE);
+        return 0;
     }
     newNode->item = item;
     newNode->next = NULL;
@@ -82,6 +122,7 @@ int enqueue(FrameQueue *q, QueueItem item)
         q->rear = newNode;
     }
     q->size++; // 增加元素数量
+    __atomic_store_n(&q->enqueued, q->enqueued + 1, __ATOMIC_RELAXED);
     pthread_cond_signal(&q->cond);
     pthread_mutex_unlock(&q->lock);
     return 1;
@@ -94,10 +135,15 @@ int enqueue(FrameQueue *q, QueueItem item)
 int dequeue(FrameQueue *q, QueueItem *item)
 {
     pthread_mutex_lock(&q->lock);
-    while (q->front == NULL)
+    while (q->front == NULL && !q->closed)
     {
         pthread_cond_wait(&q->cond, &q->lock);
     }
+    if (q->front == NULL)
+    {
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+    }
     QueueNode *temp = q->front;
     *item = temp->item;
     q->front = q->front->next;
@@ -106,6 +152,7 @@ int dequeue(FrameQueue *q, QueueItem *item)
         q->rear = NULL;
     }
     q->size--; // 减少元素数量
+    pthread_cond_signal(&q->space_cond);
     pthread_mutex_unlock(&q->lock);
     free(temp);
     return 1;
@@ -130,10 +177,27 @@ int async_dequeue(FrameQueue *q, QueueItem *item)
         q->rear = NULL;
     }
     q->size--; // 减少元素数量
+    pthread_cond_signal(&q->space_cond);
     pthread_mutex_unlock(&q->lock);
     free(temp);
     return 1;
 }
+// 关闭队列
+void frame_queue_close(FrameQueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_cond_broadcast(&q->space_cond);
+    pthread_mutex_unlock(&q->lock);
+}
+// 重新打开队列
+void frame_queue_reopen(FrameQueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = 0;
+    pthread_mutex_unlock(&q->lock);
+}
 // 释放队列资源的函数
 void frame_queue_destroy(FrameQueue *q)
 {
@@ -155,6 +219,7 @@ void frame_queue_destroy(FrameQueue *q)
     pthread_mutex_unlock(&q->lock);
     pthread_mutex_destroy(&q->lock);
     pthread_cond_destroy(&q->cond);
+    pthread_cond_destroy(&q->space_cond);
     q->front = NULL;
     q->rear = NULL;
     q->size = 0;
@@ -0,0 +1,70 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "inference_backend.h"
+#include <stdlib.h>
+#include <string.h>
+#include "logger.h"
+
+// 已注册的推理后端, 新增后端在此登记
+static const InferenceBackend *registered_backends[] = {
+    &opencv_dnn_backend,
+};
+
+static const int num_registered_backends = sizeof(registered_backends) / sizeof(registered_backends[0]);
+
+InferenceBackend *create_inference_backend(const char *name)
+{
+    for (int i = 0; i < num_registered_backends; i++)
+    {
+        if (strcmp(registered_backends[i]->name, name) == 0)
+        {
+            InferenceBackend *backend = (InferenceBackend *)malloc(sizeof(InferenceBackend));
+            if (backend == NULL)
+            {
+                return NULL;
+            }
+            *backend = *registered_backends[i];
+            backend->priv = NULL;
+            return backend;
+        }
+    }
+    log_error("Unknown inference backend: %s", name);
+    list_inference_backends();
+    return NULL;
+}
+
+void destroy_inference_backend(InferenceBackend *backend)
+{
+    if (backend == NULL)
+    {
+        return;
+    }
+    if (backend->release)
+    {
+        backend->release(backend);
+    }
+    free(backend);
+}
+
+void list_inference_backends()
+{
+    log_info("===== inference backends =====");
+    for (int i = 0; i < num_registered_backends; i++)
+    {
+        log_info("  %s", registered_backends[i]->name);
+    }
+    log_info("==============================");
+}
@@ -0,0 +1,393 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "inference_service.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "thread_utils.h"
+#include "logger.h"
+
+// 请求中送入网络的图像数
+static int request_images(const InferenceRequest *request)
+{
+    return request->regions->empty() ? 1 : (int)request->regions->size();
+}
+
+// 取出队首请求; 调用方持有 lock
+static InferenceRequest *pop_request(InferenceService *service)
+{
+    InferenceRequest *request = service->head;
+    if (request)
+    {
+        service->head = request->next;
+        if (!service->head)
+        {
+            service->tail = NULL;
+        }
+        request->next = NULL;
+    }
+    return request;
+}
+
+static void *inference_service_thread(void *arg)
+{
+    InferenceService *service = (InferenceService *)arg;
+    // 线程已按节点绑定, 在这里加载模型, 权重和推理缓冲按首次访问分配在本节点
+    int load_ret = init_yolov8_model(service->detector, &service->model);
+    pthread_mutex_lock(&service->lock);
+    service->load_ret = load_ret;
+    service->loaded = 1;
+    pthread_cond_broadcast(&service->done_cond);
+    if (load_ret != 0)
+    {
+        service->running = 0;
+        pthread_mutex_unlock(&service->lock);
+        return NULL;
+    }
+    int max_images = service->model.caps.max_batch_size;
+    std::vector<InferenceRequest *> batch;
+    std::vector<cv::Mat> frames;
+    std::vector<std::vector<cv::Rect>> regions;
+    std::vector<std::vector<Box>> results;
+    std::vector<Yolov8Postprocess> post;
+    Yolov8Postprocess model_post = {&service->model.filter, service->model.nms_threshold};
+    while (service->running)
+    {
+        if (!service->head)
+        {
+            pthread_cond_wait(&service->request_cond, &service->lock);
+            continue;
+        }
+        // 批量未满时短暂等待其他摄像头的请求, 截止时间从第一个请求算起
+        batch.clear();
+        int images = 0;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)service->batch_wait_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (service->running)
+        {
+            while (service->head && (batch.empty() || images + request_images(service->head) <= max_images))
+            {
+                InferenceRequest *request = pop_request(service);
+                images += request_images(request);
+                batch.push_back(request);
+            }
+            if (images >= max_images || service->head || service->batch_wait_ms <= 0 ||
+                pthread_cond_timedwait(&service->request_cond, &service->lock, &deadline) != 0)
+            {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&service->lock);
+
+        frames.resize(batch.size());
+        regions.resize(batch.size());
+        results.resize(batch.size());
+        post.resize(batch.size());
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            frames[i] = *batch[i]->frame;
+            regions[i] = *batch[i]->regions;
+            post[i] = batch[i]->post ? *batch[i]->post : model_post;
+            results[i].clear();
+        }
+        uint64_t batch_start = trace_now();
+        int ret = inference_yolov8_batch_regions(&service->model, frames.data(), regions.data(),
+                                                 (int)batch.size(), post.data(), results.data());
+        // 整个批次共用一组时间点: 预处理和前向完成的时间由模型记录的耗时推算
+        uint64_t preprocess_done = batch_start + service->model.timing.preprocess_ticks;
+        uint64_t infer_done = preprocess_done + service->model.timing.infer_ticks;
+        uint64_t batch_end = trace_now();
+        // 释放对调用方图像的引用, 调用方在请求完成后可能立即释放帧
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            frames[i].release();
+        }
+
+        pthread_mutex_lock(&service->lock);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            batch[i]->boxes->swap(results[i]);
+            if (batch[i]->trace && latency_trace_enabled() && ret == 0)
+            {
+                batch[i]->trace->stamps[TRACE_PREPROCESS] = preprocess_done;
+                batch[i]->trace->stamps[TRACE_INFER] = infer_done;
+                batch[i]->trace->stamps[TRACE_POSTPROCESS] = batch_end;
+            }
+            batch[i]->ret = ret;
+            batch[i]->done = 1;
+        }
+        service->stats.requests += batch.size();
+        service->stats.batches++;
+        service->stats.images += images;
+        metric_add(service->requests_total, (int64_t)batch.size());
+        metric_add(service->batches_total, 1);
+        metric_add(service->images_total, images);
+        metric_add(service->errors_total, ret == 0 ? 0 : 1);
+        metric_observe_us(service->batch_latency, (uint64_t)trace_ticks_to_us(batch_end - batch_start));
+        pthread_cond_broadcast(&service->done_cond);
+    }
+    // 停止时让仍在等待的请求以失败返回
+    for (InferenceRequest *request = pop_request(service); request; request = pop_request(service))
+    {
+        request->ret = -1;
+        request->done = 1;
+    }
+    pthread_cond_broadcast(&service->done_cond);
+    pthread_mutex_unlock(&service->lock);
+    return NULL;
+}
+
+int inference_service_init(InferenceService *service, const DetectorConfig *detector, const ThreadConfig *threads,
+                           int numa_node)
+{
+    memset(&service->stats, 0, sizeof(InferenceServiceStats));
+    service->head = NULL;
+    service->tail = NULL;
+    service->detector = detector;
+    // 推理线程保存的是配置的指针, 复制一份放在服务里, 节点只对本服务生效
+    service->threads = *threads;
+    service->threads.numa_node = numa_node;
+    service->load_ret = -1;
+    service->loaded = 0;
+    service->batch_wait_ms = detector->batch_wait_ms;
+    char labels[32];
+    labels[0] = '\0';
+    if (numa_node >= 0)
+    {
+        snprintf(labels, sizeof(labels), "node=\"%d\"", numa_node);
+    }
+    service->requests_total = metrics_counter("inference_requests_total", "Completed inference requests", labels);
+    service->batches_total = metrics_counter("inference_batches_total", "Batched forward passes", labels);
+    service->images_total = metrics_counter("inference_images_total",
+                                            "Images fed to the network, including tiles and ROI crops", labels);
+    service->errors_total = metrics_counter("inference_errors_total", "Batches that failed", labels);
+    service->batch_latency = metrics_histogram("inference_batch_latency_seconds",
+                                               "Time of one batch including preprocessing and postprocessing", labels);
+    // OpenCV 线程池在首次并行计算时创建, 继承首个推理线程的 CPU 亲和性
+    if (threads->opencv_threads > 0)
+    {
+        cv::setNumThreads(threads->opencv_threads);
+    }
+    pthread_mutex_init(&service->lock, NULL);
+    pthread_cond_init(&service->request_cond, NULL);
+    pthread_cond_init(&service->done_cond, NULL);
+    service->running = 1;
+    if (create_stage_thread(&service->thread, STAGE_INFERENCE, &service->threads, inference_service_thread, service) != 0)
+    {
+        log_error("Failed to create inference thread");
+        pthread_cond_destroy(&service->done_cond);
+        pthread_cond_destroy(&service->request_cond);
+        pthread_mutex_destroy(&service->lock);
+        return -1;
+    }
+    // 等推理线程加载完模型, 加载失败在这里返回而不是在第一次提交时
+    pthread_mutex_lock(&service->lock);
+    while (!service->loaded)
+    {
+        pthread_cond_wait(&service->done_cond, &service->lock);
+    }
+    int ret = service->load_ret;
+    pthread_mutex_unlock(&service->lock);
+    if (ret != 0)
+    {
+        log_error("Failed to initialize the YOLOv8 model");
+        pthread_join(service->thread, NULL);
+        pthread_cond_destroy(&service->done_cond);
+        pthread_cond_destroy(&service->request_cond);
+        pthread_mutex_destroy(&service->lock);
+        return -1;
+    }
+    if (numa_node >= 0)
+    {
+        log_info("Inference service on NUMA node %d started", numa_node);
+    }
+    return 0;
+}
+
+int inference_service_submit(InferenceService *service, const cv::Mat &frame, const std::vector<cv::Rect> &regions,
+                             const Yolov8Postprocess *post, std::vector<Box> &boxes, FrameTrace *trace)
+{
+    InferenceRequest request;
+    request.frame = &frame;
+    request.regions = &regions;
+    request.boxes = &boxes;
+    request.post = post;
+    request.trace = trace;
+    request.ret = -1;
+    request.done = 0;
+    request.next = NULL;
+    pthread_mutex_lock(&service->lock);
+    if (!service->running)
+    {
+        pthread_mutex_unlock(&service->lock);
+        return -1;
+    }
+    if (service->tail)
+    {
+        service->tail->next = &request;
+    }
+    else
+    {
+        service->head = &request;
+    }
+    service->tail = &request;
+    pthread_cond_signal(&service->request_cond);
+    while (!request.done)
+    {
+        pthread_cond_wait(&service->done_cond, &service->lock);
+    }
+    pthread_mutex_unlock(&service->lock);
+    return request.ret;
+}
+
+void inference_service_stop(InferenceService *service)
+{
+    pthread_mutex_lock(&service->lock);
+    service->running = 0;
+    pthread_cond_broadcast(&service->request_cond);
+    pthread_mutex_unlock(&service->lock);
+    pthread_join(service->thread, NULL);
+    pthread_cond_destroy(&service->done_cond);
+    pthread_cond_destroy(&service->request_cond);
+    pthread_mutex_destroy(&service->lock);
+    release_yolov8_model(&service->model);
+}
+
+void inference_service_dump_stats(InferenceService *service)
+{
+    pthread_mutex_lock(&service->lock);
+    InferenceServiceStats stats = service->stats;
+    pthread_mutex_unlock(&service->lock);
+    char node[24] = "";
+    if (service->threads.numa_node >= 0)
+    {
+        snprintf(node, sizeof(node), " (node %d)", service->threads.numa_node);
+    }
+    log_info("Inference service%s: requests=%llu, batches=%llu, images=%llu, avg_batch=%.2f", node,
+             (unsigned long long)stats.requests, (unsigned long long)stats.batches,
+             (unsigned long long)stats.images, stats.batches ? (double)stats.images / stats.batches : 0);
+}
+
+// 节点对应的槽位: [0] 不绑定节点, [n + 1] 节点 n
+static int pool_slot(int numa_node)
+{
+    return numa_node >= 0 && numa_node < NUMA_MAX_NODES ? numa_node + 1 : 0;
+}
+
+// 创建节点的服务; 调用方持有 pool->lock
+static InferenceService *pool_create(InferencePool *pool, int numa_node)
+{
+    InferenceService *service = (InferenceService *)calloc(1, sizeof(InferenceService));
+    if (!service)
+    {
+        log_error("Failed to allocate inference service");
+        return NULL;
+    }
+    if (inference_service_init(service, &pool->detector, &pool->threads, numa_node) != 0)
+    {
+        free(service);
+        return NULL;
+    }
+    pool->services[pool_slot(numa_node)] = service;
+    return service;
+}
+
+int inference_pool_init(InferencePool *pool, const DetectorConfig *detector, const ThreadConfig *threads)
+{
+    memset(pool->services, 0, sizeof(pool->services));
+    pool->detector = *detector;
+    pool->threads = *threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    int count = numa_node_count();
+    int ret = 0;
+    pthread_mutex_lock(&pool->lock);
+    if (threads->numa_node == NUMA_NODE_AUTO && count > 1)
+    {
+        // 自动放置时各路会分到所有节点, 每个节点一份模型, 内存开销为节点数倍
+        for (int node = 0; node < count && node < NUMA_MAX_NODES && ret == 0; node++)
+        {
+            ret = pool_create(pool, node) ? 0 : -1;
+        }
+    }
+    else
+    {
+        int node = threads->numa_node >= 0 && threads->numa_node < count ? threads->numa_node : -1;
+        ret = pool_create(pool, node) ? 0 : -1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (ret != 0)
+    {
+        inference_pool_stop(pool);
+    }
+    return ret;
+}
+
+InferenceService *inference_pool_get(InferencePool *pool, int numa_node)
+{
+    pthread_mutex_lock(&pool->lock);
+    int slot = pool_slot(numa_node);
+    InferenceService *service = pool->services[slot];
+    if (!service)
+    {
+        // 单路指定了全局以外的节点时才会走到这里, 为该节点再加载一份模型
+        service = pool_create(pool, slot ? numa_node : -1);
+        if (!service)
+        {
+            for (int i = 0; i <= NUMA_MAX_NODES && !service; i++)
+            {
+                service = pool->services[i];
+            }
+            if (service)
+            {
+                log_warn("Failed to start inference service on NUMA node %d, using %s", numa_node,
+                         service->threads.numa_node >= 0 ? "another node" : "the unbound service");
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return service;
+}
+
+void inference_pool_stop(InferencePool *pool)
+{
+    for (int i = 0; i <= NUMA_MAX_NODES; i++)
+    {
+        if (pool->services[i])
+        {
+            inference_service_stop(pool->services[i]);
+            free(pool->services[i]);
+            pool->services[i] = NULL;
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void inference_pool_dump_stats(InferencePool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i <= NUMA_MAX_NODES; i++)
+    {
+        if (pool->services[i])
+        {
+            inference_service_dump_stats(pool->services[i]);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
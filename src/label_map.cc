@@ -0,0 +1,464 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "label_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "coco_class.h"
+#include "logger.h"
+
+// 去掉首尾空白和成对的引号
+static std::string strip_name(const std::string &text)
+{
+    size_t begin = 0, end = text.size();
+    while (begin < end && isspace((unsigned char)text[begin]))
+    {
+        begin++;
+    }
+    while (end > begin && isspace((unsigned char)text[end - 1]))
+    {
+        end--;
+    }
+    if (end - begin >= 2 && (text[begin] == '\'' || text[begin] == '"') && text[end - 1] == text[begin])
+    {
+        begin++;
+        end--;
+    }
+    return text.substr(begin, end - begin);
+}
+
+// 查找引号外的字符
+static size_t find_unquoted(const std::string &text, char c)
+{
+    char quote = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (quote)
+        {
+            quote = text[i] == quote ? 0 : quote;
+        }
+        else if (text[i] == '\'' || text[i] == '"')
+        {
+            quote = text[i];
+        }
+        else if (text[i] == c)
+        {
+            return i;
+        }
+    }
+    return std::string::npos;
+}
+
+// 解析一项 "名称" 或 "ID: 名称", 放入 names
+static int add_name_entry(const std::string &entry, std::vector<std::string> &names)
+{
+    size_t colon = find_unquoted(entry, ':');
+    if (colon == std::string::npos)
+    {
+        names.push_back(strip_name(entry));
+        return 0;
+    }
+    std::string key = strip_name(entry.substr(0, colon));
+    char *end = NULL;
+    long id = strtol(key.c_str(), &end, 10);
+    if (key.empty() || *end != '\0' || id < 0 || id > 100000)
+    {
+        return -1;
+    }
+    if ((size_t)id >= names.size())
+    {
+        names.resize(id + 1);
+    }
+    names[id] = strip_name(entry.substr(colon + 1));
+    return 0;
+}
+
+// 解析行内写法: ['a', 'b'] 或 {0: 'a', 1: 'b'}
+static int parse_flow_names(const std::string &text, std::vector<std::string> &names)
+{
+    std::string body = strip_name(text);
+    if (body.size() < 2 || !((body[0] == '[' && body.back() == ']') || (body[0] == '{' && body.back() == '}')))
+    {
+        return -1;
+    }
+    body = body.substr(1, body.size() - 2);
+    while (!body.empty())
+    {
+        size_t comma = find_unquoted(body, ',');
+        std::string entry = body.substr(0, comma);
+        if (!strip_name(entry).empty() && add_name_entry(entry, names) != 0)
+        {
+            return -1;
+        }
+        if (comma == std::string::npos)
+        {
+            break;
+        }
+        body = body.substr(comma + 1);
+    }
+    return 0;
+}
+
+// 解析 YAML 中的 names 字段, 支持行内写法以及
+//   names:
+//     0: person        或      - person
+static int parse_yaml_names(FILE *file, std::vector<std::string> &names)
+{
+    char line[1024];
+    int in_names = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        std::string text(line);
+        size_t comment = find_unquoted(text, '#');
+        if (comment != std::string::npos)
+        {
+            text = text.substr(0, comment);
+        }
+        std::string trimmed = strip_name(text);
+        if (trimmed.empty())
+        {
+            continue;
+        }
+        if (!in_names)
+        {
+            if (trimmed.compare(0, 6, "names:") == 0 && !isspace((unsigned char)text[0]))
+            {
+                std::string rest = strip_name(trimmed.substr(6));
+                if (!rest.empty())
+                {
+                    return parse_flow_names(rest, names);
+                }
+                in_names = 1;
+            }
+            continue;
+        }
+        // 块写法在遇到下一个顶层键时结束
+        if (!isspace((unsigned char)text[0]) && text[0] != '-')
+        {
+            break;
+        }
+        if (trimmed[0] == '-')
+        {
+            names.push_back(strip_name(trimmed.substr(1)));
+        }
+        else if (add_name_entry(trimmed, names) != 0)
+        {
+            return -1;
+        }
+    }
+    return in_names ? 0 : -1;
+}
+
+// 每行一个名称(darknet .names / labels.txt)
+static int parse_plain_names(FILE *file, std::vector<std::string> &names)
+{
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        std::string name = strip_name(line);
+        if (!name.empty())
+        {
+            names.push_back(name);
+        }
+    }
+    return 0;
+}
+
+static int assign_names(LabelMap *map, const std::vector<std::string> &names, const char *source)
+{
+    if (names.empty())
+    {
+        return -1;
+    }
+    label_map_free(map);
+    map->names = (char (*)[MAX_LABEL_LENGTH])calloc(names.size(), MAX_LABEL_LENGTH);
+    if (!map->names)
+    {
+        return -1;
+    }
+    map->count = (int)names.size();
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (names[i].empty())
+        {
+            snprintf(map->names[i], MAX_LABEL_LENGTH, "class_%d", (int)i);
+        }
+        else
+        {
+            snprintf(map->names[i], MAX_LABEL_LENGTH, "%s", names[i].c_str());
+        }
+    }
+    snprintf(map->source, sizeof(map->source), "%s", source);
+    return 0;
+}
+
+int label_map_load_file(LabelMap *map, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return -1;
+    }
+    std::vector<std::string> names;
+    const char *ext = strrchr(path, '.');
+    int ret;
+    if (ext && (strcmp(ext, ".yaml") == 0 || strcmp(ext, ".yml") == 0))
+    {
+        ret = parse_yaml_names(file, names);
+    }
+    else
+    {
+        ret = parse_plain_names(file, names);
+    }
+    fclose(file);
+    if (ret != 0 || assign_names(map, names, path) != 0)
+    {
+        log_error("Failed to parse label file: %s", path);
+        return -1;
+    }
+    return 0;
+}
+
+// 读取 protobuf varint
+static int read_varint(const uint8_t **p, const uint8_t *end, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7)
+    {
+        uint8_t byte = *(*p)++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// 遍历一层 protobuf 消息, 对每个长度前缀字段调用 visit, 其余字段跳过
+template <typename Visitor>
+static int walk_message(const uint8_t *p, const uint8_t *end, Visitor visit)
+{
+    while (p < end)
+    {
+        uint64_t tag, value;
+        if (read_varint(&p, end, &tag) != 0)
+        {
+            return -1;
+        }
+        switch (tag & 7)
+        {
+        case 0:
+            if (read_varint(&p, end, &value) != 0)
+            {
+                return -1;
+            }
+            break;
+        case 1:
+            p += 8;
+            break;
+        case 2:
+            if (read_varint(&p, end, &value) != 0 || value > (uint64_t)(end - p))
+            {
+                return -1;
+            }
+            visit((int)(tag >> 3), p, (size_t)value);
+            p += value;
+            break;
+        case 5:
+            p += 4;
+            break;
+        default:
+            return -1;
+        }
+    }
+    return p == end ? 0 : -1;
+}
+
+// 从 ONNX ModelProto 的 metadata_props(字段 14, 元素为 key=1 / value=2)中读取 names;
+// 只解析最外层, 权重所在的 graph 字段直接跳过, 不需要 protobuf 依赖
+static int load_onnx_metadata(LabelMap *map, const char *model_path)
+{
+    int fd = open(model_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return -1;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+    const uint8_t *begin = (const uint8_t *)data;
+    std::string names_value;
+    walk_message(begin, begin + st.st_size, [&](int field, const uint8_t *p, size_t size)
+                 {
+                     if (field != 14)
+                     {
+                         return;
+                     }
+                     std::string key, value;
+                     walk_message(p, p + size, [&](int entry_field, const uint8_t *q, size_t len)
+                                  {
+                                      if (entry_field == 1)
+                                      {
+                                          key.assign((const char *)q, len);
+                                      }
+                                      else if (entry_field == 2)
+                                      {
+                                          value.assign((const char *)q, len);
+                                      }
+                                  });
+                     if (key == "names")
+                     {
+                         names_value = value;
+                     } });
+    munmap(data, st.st_size);
+    std::vector<std::string> names;
+    if (names_value.empty() || parse_flow_names(names_value, names) != 0)
+    {
+        return -1;
+    }
+    std::string source = std::string(model_path) + " (metadata)";
+    return assign_names(map, names, source.c_str());
+}
+
+static int load_coco(LabelMap *map)
+{
+    init_coco_names();
+    std::vector<std::string> names;
+    for (int i = 0; i < 80; i++)
+    {
+        names.push_back(get_coco_name(i));
+    }
+    return assign_names(map, names, "builtin coco");
+}
+
+int label_map_load(LabelMap *map, const char *labels_path, const char *model_path)
+{
+    memset(map, 0, sizeof(LabelMap));
+    if (labels_path && labels_path[0])
+    {
+        return label_map_load_file(map, labels_path);
+    }
+    // 模型旁边的标签文件; 同名 yaml 也可能是不含 names 的模型结构文件, 解析失败时继续尝试
+    std::string model(model_path);
+    size_t slash = model.find_last_of('/');
+    size_t dot = model.find_last_of('.');
+    std::string stem = (dot != std::string::npos && (slash == std::string::npos || dot > slash)) ? model.substr(0, dot) : model;
+    std::string dir = slash == std::string::npos ? "." : model.substr(0, slash);
+    // 不查找同名 .txt: 与 make clean 清理的输出文件冲突, 需要时用 labels 显式指定
+    const std::string candidates[] = {stem + ".names", stem + ".yaml", stem + ".yml", dir + "/data.yaml"};
+    for (const std::string &candidate : candidates)
+    {
+        if (access(candidate.c_str(), R_OK) == 0 && label_map_load_file(map, candidate.c_str()) == 0)
+        {
+            return 0;
+        }
+    }
+    if (load_onnx_metadata(map, model_path) == 0)
+    {
+        return 0;
+    }
+    return load_coco(map);
+}
+
+void label_map_free(LabelMap *map)
+{
+    free(map->names);
+    map->names = NULL;
+    map->count = 0;
+}
+
+const char *label_map_name(const LabelMap *map, int id)
+{
+    if (id < 0 || id >= map->count)
+    {
+        return "unknown";
+    }
+    return map->names[id];
+}
+
+int label_map_find(const LabelMap *map, const char *name)
+{
+    for (int i = 0; i < map->count; i++)
+    {
+        if (strcmp(map->names[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int label_map_parse_class_list(const LabelMap *map, const char *list, int num_classes, int *ids, int max_ids)
+{
+    int count = 0;
+    std::string rest(list);
+    while (!rest.empty())
+    {
+        size_t comma = rest.find(',');
+        // 类别名称中间允许空格(如 traffic light)
+        std::string token = strip_name(rest.substr(0, comma));
+        rest = comma == std::string::npos ? "" : rest.substr(comma + 1);
+        if (token.empty())
+        {
+            continue;
+        }
+        char *end = NULL;
+        long id = strtol(token.c_str(), &end, 10);
+        if (*end != '\0')
+        {
+            id = label_map_find(map, token.c_str());
+        }
+        if (id < 0 || count >= max_ids)
+        {
+            log_error("Unknown class: %s", token.c_str());
+            return -1;
+        }
+        if (id >= num_classes)
+        {
+            log_error("Class %s is out of range, the model outputs %d classes", token.c_str(), num_classes);
+            return -1;
+        }
+        ids[count++] = (int)id;
+    }
+    return count;
+}
+
+void label_map_dump(const LabelMap *map)
+{
+    log_info("Label map: %d classes from %s", map->count, map->source);
+    for (int i = 0; i < map->count; i++)
+    {
+        log_debug("  %d => %s", i, map->names[i]);
+    }
+}
@@ -0,0 +1,357 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "latency_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "logger.h"
+
+static TraceConfig trace_config;
+static int use_tsc;
+static double ticks_per_us = 1000.0; // CLOCK_MONOTONIC 时刻度为纳秒
+
+// 每个线程一份直方图, 只由所属线程写入; 汇总时按 relaxed 原子读取
+typedef struct ThreadTrace
+{
+    TraceHistogram spans[TRACE_SPAN_COUNT];
+    struct ThreadTrace *next;
+} ThreadTrace;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadTrace *registry;                     // 活动线程的直方图
+static TraceHistogram retired[TRACE_SPAN_COUNT]; // 已退出线程的直方图
+static pthread_key_t thread_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static __thread ThreadTrace *local_trace;
+
+static const char *span_names[TRACE_SPAN_COUNT] = {
+    "decode",
+    "queue.render",
+    "queue.push",
+    "queue.record",
+    "queue.detect",
+    "detect.preprocess",
+    "detect.infer",
+    "detect.postprocess",
+    "push.encode",
+    "push.mux",
+    "record.encode",
+    "record.mux",
+    "e2e.push",
+    "e2e.detect",
+};
+
+static uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 恒定速率且深度睡眠时不停止的 TSC 才能跨核心比较
+static int tsc_is_invariant()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    FILE *file = fopen("/proc/cpuinfo", "r");
+    if (!file)
+    {
+        return 0;
+    }
+    char line[4096];
+    int invariant = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "flags", 5) == 0)
+        {
+            invariant = strstr(line, " constant_tsc") && strstr(line, " nonstop_tsc");
+            break;
+        }
+    }
+    fclose(file);
+    return invariant;
+#else
+    return 0;
+#endif
+}
+
+// 微秒数所在的桶
+int trace_bucket_index(uint64_t us)
+{
+    if (us < 4)
+    {
+        return (int)us;
+    }
+    int octave = 63 - __builtin_clzll(us);
+    int sub = (int)(us >> (octave - 2)) & 3;
+    int bucket = 4 * (octave - 1) + sub;
+    return bucket < TRACE_BUCKETS ? bucket : TRACE_BUCKETS - 1;
+}
+
+// 桶的上界(微秒)
+double trace_bucket_upper_us(int bucket)
+{
+    if (bucket < 4)
+    {
+        return bucket + 1;
+    }
+    int octave = bucket / 4 + 1;
+    int sub = bucket % 4;
+    return (double)((uint64_t)(4 + sub + 1) << (octave - 2));
+}
+
+// 线程退出时把直方图并入 retired
+static void retire_thread_trace(void *arg)
+{
+    ThreadTrace *trace = (ThreadTrace *)arg;
+    pthread_mutex_lock(&registry_lock);
+    for (ThreadTrace **it = &registry; *it; it = &(*it)->next)
+    {
+        if (*it == trace)
+        {
+            *it = trace->next;
+            break;
+        }
+    }
+    for (int s = 0; s < TRACE_SPAN_COUNT; s++)
+    {
+        TraceHistogram *dst = &retired[s];
+        const TraceHistogram *src = &trace->spans[s];
+        for (int b = 0; b < TRACE_BUCKETS; b++)
+        {
+            dst->buckets[b] += src->buckets[b];
+        }
+        dst->count += src->count;
+        dst->sum_us += src->sum_us;
+        dst->max_us = src->max_us > dst->max_us ? src->max_us : dst->max_us;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    free(trace);
+}
+
+static void create_thread_key()
+{
+    pthread_key_create(&thread_key, retire_thread_trace);
+}
+
+// 当前线程的直方图, 首次使用时分配并登记
+static ThreadTrace *thread_trace()
+{
+    if (local_trace)
+    {
+        return local_trace;
+    }
+    ThreadTrace *trace = (ThreadTrace *)calloc(1, sizeof(ThreadTrace));
+    if (!trace)
+    {
+        return NULL;
+    }
+    pthread_once(&key_once, create_thread_key);
+    pthread_setspecific(thread_key, trace);
+    pthread_mutex_lock(&registry_lock);
+    trace->next = registry;
+    registry = trace;
+    pthread_mutex_unlock(&registry_lock);
+    local_trace = trace;
+    return trace;
+}
+
+void latency_trace_init(const TraceConfig *config)
+{
+    trace_config = *config;
+    use_tsc = 0;
+    ticks_per_us = 1000.0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (tsc_is_invariant())
+    {
+        // 对照 CLOCK_MONOTONIC 校准 20 毫秒
+        uint64_t ns0 = monotonic_ns();
+        uint64_t tsc0 = __rdtsc();
+        struct timespec wait = {0, 20 * 1000000};
+        nanosleep(&wait, NULL);
+        uint64_t ns1 = monotonic_ns();
+        uint64_t tsc1 = __rdtsc();
+        if (ns1 > ns0 && tsc1 > tsc0)
+        {
+            ticks_per_us = (double)(tsc1 - tsc0) * 1000.0 / (ns1 - ns0);
+            use_tsc = 1;
+        }
+    }
+#endif
+    if (config->enabled)
+    {
+        log_info("Latency trace enabled, clock=%s (%.1f ticks/us)", use_tsc ? "tsc" : "monotonic", ticks_per_us);
+    }
+}
+
+int latency_trace_enabled()
+{
+    return trace_config.enabled;
+}
+
+uint64_t trace_now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (use_tsc)
+    {
+        return __rdtsc();
+    }
+#endif
+    return monotonic_ns();
+}
+
+double trace_ticks_to_us(uint64_t ticks)
+{
+    return ticks / ticks_per_us;
+}
+
+void trace_stamp(FrameTrace *trace, TracePoint point)
+{
+    if (trace && trace_config.enabled)
+    {
+        trace->stamps[point] = trace_now();
+    }
+}
+
+void trace_record(TraceSpan span, const FrameTrace *trace, TracePoint from, TracePoint to)
+{
+    if (!trace || !trace_config.enabled || !trace->stamps[from] || trace->stamps[to] < trace->stamps[from])
+    {
+        return;
+    }
+    ThreadTrace *local = thread_trace();
+    if (!local)
+    {
+        return;
+    }
+    uint64_t us = (uint64_t)trace_ticks_to_us(trace->stamps[to] - trace->stamps[from]);
+    int bucket = trace_bucket_index(us);
+    // 只有本线程写入, relaxed 存储保证汇总线程读到完整的值
+    TraceHistogram *h = &local->spans[span];
+    __atomic_store_n(&h->buckets[bucket], h->buckets[bucket] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum_us, h->sum_us + us, __ATOMIC_RELAXED);
+    if (us > h->max_us)
+    {
+        __atomic_store_n(&h->max_us, us, __ATOMIC_RELAXED);
+    }
+}
+
+// 区间耗时(毫秒), 时间点缺失时返回 -1
+static double span_ms(const FrameTrace *trace, TracePoint from, TracePoint to)
+{
+    if (!trace->stamps[from] || trace->stamps[to] < trace->stamps[from])
+    {
+        return -1;
+    }
+    return trace_ticks_to_us(trace->stamps[to] - trace->stamps[from]) / 1000.0;
+}
+
+void trace_report_slow(const char *stream, const FrameTrace *trace, TracePoint end)
+{
+    if (!trace || !trace_config.enabled || trace_config.slow_frame_ms <= 0)
+    {
+        return;
+    }
+    double total = span_ms(trace, TRACE_DEMUX, end);
+    if (total < trace_config.slow_frame_ms)
+    {
+        return;
+    }
+    log_warn("Slow frame %s#%llu: total=%.1fms, decode=%.1fms, queue=%.1fms, process=%.1fms", stream,
+             (unsigned long long)trace->seq, total, span_ms(trace, TRACE_DEMUX, TRACE_DECODE),
+             span_ms(trace, TRACE_ENQUEUE, TRACE_DEQUEUE), span_ms(trace, TRACE_DEQUEUE, end));
+}
+
+void latency_trace_snapshot(TraceHistogram *out)
+{
+    pthread_mutex_lock(&registry_lock);
+    memcpy(out, retired, sizeof(retired));
+    for (ThreadTrace *trace = registry; trace; trace = trace->next)
+    {
+        for (int s = 0; s < TRACE_SPAN_COUNT; s++)
+        {
+            const TraceHistogram *src = &trace->spans[s];
+            for (int b = 0; b < TRACE_BUCKETS; b++)
+            {
+                out[s].buckets[b] += __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+            }
+            out[s].count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+            out[s].sum_us += __atomic_load_n(&src->sum_us, __ATOMIC_RELAXED);
+            uint64_t max_us = __atomic_load_n(&src->max_us, __ATOMIC_RELAXED);
+            out[s].max_us = max_us > out[s].max_us ? max_us : out[s].max_us;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+double trace_histogram_quantile(const TraceHistogram *histogram, double quantile)
+{
+    uint64_t total = 0;
+    for (int b = 0; b < TRACE_BUCKETS; b++)
+    {
+        total += histogram->buckets[b];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(quantile * total);
+    uint64_t seen = 0;
+    for (int b = 0; b < TRACE_BUCKETS; b++)
+    {
+        seen += histogram->buckets[b];
+        if (seen > rank)
+        {
+            double upper = trace_bucket_upper_us(b);
+            return upper < histogram->max_us ? upper : (double)histogram->max_us;
+        }
+    }
+    return (double)histogram->max_us;
+}
+
+const char *trace_span_name(TraceSpan span)
+{
+    return span >= 0 && span < TRACE_SPAN_COUNT ? span_names[span] : "unknown";
+}
+
+void latency_trace_dump()
+{
+    if (!trace_config.enabled)
+    {
+        return;
+    }
+    TraceHistogram spans[TRACE_SPAN_COUNT];
+    latency_trace_snapshot(spans);
+    log_info("Latency trace (ms):");
+    for (int s = 0; s < TRACE_SPAN_COUNT; s++)
+    {
+        const TraceHistogram *h = &spans[s];
+        if (h->count == 0)
+        {
+            continue;
+        }
+        log_info("  %-18s n=%llu, avg=%.2f, p50=%.2f, p90=%.2f, p99=%.2f, max=%.2f", span_names[s],
+                 (unsigned long long)h->count, h->sum_us / 1000.0 / h->count,
+                 trace_histogram_quantile(h, 0.5) / 1000.0, trace_histogram_quantile(h, 0.9) / 1000.0,
+                 trace_histogram_quantile(h, 0.99) / 1000.0, h->max_us / 1000.0);
+    }
+}
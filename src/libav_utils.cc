@@ -16,8 +16,24 @@
 #include "frame_queue.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+extern "C"
+{
 #include <libavutil/imgutils.h>
+#include <libavdevice/avdevice.h>
+}
 #include "logger.h"
+
+#define LAVFI_PREFIX "lavfi:"
+#define NULL_OUTPUT "null"
+
+static pthread_once_t device_once = PTHREAD_ONCE_INIT;
+
+static void register_devices()
+{
+    avdevice_register_all();
+}
 // 保存AVFrame图像到文件，格式为png
 const char *get_av_error(int errnum)
 {
@@ -26,18 +42,37 @@ const char *get_av_error(int errnum)
     return str;
 }
 
-// 简单的线性插值
-Box InterpolateBox(Box prevBox, Box currentBox, float t)
+int context_interrupt_callback(void *opaque)
+{
+    Context *ctx = (Context *)opaque;
+    return ctx->is_cancelled;
+}
+
+int open_input_stream(AVFormatContext **fmt_ctx, const char *url)
 {
-    Box result;
-    result.x = (1 - t) * prevBox.x + t * currentBox.x;
-    result.y = (1 - t) * prevBox.y + t * currentBox.y;
-    result.w = (1 - t) * prevBox.w + t * currentBox.w;
-    result.h = (1 - t) * prevBox.h + t * currentBox.h;
-    result.prop = (1 - t) * prevBox.prop + t * currentBox.prop;
-    strcpy(result.label, currentBox.label);
-    return result;
+    size_t prefix_len = strlen(LAVFI_PREFIX);
+    if (strncmp(url, LAVFI_PREFIX, prefix_len) != 0)
+    {
+        return avformat_open_input(fmt_ctx, url, NULL, NULL);
+    }
+    // lavfi 属于 libavdevice, 注册后才能按名称找到
+    pthread_once(&device_once, register_devices);
+    const AVInputFormat *lavfi = av_find_input_format("lavfi");
+    if (!lavfi)
+    {
+        log_error("FFmpeg is built without the lavfi input device");
+        avformat_free_context(*fmt_ctx);
+        *fmt_ctx = NULL;
+        return AVERROR_DEMUXER_NOT_FOUND;
+    }
+    return avformat_open_input(fmt_ctx, url + prefix_len, (AVInputFormat *)lavfi, NULL);
 }
+
+const char *output_format_name(const char *url)
+{
+    return strcmp(url, NULL_OUTPUT) == 0 ? "null" : "flv";
+}
+
 //
 void copy_codec_context_properties(AVCodecContext *src_ctx, AVCodecContext *dst_ctx)
 {
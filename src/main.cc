@@ -19,37 +19,66 @@
 #include <pthread.h>
 #include "pull_stream_handler_thread.h"
 #include "frame_queue.h"
+#ifndef HEADLESS
 #include "video_renderer.h"
+#endif
 #include "detection_thread.h"
 #include <signal.h>
 #include <unistd.h>
+#include <time.h>
 #include "background.h"
 #include "context.h"
 #include "push_stream_thread.h"
 #include "warning_timer.h"
 #include <curl/curl.h>
 #include "logger.h"
-// 全局上下文指针数组
-Context *contexts[4];
+#include "config.h"
+#include "rate_controller.h"
+#include "thread_utils.h"
+#include "pipeline.h"
+#include "inference_service.h"
+#include "control_server.h"
+#include "metrics_server.h"
+#include "latency_trace.h"
+// 后台任务和渲染线程的上下文
+static Context *background_ctx;
+static Context *render_ctx;
+// 各路流水线
+static PipelineManager manager;
 
-// 信号处理函数
-void handle_signal(int sig)
+// 等待 SIGINT / SIGTERM 或渲染窗口被关闭, 期间按间隔打印延迟直方图; render_thread 为 NULL 时没有渲染窗口
+static void wait_for_shutdown(const sigset_t *signals, const pthread_t *render_thread, int *render_joined,
+                              int report_interval_s)
 {
-    for (int i = 0; i < 4; i++)
+    struct timespec timeout = {0, 500 * 1000000};
+    time_t last_report = time(NULL);
+    while (1)
     {
-        if (contexts[i])
+        if (report_interval_s > 0 && time(NULL) - last_report >= report_interval_s)
         {
-            CancelContext(contexts[i]);
+            latency_trace_dump();
+            last_report = time(NULL);
+        }
+        int sig = sigtimedwait(signals, NULL, &timeout);
+        if (sig > 0)
+        {
+            log_info("Received signal %d, shutting down...", sig);
+            return;
+        }
+        if (render_thread && pthread_tryjoin_np(*render_thread, NULL) == 0)
+        {
+            log_info("Renderer closed, shutting down...");
+            *render_joined = 1;
+            return;
         }
     }
-    log_info("Received signal %d, exiting...", sig);
-    exit(0);
 }
 
-// 创建线程的辅助函数
-int create_thread(pthread_t *thread, void *(*start_routine)(void *), void *arg)
+// 创建线程的辅助函数, 按阶段设置 CPU 亲和性和调度策略
+int create_thread(pthread_t *thread, PipelineStage stage, const ThreadConfig *config,
+                  void *(*start_routine)(void *), void *arg)
 {
-    int ret = pthread_create(thread, NULL, start_routine, arg);
+    int ret = create_stage_thread(thread, stage, config, start_routine, arg);
     if (ret != 0)
     {
         log_error( "Failed to create thread");
@@ -58,49 +87,75 @@ int create_thread(pthread_t *thread, void *(*start_routine)(void *), void *arg)
     return 0;
 }
 
-// 销毁上下文的辅助函数
-void destroy_contexts()
+// 加载配置: 单个参数为多路配置文件, 否则为 <拉流地址> <推流地址> [配置文件]
+static int load_process_config(int argc, char *argv[], ProcessConfig *process)
 {
-    for (int i = 0; i < 4; i++)
+    config_set_defaults(&process->defaults);
+    process->streams = NULL;
+    process->stream_count = 0;
+    if (argc == 2)
     {
-        if (contexts[i])
+        if (config_load_process_file(argv[1], process) != 0)
         {
-            CancelContext(contexts[i]);
-            if (i > 0)
-            {
-                pthread_mutex_destroy(&contexts[i]->mtx);
-            }
-            else
-            {
-                pthread_cond_destroy(&contexts[i]->cond);
-            }
+            log_info("Failed to load config file %s", argv[1]);
+            return -1;
         }
+        if (process->stream_count == 0)
+        {
+            log_info("No stream configured in %s", argv[1]);
+            return -1;
+        }
+        return 0;
     }
-}
-
-// 销毁帧队列的辅助函数
-void destroy_frame_queues(FrameQueue *queues, int num_queues)
-{
-    for (int i = 0; i < num_queues; i++)
+    if (argc > 3 && config_load_file(argv[3], &process->defaults) != 0)
+    {
+        log_info("Failed to load config file %s", argv[3]);
+        return -1;
+    }
+    StreamConfig *stream = config_add_stream(process, "default");
+    if (!stream)
     {
-        frame_queue_destroy(&queues[i]);
+        return -1;
     }
+    snprintf(stream->input_url, sizeof(stream->input_url), "%s", argv[1]);
+    snprintf(stream->output_url, sizeof(stream->output_url), "%s", argv[2]);
+    return 0;
 }
 
 int main(int argc, char *argv[])
 {
     set_log_level(LOG_DEBUG);
     // 检查命令行参数数量
-    if (argc < 3)
+    if (argc < 2)
+    {
+        log_info("Usage: %s <camera_URL> <PUSH_URL> [config.ini]", argv[0]);
+        log_info("       %s <streams.ini>", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // 加载配置
+    ProcessConfig process;
+    if (load_process_config(argc, argv, &process) != 0)
     {
-        log_info("Usage: %s <camera_URL> <PUSH_URL>", argv[0]);
+        config_free_process(&process);
         return EXIT_FAILURE;
     }
+    for (int i = 0; i < process.stream_count; i++)
+    {
+        dump_stream_config(&process.streams[i]);
+    }
+    rate_controller_init(&process.defaults.rate);
+    latency_trace_init(&process.defaults.trace);
 
-    // 设置信号处理函数
-    if (signal(SIGINT, handle_signal) == SIG_ERR)
+    // 由主线程同步等待退出信号; 在创建任何线程之前屏蔽, 所有线程继承该屏蔽字
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &signals, NULL) != 0)
     {
-        log_error( "Failed to set signal handler for SIGINT");
+        log_error( "Failed to block SIGINT and SIGTERM");
+        config_free_process(&process);
         return EXIT_FAILURE;
     }
 
@@ -108,6 +163,7 @@ int main(int argc, char *argv[])
     if (warning_timer_init(10000, 10, event_triggered) != 0)
     {
         log_info("Failed to initialize warning timer");
+        config_free_process(&process);
         return EXIT_FAILURE;
     }
 
@@ -116,70 +172,127 @@ int main(int argc, char *argv[])
     {
         log_info("Failed to initialize cURL library");
         warning_timer_stop();
+        config_free_process(&process);
         return EXIT_FAILURE;
     }
 
-    const char *pull_from_camera_url = argv[1];
-    const char *push_to_camera_url = argv[2];
-
-    // 创建上下文
-    for (int i = 0; i < 4; i++)
+    // 每个用到的 NUMA 节点一份模型和一个推理线程, 同一节点各路的请求在推理线程中合批
+    InferencePool inference;
+    if (inference_pool_init(&inference, &process.defaults.detector, &process.defaults.threads) != 0)
     {
-        contexts[i] = CreateContext();
-        if (!contexts[i])
-        {
-            log_info("Failed to create context %d", i);
-            destroy_contexts();
-            curl_global_cleanup();
-            warning_timer_stop();
-            return EXIT_FAILURE;
-        }
+        curl_global_cleanup();
+        warning_timer_stop();
+        config_free_process(&process);
+        return EXIT_FAILURE;
     }
 
-    // 初始化帧队列
-    const int num_queues = 6;
-    FrameQueue queues[num_queues];
-    for (int i = 0; i < num_queues; i++)
+    // 无显示模式下没有渲染线程和渲染队列, 拉流线程也不为显示复制帧
+    int display = process.defaults.display.enabled;
+#ifdef HEADLESS
+    if (display)
     {
-        frame_queue_init(&queues[i], 60);
+        log_warn("Built with HEADLESS, [display] enabled is ignored");
+        display = 0;
     }
-
-    // 创建线程参数
-    ThreadArgs background_thread_args = {.ctx = contexts[0]};
-    ThreadArgs common_args = {pull_from_camera_url, push_to_camera_url, &queues[0], &queues[1], &queues[2],
-                              &queues[3], &queues[4], &queues[5], NULL, contexts[1]};
-
-    // 创建线程
-    pthread_t threads[4];
-    if (create_thread(&threads[0], background_task_thread, &background_thread_args) != 0 ||
-        create_thread(&threads[1], pull_stream_handler_thread, &common_args) != 0 ||
-        create_thread(&threads[2], video_renderer_thread, &common_args) != 0 ||
-        create_thread(&threads[3], frame_detection_thread, &common_args) != 0)
-    {
-        destroy_contexts();
-        destroy_frame_queues(queues, num_queues);
+#endif
+    // 渲染队列由渲染线程所有, 显示中的视频流停止或重启时渲染窗口不受影响
+    FrameQueue display_queues[2];
+    for (int i = 0; display && i < 2; i++)
+    {
+        frame_queue_init(&display_queues[i], PIPELINE_QUEUE_SIZE);
+    }
+    // 管理器的监管线程在阶段退出或停滞时单独重启该阶段
+    if (pipeline_manager_init(&manager, &inference, display ? &display_queues[0] : NULL,
+                              display ? &display_queues[1] : NULL, &process.defaults.threads) != 0)
+    {
+        inference_pool_stop(&inference);
         curl_global_cleanup();
         warning_timer_stop();
+        config_free_process(&process);
+        return EXIT_FAILURE;
+    }
+    background_ctx = CreateContext();
+    render_ctx = display ? CreateContext() : NULL;
+    int ok = background_ctx && (!display || render_ctx);
+    for (int i = 0; ok && i < process.stream_count; i++)
+    {
+        ok = pipeline_manager_add(&manager, &process.streams[i], 1) == 0;
+    }
+    // 控制接口: 运行时启停、增删和重新配置单路流水线
+    ControlServer control;
+    control.listen_fd = -1;
+    if (ok && process.defaults.control.socket_path[0])
+    {
+        ok = control_server_start(&control, process.defaults.control.socket_path, argc == 2 ? argv[1] : NULL,
+                                  &process.defaults, &manager) == 0;
+    }
+    // 指标接口: Prometheus 抓取各路队列、帧数、延迟和重启次数
+    MetricsServer metrics;
+    metrics.listen_fd = -1;
+    if (ok && process.defaults.metrics.listen[0])
+    {
+        ok = metrics_server_start(&metrics, process.defaults.metrics.listen) == 0;
+    }
+    ThreadArgs background_thread_args = {.ctx = background_ctx};
+    pthread_t threads[2];
+    ok = ok && create_thread(&threads[0], STAGE_BACKGROUND, &process.defaults.threads, background_task_thread,
+                             &background_thread_args) == 0;
+#ifndef HEADLESS
+    ThreadArgs render_thread_args = {.video_queue = &display_queues[0], .box_queue = &display_queues[1], .ctx = render_ctx};
+    if (ok && display &&
+        create_thread(&threads[1], STAGE_RENDER, &process.defaults.threads, video_renderer_thread, &render_thread_args) != 0)
+    {
+        CancelContext(background_ctx);
+        pthread_join(threads[0], NULL);
+        ok = 0;
+    }
+#endif
+    if (!ok)
+    {
+        metrics_server_stop(&metrics);
+        control_server_stop(&control);
+        pipeline_manager_destroy(&manager);
+        inference_pool_stop(&inference);
+        curl_global_cleanup();
+        warning_timer_stop();
+        config_free_process(&process);
         return EXIT_FAILURE;
     }
 
-    log_info("Main thread waiting for threads to finish...");
+    log_info("Main thread waiting for shutdown...");
+    int render_joined = 0;
+    wait_for_shutdown(&signals, display ? &threads[1] : NULL, &render_joined, process.defaults.trace.report_interval_s);
 
-    // 等待所有线程结束
-    for (int i = 0; i < 4; i++)
+    // 按数据流顺序退出: 先停止接收控制命令和指标抓取, 再停止拉流并排空各路队列、冲刷编码器、写入文件尾
+    metrics_server_stop(&metrics);
+    control_server_stop(&control);
+    pipeline_manager_destroy(&manager);
+    // 流水线已全部退出, 再关闭渲染窗口
+    if (display)
     {
-        if (pthread_join(threads[i], NULL) != 0)
+        CancelContext(render_ctx);
+        frame_queue_close(&display_queues[0]);
+        if (!render_joined && pthread_join(threads[1], NULL) != 0)
         {
             log_error( "Failed to join thread");
         }
     }
-
-    // 清理资源
-    destroy_contexts();
-    destroy_frame_queues(queues, num_queues);
+    CancelContext(background_ctx);
+    if (pthread_join(threads[0], NULL) != 0)
+    {
+        log_error( "Failed to join thread");
+    }
+    for (int i = 0; display && i < 2; i++)
+    {
+        frame_queue_destroy(&display_queues[i]);
+    }
+    inference_pool_dump_stats(&inference);
+    latency_trace_dump();
+    inference_pool_stop(&inference);
     curl_global_cleanup();
     // 清理计时器
     warning_timer_stop();
+    config_free_process(&process);
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,410 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include "logger.h"
+
+// 直方图输出的桶边界: 2^7 ~ 2^25 微秒(约 0.13ms ~ 33s), 正好落在内部桶的边界上
+#define HISTOGRAM_FIRST_OCTAVE 7
+#define HISTOGRAM_LAST_OCTAVE 25
+
+#define MAX_COLLECTORS 16
+
+typedef struct
+{
+    MetricsCollector collect;
+    void *arg;
+} CollectorEntry;
+
+// 注册表和采集函数各用一把锁: 采集函数可能要拿流水线管理器的锁,
+// 而持有管理器锁的线程会注册指标, 共用一把锁会死锁
+static Metric *registry = NULL;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static CollectorEntry collectors[MAX_COLLECTORS];
+static int collector_count = 0;
+static pthread_mutex_t collector_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *type_name(MetricType type)
+{
+    switch (type)
+    {
+    case METRIC_COUNTER:
+        return "counter";
+    case METRIC_GAUGE:
+        return "gauge";
+    default:
+        return "histogram";
+    }
+}
+
+static Metric *metrics_register(MetricType type, const char *name, const char *help, const char *labels)
+{
+    if (!labels)
+    {
+        labels = "";
+    }
+    pthread_mutex_lock(&registry_lock);
+    Metric **tail = &registry;
+    for (Metric *it = registry; it; it = it->next)
+    {
+        if (strcmp(it->name, name) == 0 && strcmp(it->labels, labels) == 0)
+        {
+            pthread_mutex_unlock(&registry_lock);
+            if (it->type != type)
+            {
+                log_error("Metric %s{%s} is already registered as a %s", name, labels, type_name(it->type));
+                return NULL;
+            }
+            return it;
+        }
+        tail = &it->next;
+    }
+    Metric *metric = (Metric *)calloc(1, sizeof(Metric));
+    if (metric)
+    {
+        snprintf(metric->name, sizeof(metric->name), "%s", name);
+        snprintf(metric->labels, sizeof(metric->labels), "%s", labels);
+        metric->help = help;
+        metric->type = type;
+        *tail = metric;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return metric;
+}
+
+Metric *metrics_counter(const char *name, const char *help, const char *labels)
+{
+    return metrics_register(METRIC_COUNTER, name, help, labels);
+}
+
+Metric *metrics_gauge(const char *name, const char *help, const char *labels)
+{
+    return metrics_register(METRIC_GAUGE, name, help, labels);
+}
+
+Metric *metrics_histogram(const char *name, const char *help, const char *labels)
+{
+    return metrics_register(METRIC_HISTOGRAM, name, help, labels);
+}
+
+Metric *metrics_find(const char *name, const char *labels)
+{
+    if (!labels)
+    {
+        labels = "";
+    }
+    Metric *found = NULL;
+    pthread_mutex_lock(&registry_lock);
+    for (Metric *it = registry; it && !found; it = it->next)
+    {
+        if (strcmp(it->name, name) == 0 && strcmp(it->labels, labels) == 0)
+        {
+            found = it;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return found;
+}
+
+// labels 中是否含有完整的 label: 前后须是标签的边界, stream="cam1" 不匹配 stream="cam10"
+static int labels_contain(const char *labels, const char *label, size_t len)
+{
+    for (const char *p = strstr(labels, label); p; p = strstr(p + 1, label))
+    {
+        if ((p == labels || p[-1] == ',') && (p[len] == '\0' || p[len] == ','))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int metrics_unregister_label(const char *label)
+{
+    size_t len = strlen(label);
+    int removed = 0;
+    if (len == 0)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&registry_lock);
+    Metric **link = &registry;
+    while (*link)
+    {
+        Metric *it = *link;
+        if (labels_contain(it->labels, label, len))
+        {
+            *link = it->next;
+            free(it);
+            removed++;
+        }
+        else
+        {
+            link = &it->next;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return removed;
+}
+
+int64_t metric_value(const Metric *metric)
+{
+    return metric ? __atomic_load_n(&metric->value, __ATOMIC_RELAXED) : 0;
+}
+
+void metric_add(Metric *metric, int64_t n)
+{
+    if (metric)
+    {
+        __atomic_fetch_add(&metric->value, n, __ATOMIC_RELAXED);
+    }
+}
+
+void metric_set(Metric *metric, int64_t value)
+{
+    if (metric)
+    {
+        __atomic_store_n(&metric->value, value, __ATOMIC_RELAXED);
+    }
+}
+
+void metric_observe_us(Metric *metric, uint64_t us)
+{
+    if (!metric)
+    {
+        return;
+    }
+    TraceHistogram *histogram = &metric->histogram;
+    __atomic_fetch_add(&histogram->buckets[trace_bucket_index(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum_us, us, __ATOMIC_RELAXED);
+}
+
+void metrics_register_collector(MetricsCollector collect, void *arg)
+{
+    pthread_mutex_lock(&collector_lock);
+    if (collector_count < MAX_COLLECTORS)
+    {
+        collectors[collector_count].collect = collect;
+        collectors[collector_count].arg = arg;
+        collector_count++;
+    }
+    else
+    {
+        log_error("Too many metrics collectors");
+    }
+    pthread_mutex_unlock(&collector_lock);
+}
+
+void metrics_unregister_collector(MetricsCollector collect, void *arg)
+{
+    // 抓取期间持有 collector_lock, 拿到锁即说明没有正在执行的采集
+    pthread_mutex_lock(&collector_lock);
+    for (int i = 0; i < collector_count; i++)
+    {
+        if (collectors[i].collect == collect && collectors[i].arg == arg)
+        {
+            collectors[i] = collectors[collector_count - 1];
+            collector_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&collector_lock);
+}
+
+// 追加格式化文本, 内存不足时丢弃已有内容并标记失败
+static void buffer_printf(MetricsBuffer *out, const char *fmt, ...)
+{
+    while (!out->failed)
+    {
+        size_t available = out->capacity - out->size;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(out->data ? out->data + out->size : NULL, out->data ? available : 0, fmt, args);
+        va_end(args);
+        if (n < 0)
+        {
+            return;
+        }
+        if (out->data && (size_t)n < available)
+        {
+            out->size += (size_t)n;
+            return;
+        }
+        size_t capacity = out->capacity ? out->capacity * 2 : 16384;
+        while (capacity < out->size + (size_t)n + 1)
+        {
+            capacity *= 2;
+        }
+        char *data = (char *)realloc(out->data, capacity);
+        if (!data)
+        {
+            free(out->data);
+            out->data = NULL;
+            out->size = out->capacity = 0;
+            out->failed = 1;
+            return;
+        }
+        out->data = data;
+        out->capacity = capacity;
+    }
+}
+
+void metrics_write_header(MetricsBuffer *out, const char *name, const char *help, MetricType type)
+{
+    buffer_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help ? help : "", name, type_name(type));
+}
+
+void metrics_write_sample(MetricsBuffer *out, const char *name, const char *labels, double value)
+{
+    if (labels && labels[0])
+    {
+        buffer_printf(out, "%s{%s} %.17g\n", name, labels, value);
+    }
+    else
+    {
+        buffer_printf(out, "%s %.17g\n", name, value);
+    }
+}
+
+void metrics_write_histogram(MetricsBuffer *out, const char *name, const char *labels,
+                             const TraceHistogram *histogram)
+{
+    const char *sep = labels && labels[0] ? "," : "";
+    labels = labels ? labels : "";
+    // 按桶累加得到总数, 与并发更新的 count 字段可能差几个样本, 这样各行保持单调
+    uint64_t cumulative = 0;
+    int bucket = 0;
+    for (int octave = HISTOGRAM_FIRST_OCTAVE; octave <= HISTOGRAM_LAST_OCTAVE; octave++)
+    {
+        int end = 4 * (octave - 1);
+        for (; bucket < end && bucket < TRACE_BUCKETS; bucket++)
+        {
+            cumulative += __atomic_load_n(&histogram->buckets[bucket], __ATOMIC_RELAXED);
+        }
+        buffer_printf(out, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", name, labels, sep,
+                      (double)(1ULL << octave) / 1e6, (unsigned long long)cumulative);
+    }
+    for (; bucket < TRACE_BUCKETS; bucket++)
+    {
+        cumulative += __atomic_load_n(&histogram->buckets[bucket], __ATOMIC_RELAXED);
+    }
+    buffer_printf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, (unsigned long long)cumulative);
+    uint64_t sum_us = __atomic_load_n(&histogram->sum_us, __ATOMIC_RELAXED);
+    if (labels[0])
+    {
+        buffer_printf(out, "%s_sum{%s} %.6f\n%s_count{%s} %llu\n", name, labels, sum_us / 1e6,
+                      name, labels, (unsigned long long)cumulative);
+    }
+    else
+    {
+        buffer_printf(out, "%s_sum %.6f\n%s_count %llu\n", name, sum_us / 1e6, name, (unsigned long long)cumulative);
+    }
+}
+
+// 输出注册表, 同名指标归为一族连续输出
+static void render_registry(MetricsBuffer *out)
+{
+    pthread_mutex_lock(&registry_lock);
+    for (Metric *first = registry; first; first = first->next)
+    {
+        int seen = 0;
+        for (Metric *it = registry; it != first; it = it->next)
+        {
+            if (strcmp(it->name, first->name) == 0)
+            {
+                seen = 1;
+                break;
+            }
+        }
+        if (seen)
+        {
+            continue;
+        }
+        metrics_write_header(out, first->name, first->help, first->type);
+        for (Metric *it = first; it; it = it->next)
+        {
+            if (strcmp(it->name, first->name) != 0)
+            {
+                continue;
+            }
+            if (it->type == METRIC_HISTOGRAM)
+            {
+                metrics_write_histogram(out, it->name, it->labels, &it->histogram);
+            }
+            else
+            {
+                metrics_write_sample(out, it->name, it->labels,
+                                     (double)__atomic_load_n(&it->value, __ATOMIC_RELAXED));
+            }
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+// 延迟跟踪的各区间, 由各线程的直方图汇总而来
+static void render_trace_spans(MetricsBuffer *out)
+{
+    if (!latency_trace_enabled())
+    {
+        return;
+    }
+    TraceHistogram *spans = (TraceHistogram *)malloc(sizeof(TraceHistogram) * TRACE_SPAN_COUNT);
+    if (!spans)
+    {
+        return;
+    }
+    latency_trace_snapshot(spans);
+    const char *name = "pipeline_span_latency_seconds";
+    metrics_write_header(out, name, "Per-frame latency between two trace points of the pipeline", METRIC_HISTOGRAM);
+    for (int i = 0; i < TRACE_SPAN_COUNT; i++)
+    {
+        char labels[64];
+        snprintf(labels, sizeof(labels), "span=\"%s\"", trace_span_name((TraceSpan)i));
+        metrics_write_histogram(out, name, labels, &spans[i]);
+    }
+    free(spans);
+}
+
+int metrics_render(MetricsBuffer *out)
+{
+    memset(out, 0, sizeof(MetricsBuffer));
+    render_registry(out);
+    pthread_mutex_lock(&collector_lock);
+    for (int i = 0; i < collector_count; i++)
+    {
+        collectors[i].collect(out, collectors[i].arg);
+    }
+    pthread_mutex_unlock(&collector_lock);
+    render_trace_spans(out);
+    if (out->failed)
+    {
+        metrics_buffer_free(out);
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_buffer_free(MetricsBuffer *out)
+{
+    free(out->data);
+    memset(out, 0, sizeof(MetricsBuffer));
+}
@@ -0,0 +1,242 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "metrics_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "metrics.h"
+#include "logger.h"
+
+// 检查停止标志的间隔(毫秒)
+#define METRICS_POLL_MS 500
+// 等待请求头的最长时间(毫秒), 避免慢连接占住唯一的服务线程
+#define METRICS_REQUEST_TIMEOUT_MS 2000
+// 请求头的最大长度
+#define METRICS_REQUEST_SIZE 4096
+
+// 发送完整的数据
+static void send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+static void send_response(int fd, const char *status, const char *content_type, const char *body, size_t len)
+{
+    char header[256];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, content_type, len);
+    send_all(fd, header, (size_t)n);
+    send_all(fd, body, len);
+}
+
+// 读取请求头, 返回 0 成功
+static int read_request(int fd, char *buffer, size_t size)
+{
+    size_t used = 0;
+    while (used < size - 1)
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, METRICS_REQUEST_TIMEOUT_MS) <= 0)
+        {
+            return -1;
+        }
+        ssize_t n = recv(fd, buffer + used, size - 1 - used, 0);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        used += (size_t)n;
+        buffer[used] = '\0';
+        if (strstr(buffer, "\r\n\r\n") || strstr(buffer, "\n\n"))
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void serve_client(int fd)
+{
+    char request[METRICS_REQUEST_SIZE];
+    if (read_request(fd, request, sizeof(request)) != 0)
+    {
+        return;
+    }
+    char method[8] = "";
+    char path[256] = "";
+    if (sscanf(request, "%7s %255s", method, path) != 2)
+    {
+        const char *body = "bad request\n";
+        send_response(fd, "400 Bad Request", "text/plain", body, strlen(body));
+        return;
+    }
+    // 忽略查询参数
+    char *query = strchr(path, '?');
+    if (query)
+    {
+        *query = '\0';
+    }
+    if (strcmp(method, "GET") != 0)
+    {
+        const char *body = "method not allowed\n";
+        send_response(fd, "405 Method Not Allowed", "text/plain", body, strlen(body));
+        return;
+    }
+    if (strcmp(path, "/metrics") != 0)
+    {
+        const char *body = "not found, try /metrics\n";
+        send_response(fd, "404 Not Found", "text/plain", body, strlen(body));
+        return;
+    }
+    MetricsBuffer out;
+    if (metrics_render(&out) != 0)
+    {
+        const char *body = "out of memory\n";
+        send_response(fd, "500 Internal Server Error", "text/plain", body, strlen(body));
+        return;
+    }
+    send_response(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", out.data ? out.data : "", out.size);
+    metrics_buffer_free(&out);
+}
+
+static void *metrics_server_thread(void *arg)
+{
+    MetricsServer *server = (MetricsServer *)arg;
+    while (server->running)
+    {
+        struct pollfd pfd = {server->listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0)
+        {
+            continue;
+        }
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            continue;
+        }
+        serve_client(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+// 按 host:port 或 port 创建监听套接字
+static int open_listener(const char *listen_addr)
+{
+    char host[64] = "";
+    const char *port = listen_addr;
+    const char *colon = strrchr(listen_addr, ':');
+    if (colon)
+    {
+        size_t len = (size_t)(colon - listen_addr) < sizeof(host) ? (size_t)(colon - listen_addr) : sizeof(host) - 1;
+        memcpy(host, listen_addr, len);
+        host[len] = '\0';
+        port = colon + 1;
+    }
+    // [::1]:9464 形式的 IPv6 地址
+    char *h = host;
+    size_t hlen = strlen(h);
+    if (hlen >= 2 && h[0] == '[' && h[hlen - 1] == ']')
+    {
+        h[hlen - 1] = '\0';
+        h++;
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo *result = NULL;
+    int ret = getaddrinfo(h[0] ? h : NULL, port, &hints, &result);
+    if (ret != 0)
+    {
+        log_error("Invalid metrics listen address %s: %s", listen_addr, gai_strerror(ret));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = result; ai; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 8) == 0)
+        {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd < 0)
+    {
+        log_error("Failed to listen on metrics address %s: %s", listen_addr, strerror(errno));
+    }
+    return fd;
+}
+
+int metrics_server_start(MetricsServer *server, const char *listen_addr)
+{
+    memset(server, 0, sizeof(MetricsServer));
+    snprintf(server->listen_addr, sizeof(server->listen_addr), "%s", listen_addr);
+    server->listen_fd = open_listener(listen_addr);
+    if (server->listen_fd < 0)
+    {
+        return -1;
+    }
+    server->running = 1;
+    if (pthread_create(&server->thread, NULL, metrics_server_thread, server) != 0)
+    {
+        log_error("Failed to create metrics thread");
+        server->running = 0;
+        close(server->listen_fd);
+        server->listen_fd = -1;
+        return -1;
+    }
+    log_info("Metrics endpoint listening on http://%s/metrics", listen_addr);
+    return 0;
+}
+
+void metrics_server_stop(MetricsServer *server)
+{
+    if (server->listen_fd < 0)
+    {
+        return;
+    }
+    server->running = 0;
+    pthread_join(server->thread, NULL);
+    close(server->listen_fd);
+    server->listen_fd = -1;
+}
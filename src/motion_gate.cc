@@ -0,0 +1,173 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "motion_gate.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "logger.h"
+
+// 每个网格单元内的采样步长, 只读取少量像素以降低开销
+#define MOTION_SAMPLE_STEP 4
+
+void motion_gate_init(MotionGate *gate, const MotionGateConfig *config)
+{
+    memset(gate, 0, sizeof(MotionGate));
+    gate->config = *config;
+}
+
+int frame_has_luma_plane(const AVFrame *frame)
+{
+    switch (frame->format)
+    {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_YUV422P:
+    case AV_PIX_FMT_YUVJ422P:
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_YUVJ444P:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+    case AV_PIX_FMT_GRAY8:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// 计算降采样亮度网格
+static void sample_luma_grid(const AVFrame *frame, float *grid)
+{
+    const uint8_t *luma = frame->data[0];
+    int stride = frame->linesize[0];
+    for (int gy = 0; gy < MOTION_GRID_HEIGHT; gy++)
+    {
+        int y0 = gy * frame->height / MOTION_GRID_HEIGHT;
+        int y1 = (gy + 1) * frame->height / MOTION_GRID_HEIGHT;
+        for (int gx = 0; gx < MOTION_GRID_WIDTH; gx++)
+        {
+            int x0 = gx * frame->width / MOTION_GRID_WIDTH;
+            int x1 = (gx + 1) * frame->width / MOTION_GRID_WIDTH;
+            uint32_t sum = 0;
+            uint32_t count = 0;
+            for (int y = y0; y < y1; y += MOTION_SAMPLE_STEP)
+            {
+                const uint8_t *row = luma + (size_t)y * stride;
+                for (int x = x0; x < x1; x += MOTION_SAMPLE_STEP)
+                {
+                    sum += row[x];
+                    count++;
+                }
+            }
+            grid[gy * MOTION_GRID_WIDTH + gx] = count ? (float)sum / count : 0;
+        }
+    }
+}
+
+int motion_gate_check(MotionGate *gate, const AVFrame *frame)
+{
+    gate->stats.frames_total++;
+    if (!gate->config.enabled || !frame || !frame_has_luma_plane(frame) ||
+        frame->width < MOTION_GRID_WIDTH || frame->height < MOTION_GRID_HEIGHT)
+    {
+        gate->stats.frames_inferred++;
+        return 1;
+    }
+    float grid[MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT];
+    sample_luma_grid(frame, grid);
+    // 首帧或分辨率变化时重建背景并放行
+    if (!gate->initialized || gate->width != frame->width || gate->height != frame->height)
+    {
+        memcpy(gate->background, grid, sizeof(grid));
+        memset(gate->changed, 1, sizeof(gate->changed));
+        gate->width = frame->width;
+        gate->height = frame->height;
+        gate->initialized = 1;
+        gate->frames_since_infer = 0;
+        gate->pending = 1;
+        gate->stats.frames_inferred++;
+        return 1;
+    }
+    const int cells = MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT;
+    const float alpha = gate->config.background_alpha;
+    int changed = 0;
+    for (int i = 0; i < cells; i++)
+    {
+        // 变化单元累积到下一次推理, 跳过的帧上的运动不会丢失
+        int cell_changed = fabsf(grid[i] - gate->background[i]) > gate->config.pixel_threshold;
+        gate->changed[i] |= cell_changed;
+        changed += cell_changed;
+        gate->background[i] += alpha * (grid[i] - gate->background[i]);
+    }
+    gate->stats.last_motion_ratio = (float)changed / cells;
+    gate->frames_since_infer++;
+    if (gate->stats.last_motion_ratio >= gate->config.motion_ratio)
+    {
+        gate->pending = 1;
+    }
+    else if (!gate->pending && gate->config.keepalive_frames > 0 &&
+             gate->frames_since_infer >= gate->config.keepalive_frames)
+    {
+        gate->pending = 1;
+        gate->stats.keepalive_frames++;
+    }
+    if (gate->pending)
+    {
+        gate->stats.frames_inferred++;
+        return 1;
+    }
+    gate->stats.frames_skipped++;
+    return 0;
+}
+
+void motion_gate_consume(MotionGate *gate)
+{
+    gate->pending = 0;
+    gate->frames_since_infer = 0;
+    memset(gate->changed, 0, sizeof(gate->changed));
+}
+
+int motion_gate_region_active(const MotionGate *gate, int x, int y, int w, int h)
+{
+    if (!gate->config.enabled || !gate->initialized || gate->width <= 0 || gate->height <= 0)
+    {
+        return 1;
+    }
+    int gx0 = std::max(0, x * MOTION_GRID_WIDTH / gate->width);
+    int gy0 = std::max(0, y * MOTION_GRID_HEIGHT / gate->height);
+    int gx1 = std::min(MOTION_GRID_WIDTH - 1, (x + w - 1) * MOTION_GRID_WIDTH / gate->width);
+    int gy1 = std::min(MOTION_GRID_HEIGHT - 1, (y + h - 1) * MOTION_GRID_HEIGHT / gate->height);
+    for (int gy = gy0; gy <= gy1; gy++)
+    {
+        for (int gx = gx0; gx <= gx1; gx++)
+        {
+            if (gate->changed[gy * MOTION_GRID_WIDTH + gx])
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void motion_gate_dump_stats(const MotionGate *gate)
+{
+    const MotionGateStats *stats = &gate->stats;
+    double skip_rate = stats->frames_total ? 100.0 * stats->frames_skipped / stats->frames_total : 0;
+    log_info("Motion gate: total=%llu, inferred=%llu, skipped=%llu (%.1f%%), keepalive=%llu, last_ratio=%.4f",
+             (unsigned long long)stats->frames_total, (unsigned long long)stats->frames_inferred,
+             (unsigned long long)stats->frames_skipped, skip_rate,
+             (unsigned long long)stats->keepalive_frames, stats->last_motion_ratio);
+}
@@ -0,0 +1,137 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "nms.h"
+#include <stdint.h>
+#include <algorithm>
+#include <unordered_map>
+
+void nms_candidates_clear(NmsCandidates *candidates)
+{
+    candidates->x1.clear();
+    candidates->y1.clear();
+    candidates->x2.clear();
+    candidates->y2.clear();
+    candidates->score.clear();
+    candidates->class_id.clear();
+    candidates->image.clear();
+}
+
+void nms_candidates_add(NmsCandidates *candidates, float x, float y, float w, float h, float score, int class_id,
+                        int image)
+{
+    candidates->x1.push_back(x);
+    candidates->y1.push_back(y);
+    candidates->x2.push_back(x + w);
+    candidates->y2.push_back(y + h);
+    candidates->score.push_back(score);
+    candidates->class_id.push_back(class_id);
+    candidates->image.push_back(image);
+}
+
+// 每次比较的框数, 定长内层循环便于编译器在 -O2 下生成 SIMD 指令
+#define NMS_LANES 8
+
+// 对一个桶(同一图片同一类别, 已按置信度降序)做贪心 NMS
+static void nms_bucket(const NmsCandidates *c, const int *order, int n, float iou_threshold, std::vector<int> &keep)
+{
+    // 按桶内顺序把坐标收集到连续数组, 长度补齐到 NMS_LANES 的倍数, 补齐部分面积为 0 不会抑制任何框
+    int padded = (n + NMS_LANES - 1) / NMS_LANES * NMS_LANES;
+    std::vector<float> x1(padded, 0.0f), y1(padded, 0.0f), x2(padded, 0.0f), y2(padded, 0.0f), area(padded, 0.0f);
+    for (int k = 0; k < n; k++)
+    {
+        int idx = order[k];
+        x1[k] = c->x1[idx];
+        y1[k] = c->y1[idx];
+        x2[k] = c->x2[idx];
+        y2[k] = c->y2[idx];
+        area[k] = (x2[k] - x1[k]) * (y2[k] - y1[k]);
+    }
+    std::vector<int> suppressed(padded, 0);
+    for (int i = 0; i < n; i++)
+    {
+        if (suppressed[i])
+        {
+            continue;
+        }
+        keep.push_back(order[i]);
+        const float ix1 = x1[i], iy1 = y1[i], ix2 = x2[i], iy2 = y2[i], iarea = area[i];
+        // 从 i 所在的块开始整块比较; 块内 i 之前的框已经处理过, 对它们的标记不影响结果
+        for (int block = i / NMS_LANES * NMS_LANES; block < padded; block += NMS_LANES)
+        {
+            for (int lane = 0; lane < NMS_LANES; lane++)
+            {
+                int j = block + lane;
+                float w = std::max(0.0f, std::min(ix2, x2[j]) - std::max(ix1, x1[j]));
+                float h = std::max(0.0f, std::min(iy2, y2[j]) - std::max(iy1, y1[j]));
+                float inter = w * h;
+                // inter / union > t 等价于 inter > t * union, 省去除法
+                suppressed[j] |= inter > iou_threshold * (iarea + area[j] - inter);
+            }
+        }
+    }
+}
+
+void nms_run(const NmsCandidates *candidates, float iou_threshold, std::vector<int> &keep)
+{
+    keep.clear();
+    int n = (int)candidates->score.size();
+    if (n == 0)
+    {
+        return;
+    }
+    // 全部候选只排序一次
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [candidates](int a, int b)
+              { return candidates->score[a] > candidates->score[b]; });
+    // 按 (图片, 类别) 分桶, 稳定分配保持桶内的置信度顺序
+    std::unordered_map<int64_t, int> bucket_of;
+    std::vector<int> bucket_index(n);
+    std::vector<int> bucket_size;
+    for (int k = 0; k < n; k++)
+    {
+        int idx = order[k];
+        int64_t key = ((int64_t)candidates->image[idx] << 32) | (uint32_t)candidates->class_id[idx];
+        auto it = bucket_of.find(key);
+        if (it == bucket_of.end())
+        {
+            it = bucket_of.emplace(key, (int)bucket_size.size()).first;
+            bucket_size.push_back(0);
+        }
+        bucket_index[k] = it->second;
+        bucket_size[it->second]++;
+    }
+    std::vector<int> bucket_start(bucket_size.size() + 1, 0);
+    for (size_t b = 0; b < bucket_size.size(); b++)
+    {
+        bucket_start[b + 1] = bucket_start[b] + bucket_size[b];
+    }
+    std::vector<int> bucketed(n);
+    std::vector<int> cursor(bucket_start.begin(), bucket_start.end() - 1);
+    for (int k = 0; k < n; k++)
+    {
+        bucketed[cursor[bucket_index[k]]++] = order[k];
+    }
+    for (size_t b = 0; b < bucket_size.size(); b++)
+    {
+        nms_bucket(candidates, bucketed.data() + bucket_start[b], bucket_size[b], iou_threshold, keep);
+    }
+    std::sort(keep.begin(), keep.end(), [candidates](int a, int b)
+              { return candidates->score[a] > candidates->score[b]; });
+}
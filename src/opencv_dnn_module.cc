@@ -15,13 +15,12 @@
 #include "opencv_dnn_module.h"
 #include "opencv_utils.h"
 #include <iostream>
+#include <string.h>
 #include "logger.h"
-#include "coco_class.h"
+#include "inference_backend.h"
 // 初始化YOLOv8模型
 int Init_CV_ONNX_DNN_Yolov8(const char *model_path, cv::dnn::Net *net)
 {
-    init_coco_names();
-    print_coco_names();
     try
     {
         *net = cv::dnn::readNetFromONNX(model_path);
@@ -43,56 +42,300 @@ int Init_CV_ONNX_DNN_Yolov8(const char *model_path, cv::dnn::Net *net)
     }
 }
 
-// 执行YOLOv8推理
-int Infer_CV_ONNX_DNN_Yolov8(cv::dnn::Net *net, cv::Mat frame, std::vector<Box> &boxes)
+// 释放模型资源
+int Release_CV_ONNX_DNN_Yolov8(cv::dnn::Net *net)
+{
+    log_info( "Releasing YOLOv8 model...");
+    return 0;
+}
+
+// OpenCV DNN 计算后端名称转换
+int CV_DNN_Backend_From_Name(const char *name)
 {
-    if (!net)
+    if (strcmp(name, "openvino") == 0)
     {
-        log_info( "Error: Net pointer is null.");
-        return -1;
+        return cv::dnn::DNN_BACKEND_INFERENCE_ENGINE;
     }
-    // 准备输入; YOLOV8图片尺寸需要压缩为640*640
-    cv::Mat blob;
-    cv::Mat letterboxed_frame;
-    letterbox(&frame, &letterboxed_frame, 640, 640, cv::Scalar(0, 0, 0));
-    cv::dnn::blobFromImage(letterboxed_frame, blob, 1.0 / 255.0, cv::Size(640, 640), cv::Scalar(), true, false);
-    net->setInput(blob);
-    // 推理
-    std::vector<cv::Mat> outs;
-    std::string outputName = "output0";
-    int layerId = net->getLayerId("output0");
-    net->registerOutput(outputName, layerId, 0);
-    net->forward(outs, outputName);
-    // 检查推理结果
-    if (outs.empty())
-    {
-        log_info( "Error: No output from the network.");
-        return -1;
+    if (strcmp(name, "cuda") == 0)
+    {
+        return cv::dnn::DNN_BACKEND_CUDA;
+    }
+    if (strcmp(name, "default") == 0)
+    {
+        return cv::dnn::DNN_BACKEND_DEFAULT;
+    }
+    return cv::dnn::DNN_BACKEND_OPENCV;
+}
+
+// OpenCV DNN 计算设备名称转换
+int CV_DNN_Target_From_Name(const char *name)
+{
+    if (strcmp(name, "opencl") == 0)
+    {
+        return cv::dnn::DNN_TARGET_OPENCL;
+    }
+    if (strcmp(name, "opencl_fp16") == 0)
+    {
+        return cv::dnn::DNN_TARGET_OPENCL_FP16;
+    }
+    if (strcmp(name, "cuda") == 0)
+    {
+        return cv::dnn::DNN_TARGET_CUDA;
     }
-    std::vector<DnnResult> results = postprocess(frame, outs, 0.25, 0.5);
-    for (auto &&result : results)
+    if (strcmp(name, "cuda_fp16") == 0)
     {
-        const char *coco_name = get_coco_name(result.class_id);
+        return cv::dnn::DNN_TARGET_CUDA_FP16;
+    }
+    return cv::dnn::DNN_TARGET_CPU;
+}
 
-        cv::Rect box_in_letterbox(result.x, result.y, result.w, result.h);
-        cv::Rect box_in_original = map_box_to_original(box_in_letterbox, frame.size(), letterboxed_frame.size());
-        Box box = {
-            .x = box_in_original.x,
-            .y = box_in_original.y,
-            .w = box_in_original.width,
-            .h = box_in_original.height,
-            .prop = result.score,
-        };
+// ============== OpenCV DNN 推理后端 ==============
+
+typedef struct
+{
+    cv::dnn::Net net;
+    std::vector<cv::String> output_names;
+    int dnn_backend;
+    int dnn_target;
+    int max_batch;
+    char precision[8];
+} OpenCVDnnBackend;
+
+// 判断网络是否已经是量化模型(QDQ 格式的 ONNX 会被导入为 Int8 层)
+static bool opencv_net_is_quantized(cv::dnn::Net &net)
+{
+    std::vector<cv::String> layer_types;
+    net.getLayerTypes(layer_types);
+    for (const cv::String &type : layer_types)
+    {
+        if (type == "Quantize" || type.find("Int8") != cv::String::npos)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-        strcpy(box.label, coco_name);
-        boxes.push_back(box);
+// 用校准图片在线量化 FP32 模型
+static int opencv_net_quantize(OpenCVDnnBackend *priv, const DetectorConfig *config)
+{
+    std::vector<cv::String> files;
+    cv::glob(cv::String(config->calibration_dir) + "/*.jpg", files, false);
+    std::vector<cv::String> png_files;
+    cv::glob(cv::String(config->calibration_dir) + "/*.png", png_files, false);
+    files.insert(files.end(), png_files.begin(), png_files.end());
+    std::vector<cv::Mat> calib_data;
+    for (const cv::String &file : files)
+    {
+        if ((int)calib_data.size() >= config->calibration_images)
+        {
+            break;
+        }
+        cv::Mat image = cv::imread(file);
+        if (image.empty())
+        {
+            continue;
+        }
+        // 与流水线保持一致, 使用 RGB 输入
+        cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+        cv::Mat blob;
+        yolov8_preprocess(&image, 1, config->input_width, config->input_height, blob);
+        calib_data.push_back(blob);
+    }
+    if (calib_data.empty())
+    {
+        log_error("No calibration images found in %s", config->calibration_dir);
+        return -1;
+    }
+    log_info("Quantizing model to INT8 with %d calibration images...", (int)calib_data.size());
+    try
+    {
+        priv->net = priv->net.quantize(calib_data, CV_32F, CV_32F);
+    }
+    catch (const std::exception &e)
+    {
+        log_error("INT8 quantization failed: %s", e.what());
+        return -1;
     }
     return 0;
 }
 
-// 释放模型资源
-int Release_CV_ONNX_DNN_Yolov8(cv::dnn::Net *net)
+// 按配置的推理精度调整网络和计算设备
+static int opencv_backend_apply_precision(OpenCVDnnBackend *priv, const DetectorConfig *config)
 {
-    log_info( "Releasing YOLOv8 model...");
+    snprintf(priv->precision, sizeof(priv->precision), "fp32");
+    if (strcmp(config->precision, "fp16") == 0)
+    {
+        switch (priv->dnn_target)
+        {
+        case cv::dnn::DNN_TARGET_OPENCL:
+            priv->dnn_target = cv::dnn::DNN_TARGET_OPENCL_FP16;
+            break;
+        case cv::dnn::DNN_TARGET_CUDA:
+            priv->dnn_target = cv::dnn::DNN_TARGET_CUDA_FP16;
+            break;
+        case cv::dnn::DNN_TARGET_OPENCL_FP16:
+        case cv::dnn::DNN_TARGET_CUDA_FP16:
+            break;
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+        case cv::dnn::DNN_TARGET_CPU:
+            priv->dnn_target = cv::dnn::DNN_TARGET_CPU_FP16;
+            break;
+#endif
+        default:
+            log_warn("FP16 is not supported on dnn_target=%s, fall back to FP32", config->dnn_target);
+            return 0;
+        }
+        snprintf(priv->precision, sizeof(priv->precision), "fp16");
+    }
+    else if (strcmp(config->precision, "int8") == 0)
+    {
+        if (priv->dnn_backend != cv::dnn::DNN_BACKEND_OPENCV)
+        {
+            log_error("INT8 inference requires dnn_backend=opencv");
+            return -1;
+        }
+        if (!opencv_net_is_quantized(priv->net))
+        {
+            if (config->calibration_dir[0] == '\0')
+            {
+                log_error("Model %s is not quantized and no calibration_dir is configured", config->model_path);
+                return -1;
+            }
+            if (opencv_net_quantize(priv, config) != 0)
+            {
+                return -1;
+            }
+        }
+        // 量化网络只能在 CPU 上运行
+        priv->dnn_target = cv::dnn::DNN_TARGET_CPU;
+        snprintf(priv->precision, sizeof(priv->precision), "int8");
+    }
+    return 0;
+}
+
+static int opencv_backend_load(InferenceBackend *backend, const DetectorConfig *config)
+{
+    OpenCVDnnBackend *priv = new OpenCVDnnBackend();
+    if (Init_CV_ONNX_DNN_Yolov8(config->model_path, &priv->net) != 0)
+    {
+        delete priv;
+        return -1;
+    }
+    priv->dnn_backend = CV_DNN_Backend_From_Name(config->dnn_backend);
+    priv->dnn_target = CV_DNN_Target_From_Name(config->dnn_target);
+    priv->max_batch = config->max_batch;
+    if (opencv_backend_apply_precision(priv, config) != 0)
+    {
+        delete priv;
+        return -1;
+    }
+    try
+    {
+        priv->net.setPreferableBackend(priv->dnn_backend);
+        priv->net.setPreferableTarget(priv->dnn_target);
+        priv->output_names = priv->net.getUnconnectedOutLayersNames();
+    }
+    catch (const std::exception &e)
+    {
+        log_error("Failed to configure OpenCV DNN backend: %s", e.what());
+        delete priv;
+        return -1;
+    }
+    backend->priv = priv;
+    log_info("OpenCV DNN backend loaded: model=%s, dnn_backend=%s, dnn_target=%s, precision=%s",
+             config->model_path, config->dnn_backend, config->dnn_target, priv->precision);
     return 0;
 }
+
+static int opencv_backend_infer(InferenceBackend *backend, const cv::Mat &blob, std::vector<cv::Mat> &outputs)
+{
+    OpenCVDnnBackend *priv = (OpenCVDnnBackend *)backend->priv;
+    if (!priv)
+    {
+        log_info( "Error: OpenCV DNN backend is not loaded.");
+        return -1;
+    }
+    try
+    {
+        priv->net.setInput(blob);
+        priv->net.forward(outputs, priv->output_names);
+    }
+    catch (const std::exception &e)
+    {
+        log_error("OpenCV DNN forward failed: %s", e.what());
+        return -1;
+    }
+    return outputs.empty() ? -1 : 0;
+}
+
+static int opencv_backend_warmup(InferenceBackend *backend, int batch, int width, int height)
+{
+    int shape[] = {batch, 3, height, width};
+    cv::Mat blob(4, shape, CV_32F, cv::Scalar(0));
+    std::vector<cv::Mat> outputs;
+    return opencv_backend_infer(backend, blob, outputs);
+}
+
+static void opencv_backend_get_capabilities(InferenceBackend *backend, BackendCapabilities *caps)
+{
+    OpenCVDnnBackend *priv = (OpenCVDnnBackend *)backend->priv;
+    memset(caps, 0, sizeof(BackendCapabilities));
+    if (!priv)
+    {
+        return;
+    }
+    caps->max_batch_size = priv->max_batch;
+    snprintf(caps->precision, sizeof(caps->precision), "%s", priv->precision);
+    // OpenCV 的 ONNX 导入器会按输入形状重新推导网络, 动态轴模型可直接使用
+    caps->dynamic_input = 1;
+    std::vector<cv::dnn::Target> targets = cv::dnn::getAvailableTargets((cv::dnn::Backend)priv->dnn_backend);
+    for (cv::dnn::Target target : targets)
+    {
+        if (target == cv::dnn::DNN_TARGET_OPENCL_FP16 || target == cv::dnn::DNN_TARGET_CUDA_FP16
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+            || target == cv::dnn::DNN_TARGET_CPU_FP16
+#endif
+        )
+        {
+            caps->supports_fp16 = 1;
+        }
+    }
+    // 量化模型只有 OpenCV 自带后端支持
+    caps->supports_int8 = priv->dnn_backend == cv::dnn::DNN_BACKEND_OPENCV;
+    switch (priv->dnn_target)
+    {
+    case cv::dnn::DNN_TARGET_OPENCL:
+    case cv::dnn::DNN_TARGET_OPENCL_FP16:
+        snprintf(caps->device, sizeof(caps->device), "opencl");
+        break;
+    case cv::dnn::DNN_TARGET_CUDA:
+    case cv::dnn::DNN_TARGET_CUDA_FP16:
+        snprintf(caps->device, sizeof(caps->device), "cuda");
+        break;
+    default:
+        snprintf(caps->device, sizeof(caps->device), "cpu");
+        break;
+    }
+}
+
+static void opencv_backend_release(InferenceBackend *backend)
+{
+    OpenCVDnnBackend *priv = (OpenCVDnnBackend *)backend->priv;
+    if (priv)
+    {
+        Release_CV_ONNX_DNN_Yolov8(&priv->net);
+        delete priv;
+        backend->priv = NULL;
+    }
+}
+
+const InferenceBackend opencv_dnn_backend = {
+    "opencv",
+    opencv_backend_load,
+    opencv_backend_warmup,
+    opencv_backend_infer,
+    opencv_backend_get_capabilities,
+    opencv_backend_release,
+    NULL,
+};
@@ -71,46 +71,67 @@ BestResult getBestFromConfidenceValue(float confidenceValues[], size_t size)
     return result;
 }
 
-std::vector<DnnResult> postprocess(cv::Mat &frame, const std::vector<cv::Mat> &outs, float confThreshold, float nmsThreshold)
+void yolov8_collect_candidates(const cv::Mat &out, const ClassFilter *filter, int image, NmsCandidates *candidates)
 {
-
-    std::vector<int> classIds;
-    std::vector<float> confidences;
-    std::vector<cv::Rect> boxes;
-    // 网络输出的后处理
-    int columns = 84;
-    int rows = 8400;
-    for (const auto &out : outs)
+    // 输出形状为 [4 + 类别数, 锚点数] 或 [1, 4 + 类别数, 锚点数]
+    // 锚点数随输入尺寸变化(640x640 为 8400), 类别数由模型决定
+    int columns = out.dims == 3 ? out.size[1] : out.size[0];
+    int rows = out.dims == 3 ? out.size[2] : out.size[1];
+    int num_classes = columns - 4;
+    if (num_classes <= 0)
+    {
+        log_error("Unexpected output shape, columns=%d", columns);
+        return;
+    }
+    const float *data_ptr = (const float *)out.data;
+    // 按类别逐行扫描(每个类别的分数在内存中连续), 只看允许的类别,
+    // 低于该类别阈值的分数直接跳过, 记录每个锚点的最佳类别
+    std::vector<float> best_scores(rows, 0.0f);
+    std::vector<int> best_ids(rows, -1);
+    for (int k = 0; k < filter->count && filter->ids[k] < num_classes; ++k)
     {
-        float *data_ptr = (float *)out.data;
-        // std::cout << "out.rows: " << out.size << std::endl;
+        const float *scores = data_ptr + rows * (4 + filter->ids[k]);
+        float threshold = filter->thresholds[k];
         for (int i = 0; i < rows; ++i)
         {
-            auto x = (data_ptr[i + rows * 0]);
-            auto y = (data_ptr[i + rows * 1]);
-            auto w = (data_ptr[i + rows * 2]);
-            auto h = (data_ptr[i + rows * 3]);
-            float confidenceValues[80] = {};
-            for (int j = 4; j < columns; ++j)
+            if (scores[i] >= threshold && scores[i] > best_scores[i])
             {
-                confidenceValues[j - 4] = data_ptr[i + rows * j];
+                best_scores[i] = scores[i];
+                best_ids[i] = filter->ids[k];
             }
-            BestResult result = getBestFromConfidenceValue(confidenceValues, 80);
-            classIds.push_back(result.bestId);
-            confidences.push_back(result.bestScore);
-            boxes.push_back(cv::Rect(int(x - w / 2), int(y - h / 2), w, h));
         }
     }
+    // 只有通过阈值的锚点才成为 NMS 候选
+    for (int i = 0; i < rows; ++i)
+    {
+        if (best_ids[i] < 0)
+        {
+            continue;
+        }
+        float x = data_ptr[i + rows * 0];
+        float y = data_ptr[i + rows * 1];
+        float w = data_ptr[i + rows * 2];
+        float h = data_ptr[i + rows * 3];
+        nms_candidates_add(candidates, x - w / 2, y - h / 2, w, h, best_scores[i], best_ids[i], image);
+    }
+}
 
-    // 非极大值抑制
+std::vector<DnnResult> postprocess(cv::Mat &frame, const std::vector<cv::Mat> &outs, const ClassFilter *filter, float nmsThreshold)
+{
+    NmsCandidates candidates;
+    for (const auto &out : outs)
+    {
+        yolov8_collect_candidates(out, filter, 0, &candidates);
+    }
+    // 按类别做非极大值抑制, 候选框已经按类别阈值过滤过
     std::vector<DnnResult> boxes_result;
     std::vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, confidences, confThreshold, nmsThreshold, indices);
+    nms_run(&candidates, nmsThreshold, indices);
     for (int idx : indices)
     {
-        cv::Rect box = boxes[idx];
-        // log_message(LOG_INFO"box: %d, %d, %d, %d, %f, %d", box.x, box.y, box.width, box.height, confidences[idx], classIds[idx]);
-        boxes_result.push_back({box.x, box.y, box.width, box.height, confidences[idx], classIds[idx]});
+        boxes_result.push_back({(int)candidates.x1[idx], (int)candidates.y1[idx],
+                                (int)(candidates.x2[idx] - candidates.x1[idx]), (int)(candidates.y2[idx] - candidates.y1[idx]),
+                                candidates.score[idx], candidates.class_id[idx]});
     }
     return boxes_result;
 }
@@ -133,43 +154,22 @@ void rescale_box(float x, float y, float w, float h, float width_scale, float he
 
 void letterbox(const cv::Mat *src, cv::Mat *dst, int new_width, int new_height, cv::Scalar color)
 {
-    float scale;
-    int unpad_w, unpad_h;
-    // 宽度大于高度
-    if (new_width > new_height)
-    {
-        scale = (float)new_height / src->rows;
-        unpad_w = scale * src->cols;
-        unpad_h = new_height;
-    }
-    // 高度大于等于宽度
-    else
-    {
-        scale = (float)new_width / src->cols;
-        unpad_w = new_width;
-        unpad_h = scale * src->rows;
-    }
+    // 取宽高缩放比例中较小的一个, 保持长宽比, 与 map_box_to_original 一致
+    float scale = std::min((float)new_width / src->cols, (float)new_height / src->rows);
+    int unpad_w = scale * src->cols;
+    int unpad_h = scale * src->rows;
     cv::resize(*src, *dst, cv::Size(unpad_w, unpad_h));
+    // 剩余部分在两侧均匀填充
     int pad_w = new_width - unpad_w;
     int pad_h = new_height - unpad_h;
-    int top, bottom, left, right;
-    // 宽度大于高度的填充机制
-    if (new_width > new_height)
-    {
-        top = 0;
-        bottom = 0;
-        left = pad_w / 2;
-        right = pad_w - left;
-    }
-    // 高度大于等于宽度的填充机制
-    else
+    int left = pad_w / 2;
+    int right = pad_w - left;
+    int top = pad_h / 2;
+    int bottom = pad_h - top;
+    if (pad_w > 0 || pad_h > 0)
     {
-        left = 0;
-        right = 0;
-        top = pad_h / 2;
-        bottom = pad_h - top;
+        cv::copyMakeBorder(*dst, *dst, top, bottom, left, right, cv::BORDER_CONSTANT, color);
     }
-    cv::copyMakeBorder(*dst, *dst, top, bottom, left, right, cv::BORDER_CONSTANT, color);
 }
 
 cv::Rect map_box_to_original(cv::Rect box, cv::Size original_size, cv::Size letterboxed_size)
@@ -187,4 +187,14 @@ cv::Rect map_box_to_original(cv::Rect box, cv::Size original_size, cv::Size lett
     mapped_box.width = box.width / scale;
     mapped_box.height = box.height / scale;
     return mapped_box;
-}
\ No newline at end of file
+}
+
+void yolov8_preprocess(const cv::Mat *frames, int count, int input_width, int input_height, cv::Mat &blob)
+{
+    std::vector<cv::Mat> letterboxed_frames(count);
+    for (int i = 0; i < count; i++)
+    {
+        letterbox(&frames[i], &letterboxed_frames[i], input_width, input_height, cv::Scalar(0, 0, 0));
+    }
+    cv::dnn::blobFromImages(letterboxed_frames, blob, 1.0 / 255.0, cv::Size(input_width, input_height), cv::Scalar(), true, false);
+}
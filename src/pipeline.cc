@@ -0,0 +1,669 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pipeline.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pull_stream_handler_thread.h"
+#include "detection_thread.h"
+#include "thread_utils.h"
+#include "metrics.h"
+#include "logger.h"
+
+// 监管线程检查各路阶段的间隔
+#define SUPERVISOR_INTERVAL_MS 500
+// 抓取指标时等待管理器锁的最长时间, 流水线正在排空停止时跳过各路的队列指标
+#define METRICS_LOCK_TIMEOUT_MS 1000
+
+// 各队列在指标中的名称, 与 Pipeline.queues 的下标对应
+static const char *queue_names[PIPELINE_QUEUE_COUNT] = {"detect", "push", "record", "infer"};
+
+// 释放上下文
+static void destroy_context(Context **ctx)
+{
+    if (!*ctx)
+    {
+        return;
+    }
+    pthread_cond_destroy(&(*ctx)->cond);
+    pthread_mutex_destroy(&(*ctx)->mtx);
+    free(*ctx);
+    *ctx = NULL;
+}
+
+// 释放流水线的上下文, 关闭检测结果记录, 归还分配的 NUMA 节点
+static void destroy_pipeline_context(Pipeline *pipeline)
+{
+    destroy_context(&pipeline->ctx);
+    destroy_context(&pipeline->abort_ctx);
+    detection_log_close(pipeline->detection_log);
+    pipeline->detection_log = NULL;
+    numa_release_node(pipeline->config.threads.numa_node);
+    pipeline->config.threads.numa_node = -1;
+}
+
+// 强制检测线程退出: 不再等待剩余的帧
+static void abort_detection(Pipeline *pipeline)
+{
+    CancelContext(pipeline->abort_ctx);
+    frame_queue_close(&pipeline->queues[0]);
+}
+
+int pipeline_start(Pipeline *pipeline, InferencePool *pool, FrameQueue *video_queue, FrameQueue *box_queue)
+{
+    pipeline->config = pipeline->source;
+    // 每路分别确定 NUMA 节点, auto 时分到当前摄像头最少的节点; 停止时归还
+    pipeline->config.threads.numa_node = numa_assign_node(pipeline->source.threads.numa_node);
+    if (pipeline->config.threads.numa_node >= 0)
+    {
+        log_info("Stream %s placed on NUMA node %d of %d", pipeline->config.name,
+                 pipeline->config.threads.numa_node, numa_node_count());
+    }
+    // 检测线程只向本节点的推理服务提交
+    InferenceService *inference = inference_pool_get(pool, pipeline->config.threads.numa_node);
+    if (!inference)
+    {
+        log_error("No inference service for stream %s", pipeline->config.name);
+        destroy_pipeline_context(pipeline);
+        return -1;
+    }
+    pipeline->ctx = CreateContext();
+    pipeline->abort_ctx = CreateContext();
+    if (!pipeline->ctx || !pipeline->abort_ctx)
+    {
+        log_error("Failed to create context for stream %s", pipeline->config.name);
+        destroy_pipeline_context(pipeline);
+        return -1;
+    }
+    if (pipeline->config.detection_log[0])
+    {
+        pipeline->detection_log = detection_log_open(pipeline->config.detection_log);
+        if (!pipeline->detection_log)
+        {
+            destroy_pipeline_context(pipeline);
+            return -1;
+        }
+    }
+    for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++)
+    {
+        frame_queue_init(&pipeline->queues[i], PIPELINE_QUEUE_SIZE);
+        if (pipeline->config.lossless)
+        {
+            frame_queue_set_block_timeout(&pipeline->queues[i], PIPELINE_BLOCK_TIMEOUT_MS);
+        }
+    }
+    ThreadArgs *args = &pipeline->args;
+    memset(args, 0, sizeof(ThreadArgs));
+    args->input_stream_url = pipeline->config.input_url;
+    args->output_stream_url = pipeline->config.output_url;
+    args->video_queue = video_queue;
+    args->box_queue = box_queue;
+    args->detection_queue = &pipeline->queues[0];
+    args->origin_frame_queue = &pipeline->queues[1];
+    args->record_frame_queue = &pipeline->queues[2];
+    args->infer_frame_queue = &pipeline->queues[3];
+    args->input_stream = NULL;
+    args->ctx = pipeline->ctx;
+    args->config = &pipeline->config;
+    args->inference = inference;
+    args->health = &pipeline->decode;
+    args->detection_log = pipeline->detection_log;
+    memset(&pipeline->drain_deadline, 0, sizeof(pipeline->drain_deadline));
+    args->drain_deadline = &pipeline->drain_deadline;
+    // 检测线程在队列关闭并取完后自行退出, 它的上下文只用于超时后强制退出
+    pipeline->detection_args = *args;
+    pipeline->detection_args.ctx = pipeline->abort_ctx;
+    pipeline->detection_args.health = &pipeline->detection;
+    char stage_name[32];
+    snprintf(stage_name, sizeof(stage_name), "%s/decode", pipeline->config.name);
+    supervised_stage_init(&pipeline->decode, stage_name);
+    snprintf(stage_name, sizeof(stage_name), "%s/detection", pipeline->config.name);
+    supervised_stage_init(&pipeline->detection, stage_name);
+    pipeline->stopping = 0;
+
+    const ThreadConfig *threads = &pipeline->config.threads;
+    if (supervised_stage_start(&pipeline->detection, STAGE_DETECT, threads, frame_detection_thread,
+                               &pipeline->detection_args) != 0)
+    {
+        log_error("Failed to create detection thread for stream %s", pipeline->config.name);
+        for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++)
+        {
+            frame_queue_destroy(&pipeline->queues[i]);
+        }
+        destroy_pipeline_context(pipeline);
+        return -1;
+    }
+    if (supervised_stage_start(&pipeline->decode, STAGE_DECODE, threads, pull_stream_handler_thread, args) != 0)
+    {
+        log_error("Failed to create decode thread for stream %s", pipeline->config.name);
+        abort_detection(pipeline);
+        supervised_stage_join(&pipeline->detection, NULL);
+        for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++)
+        {
+            frame_queue_destroy(&pipeline->queues[i]);
+        }
+        destroy_pipeline_context(pipeline);
+        return -1;
+    }
+    pipeline->started = 1;
+    log_info("Stream %s started: %s -> %s", pipeline->config.name, pipeline->config.input_url,
+             pipeline->config.output_url);
+    return 0;
+}
+
+void pipeline_cancel(Pipeline *pipeline, const struct timespec *deadline)
+{
+    if (!pipeline->ctx)
+    {
+        return;
+    }
+    // 只停止拉流; 拉流线程冲刷解码器后关闭下游队列, 各阶段处理完队列中剩余的帧再退出.
+    // 截止时间在这里确定一次, 拉流线程等推流/录像和这里等检测都用它, 各阶段不再各自重新计时
+    pthread_mutex_lock(&pipeline->ctx->mtx);
+    if (deadline)
+    {
+        pipeline->drain_deadline = *deadline;
+    }
+    else
+    {
+        deadline_after_ms(&pipeline->drain_deadline, pipeline->config.shutdown.drain_timeout_ms);
+    }
+    pthread_mutex_unlock(&pipeline->ctx->mtx);
+    pipeline->stopping = 1;
+    CancelContext(pipeline->ctx);
+}
+
+void pipeline_join(Pipeline *pipeline)
+{
+    if (!pipeline->started)
+    {
+        return;
+    }
+    // 拉流线程自己按同一截止时间等待推流和录像线程; 之后检测队列不再有新帧
+    supervised_stage_join(&pipeline->decode, NULL);
+    frame_queue_close(&pipeline->queues[0]);
+    if (supervised_stage_join(&pipeline->detection, &pipeline->drain_deadline) != 0)
+    {
+        log_warn("Stream %s: detection did not drain within the %d ms shutdown timeout, aborting",
+                 pipeline->config.name, pipeline->config.shutdown.drain_timeout_ms);
+        abort_detection(pipeline);
+        supervised_stage_join(&pipeline->detection, NULL);
+    }
+    for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++)
+    {
+        frame_queue_destroy(&pipeline->queues[i]);
+    }
+    destroy_pipeline_context(pipeline);
+    pipeline->started = 0;
+    log_info("Stream %s stopped", pipeline->config.name);
+}
+
+// 重启拉流: 换一个新的上下文, 重新打开推流和录像队列; 检测线程和检测队列保持不变
+static void restart_decode(Pipeline *pipeline)
+{
+    Context *ctx = CreateContext();
+    if (!ctx)
+    {
+        return;
+    }
+    destroy_context(&pipeline->ctx);
+    pipeline->ctx = ctx;
+    pipeline->args.ctx = ctx;
+    frame_queue_reopen(&pipeline->queues[1]);
+    frame_queue_reopen(&pipeline->queues[2]);
+    supervised_stage_start(&pipeline->decode, STAGE_DECODE, &pipeline->config.threads, pull_stream_handler_thread,
+                           &pipeline->args);
+}
+
+void pipeline_supervise(Pipeline *pipeline)
+{
+    const SupervisorConfig *config = &pipeline->config.supervisor;
+    if (!pipeline->started || pipeline->stopping || !config->enabled)
+    {
+        return;
+    }
+    // 拉流停滞(如摄像头不再发送数据)时中断阻塞的读包, 拉流线程退出后重新连接
+    if (supervised_stage_stalled(&pipeline->decode, config))
+    {
+        CancelContext(pipeline->ctx);
+    }
+    if (supervised_stage_due(&pipeline->decode, config))
+    {
+        restart_decode(pipeline);
+    }
+    // 检测线程阻塞在推理服务中时无法安全中断, 停滞只记录; 退出后单独重启
+    supervised_stage_stalled(&pipeline->detection, config);
+    if (supervised_stage_due(&pipeline->detection, config))
+    {
+        supervised_stage_start(&pipeline->detection, STAGE_DETECT, &pipeline->config.threads,
+                               frame_detection_thread, &pipeline->detection_args);
+    }
+}
+
+// 监管线程: 定期检查各路阶段, 重启退出或停滞的阶段
+static void *supervisor_thread(void *arg)
+{
+    PipelineManager *manager = (PipelineManager *)arg;
+    Context *ctx = manager->supervisor_ctx;
+    pthread_mutex_lock(&ctx->mtx);
+    while (!ctx->is_cancelled)
+    {
+        struct timespec deadline;
+        deadline_after_ms(&deadline, SUPERVISOR_INTERVAL_MS);
+        pthread_cond_timedwait(&ctx->cond, &ctx->mtx, &deadline);
+        if (ctx->is_cancelled)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&ctx->mtx);
+        pthread_mutex_lock(&manager->lock);
+        for (int i = 0; i < MAX_STREAMS; i++)
+        {
+            if (manager->pipelines[i])
+            {
+                pipeline_supervise(manager->pipelines[i]);
+            }
+        }
+        pthread_mutex_unlock(&manager->lock);
+        pthread_mutex_lock(&ctx->mtx);
+    }
+    pthread_mutex_unlock(&ctx->mtx);
+    return NULL;
+}
+
+// 队列指标
+typedef enum
+{
+    QUEUE_DEPTH,
+    QUEUE_ENQUEUED,
+    QUEUE_DROPPED,
+} QueueField;
+
+static double queue_value(FrameQueue *queue, QueueField field)
+{
+    switch (field)
+    {
+    case QUEUE_DEPTH:
+        return __atomic_load_n(&queue->size, __ATOMIC_RELAXED);
+    case QUEUE_ENQUEUED:
+        return (double)__atomic_load_n(&queue->enqueued, __ATOMIC_RELAXED);
+    default:
+        return (double)__atomic_load_n(&queue->dropped, __ATOMIC_RELAXED);
+    }
+}
+
+// 输出一个队列指标族: 渲染窗口的队列和各路运行中流水线的队列; locked 为 0 时只输出渲染队列
+static void write_queue_family(MetricsBuffer *out, PipelineManager *manager, int locked, const char *name,
+                               const char *help, MetricType type, QueueField field)
+{
+    metrics_write_header(out, name, help, type);
+    if (manager->video_queue)
+    {
+        metrics_write_sample(out, name, "queue=\"render\"", queue_value(manager->video_queue, field));
+    }
+    if (manager->box_queue)
+    {
+        metrics_write_sample(out, name, "queue=\"render_boxes\"", queue_value(manager->box_queue, field));
+    }
+    for (int i = 0; locked && i < MAX_STREAMS; i++)
+    {
+        Pipeline *pipeline = manager->pipelines[i];
+        if (!pipeline || !pipeline->started)
+        {
+            continue;
+        }
+        for (int q = 0; q < PIPELINE_QUEUE_COUNT; q++)
+        {
+            char labels[128];
+            snprintf(labels, sizeof(labels), "stream=\"%s\",queue=\"%s\"", pipeline->config.name, queue_names[q]);
+            metrics_write_sample(out, name, labels, queue_value(&pipeline->queues[q], field));
+        }
+    }
+}
+
+// 抓取时输出各路的运行状态和队列指标
+static void collect_pipeline_metrics(MetricsBuffer *out, void *arg)
+{
+    PipelineManager *manager = (PipelineManager *)arg;
+    struct timespec deadline;
+    deadline_after_ms(&deadline, METRICS_LOCK_TIMEOUT_MS);
+    int locked = pthread_mutex_timedlock(&manager->lock, &deadline) == 0;
+    if (locked)
+    {
+        const char *name = "pipeline_up";
+        metrics_write_header(out, name, "Whether the stream pipeline is running", METRIC_GAUGE);
+        for (int i = 0; i < MAX_STREAMS; i++)
+        {
+            const Pipeline *pipeline = manager->pipelines[i];
+            if (pipeline)
+            {
+                char labels[96];
+                snprintf(labels, sizeof(labels), "stream=\"%s\"", pipeline->source.name);
+                metrics_write_sample(out, name, labels, pipeline->started);
+            }
+        }
+    }
+    write_queue_family(out, manager, locked, "frame_queue_depth", "Items waiting in the queue", METRIC_GAUGE,
+                       QUEUE_DEPTH);
+    write_queue_family(out, manager, locked, "frame_queue_enqueued_total",
+                       "Items put into the queue since the pipeline started", METRIC_COUNTER, QUEUE_ENQUEUED);
+    write_queue_family(out, manager, locked, "frame_queue_dropped_total",
+                       "Items dropped because the queue was full", METRIC_COUNTER, QUEUE_DROPPED);
+    if (locked)
+    {
+        pthread_mutex_unlock(&manager->lock);
+    }
+}
+
+int pipeline_manager_init(PipelineManager *manager, InferencePool *inference_pool,
+                          FrameQueue *video_queue, FrameQueue *box_queue, const ThreadConfig *threads)
+{
+    memset(manager->pipelines, 0, sizeof(manager->pipelines));
+    manager->inference_pool = inference_pool;
+    manager->video_queue = video_queue;
+    manager->box_queue = box_queue;
+    manager->display[0] = '\0';
+    pthread_mutex_init(&manager->lock, NULL);
+    manager->supervisor_ctx = CreateContext();
+    if (!manager->supervisor_ctx)
+    {
+        log_error("Failed to create supervisor context");
+        pthread_mutex_destroy(&manager->lock);
+        return -1;
+    }
+    if (create_stage_thread(&manager->supervisor_thread, STAGE_BACKGROUND, threads, supervisor_thread, manager) != 0)
+    {
+        log_error("Failed to create supervisor thread");
+        destroy_context(&manager->supervisor_ctx);
+        pthread_mutex_destroy(&manager->lock);
+        return -1;
+    }
+    metrics_register_collector(collect_pipeline_metrics, manager);
+    return 0;
+}
+
+// 按名称查找槽位, 调用方持有 lock
+static int find_slot(PipelineManager *manager, const char *name)
+{
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (manager->pipelines[i] && strcmp(manager->pipelines[i]->source.name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 启动一路, 只有显示的视频流拿到渲染队列; 调用方持有 lock
+static int start_locked(PipelineManager *manager, Pipeline *pipeline)
+{
+    if (pipeline->started)
+    {
+        return 0;
+    }
+    int display = strcmp(manager->display, pipeline->source.name) == 0;
+    return pipeline_start(pipeline, manager->inference_pool, display ? manager->video_queue : NULL,
+                          display ? manager->box_queue : NULL);
+}
+
+// 停止一路; 调用方持有 lock
+static void stop_locked(Pipeline *pipeline)
+{
+    pipeline_cancel(pipeline, NULL);
+    pipeline_join(pipeline);
+}
+
+// 释放已停止的流水线所在槽位, 被删除的是显示中的视频流时, 渲染窗口留给下一路新增的视频流; 调用方持有 lock
+static void release_slot(PipelineManager *manager, int slot)
+{
+    if (strcmp(manager->display, manager->pipelines[slot]->source.name) == 0)
+    {
+        manager->display[0] = '\0';
+    }
+    // 该路的线程已全部退出, 不再有人持有它的指标; 删除后抓取结果中不再出现已删除的视频流
+    char label[96];
+    snprintf(label, sizeof(label), "stream=\"%s\"", manager->pipelines[slot]->source.name);
+    metrics_unregister_label(label);
+    free(manager->pipelines[slot]);
+    manager->pipelines[slot] = NULL;
+}
+
+int pipeline_manager_add(PipelineManager *manager, const StreamConfig *config, int start)
+{
+    pthread_mutex_lock(&manager->lock);
+    int ret = -1;
+    int slot = -1;
+    if (find_slot(manager, config->name) >= 0)
+    {
+        log_error("Stream %s already exists", config->name);
+        pthread_mutex_unlock(&manager->lock);
+        return -1;
+    }
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (!manager->pipelines[i])
+        {
+            slot = i;
+            break;
+        }
+    }
+    Pipeline *pipeline = slot >= 0 ? (Pipeline *)calloc(1, sizeof(Pipeline)) : NULL;
+    if (pipeline)
+    {
+        pipeline->source = *config;
+        manager->pipelines[slot] = pipeline;
+        // 无显示模式下没有渲染队列, 各路都不显示
+        if (!manager->display[0] && manager->video_queue)
+        {
+            snprintf(manager->display, sizeof(manager->display), "%s", config->name);
+        }
+        ret = start ? start_locked(manager, pipeline) : 0;
+    }
+    else
+    {
+        log_error("Failed to add stream %s", config->name);
+    }
+    pthread_mutex_unlock(&manager->lock);
+    return ret;
+}
+
+int pipeline_manager_remove(PipelineManager *manager, const char *name)
+{
+    pthread_mutex_lock(&manager->lock);
+    int slot = find_slot(manager, name);
+    if (slot >= 0)
+    {
+        stop_locked(manager->pipelines[slot]);
+        release_slot(manager, slot);
+    }
+    pthread_mutex_unlock(&manager->lock);
+    return slot >= 0 ? 0 : -1;
+}
+
+int pipeline_manager_start(PipelineManager *manager, const char *name)
+{
+    pthread_mutex_lock(&manager->lock);
+    int slot = find_slot(manager, name);
+    int ret = slot >= 0 ? start_locked(manager, manager->pipelines[slot]) : -1;
+    pthread_mutex_unlock(&manager->lock);
+    return ret;
+}
+
+int pipeline_manager_stop(PipelineManager *manager, const char *name)
+{
+    pthread_mutex_lock(&manager->lock);
+    int slot = find_slot(manager, name);
+    if (slot >= 0)
+    {
+        stop_locked(manager->pipelines[slot]);
+    }
+    pthread_mutex_unlock(&manager->lock);
+    return slot >= 0 ? 0 : -1;
+}
+
+int pipeline_manager_restart(PipelineManager *manager, const char *name)
+{
+    pthread_mutex_lock(&manager->lock);
+    int slot = find_slot(manager, name);
+    int ret = -1;
+    if (slot >= 0)
+    {
+        stop_locked(manager->pipelines[slot]);
+        ret = start_locked(manager, manager->pipelines[slot]);
+    }
+    pthread_mutex_unlock(&manager->lock);
+    return ret;
+}
+
+int pipeline_manager_set(PipelineManager *manager, const char *name, const char *key, const char *value)
+{
+    pthread_mutex_lock(&manager->lock);
+    int slot = find_slot(manager, name);
+    int ret = -1;
+    if (slot >= 0)
+    {
+        Pipeline *pipeline = manager->pipelines[slot];
+        StreamConfig config = pipeline->source;
+        // 不接受把 input_url / output_url 改为空值, 否则重启后拉流或推流阶段反复失败
+        if (config_set_stream_override(&config, key, value) == 0 && config_validate_stream(&config, "control") == 0)
+        {
+            int running = pipeline->started;
+            stop_locked(pipeline);
+            pipeline->source = config;
+            ret = running ? start_locked(manager, pipeline) : 0;
+        }
+    }
+    pthread_mutex_unlock(&manager->lock);
+    return ret;
+}
+
+int pipeline_manager_apply(PipelineManager *manager, const ProcessConfig *process)
+{
+    int ret = 0;
+    // 先删除配置中已不存在的视频流
+    pthread_mutex_lock(&manager->lock);
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        Pipeline *pipeline = manager->pipelines[i];
+        if (!pipeline)
+        {
+            continue;
+        }
+        int found = 0;
+        for (int j = 0; j < process->stream_count; j++)
+        {
+            found |= strcmp(process->streams[j].name, pipeline->source.name) == 0;
+        }
+        if (!found)
+        {
+            log_info("Stream %s removed from config", pipeline->source.name);
+            stop_locked(pipeline);
+            release_slot(manager, i);
+        }
+    }
+    pthread_mutex_unlock(&manager->lock);
+    for (int j = 0; j < process->stream_count; j++)
+    {
+        const StreamConfig *config = &process->streams[j];
+        pthread_mutex_lock(&manager->lock);
+        int slot = find_slot(manager, config->name);
+        if (slot >= 0)
+        {
+            // 两份配置由同样的解析过程生成, 且字符串字段写入时整体清零, 逐字节比较即可判断是否变化
+            Pipeline *pipeline = manager->pipelines[slot];
+            if (memcmp(&pipeline->source, config, sizeof(StreamConfig)) != 0)
+            {
+                log_info("Stream %s config changed, restarting", config->name);
+                stop_locked(pipeline);
+                pipeline->source = *config;
+                ret |= start_locked(manager, pipeline);
+            }
+            pthread_mutex_unlock(&manager->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&manager->lock);
+        ret |= pipeline_manager_add(manager, config, 1);
+    }
+    return ret;
+}
+
+void pipeline_manager_list(PipelineManager *manager, char *buffer, size_t size)
+{
+    size_t used = 0;
+    buffer[0] = '\0';
+    pthread_mutex_lock(&manager->lock);
+    for (int i = 0; i < MAX_STREAMS && used < size; i++)
+    {
+        const Pipeline *pipeline = manager->pipelines[i];
+        if (!pipeline)
+        {
+            continue;
+        }
+        int n = snprintf(buffer + used, size - used, "%s %s%s %s %s restarts=%d\n", pipeline->source.name,
+                         pipeline->started ? "running" : "stopped",
+                         strcmp(manager->display, pipeline->source.name) == 0 ? ",display" : "",
+                         pipeline->source.input_url, pipeline->source.output_url,
+                         pipeline->decode.restarts + pipeline->detection.restarts);
+        if (n < 0)
+        {
+            break;
+        }
+        used += (size_t)n;
+    }
+    pthread_mutex_unlock(&manager->lock);
+}
+
+void pipeline_manager_destroy(PipelineManager *manager)
+{
+    // 采集函数会拿管理器的锁, 在加锁之前注销
+    metrics_unregister_collector(collect_pipeline_metrics, manager);
+    // 先停止监管, 退出中的阶段不再被重启
+    CancelContext(manager->supervisor_ctx);
+    pthread_join(manager->supervisor_thread, NULL);
+    destroy_context(&manager->supervisor_ctx);
+    pthread_mutex_lock(&manager->lock);
+    // 截止时间只算一次(取各路中最长的 drain_timeout_ms), 各路并行排空, 逐个等待时不再累加
+    int timeout_ms = 0;
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (manager->pipelines[i])
+        {
+            timeout_ms = std::max(timeout_ms, manager->pipelines[i]->config.shutdown.drain_timeout_ms);
+        }
+    }
+    struct timespec deadline;
+    deadline_after_ms(&deadline, timeout_ms);
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (manager->pipelines[i])
+        {
+            pipeline_cancel(manager->pipelines[i], &deadline);
+        }
+    }
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (manager->pipelines[i])
+        {
+            pipeline_join(manager->pipelines[i]);
+            free(manager->pipelines[i]);
+            manager->pipelines[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&manager->lock);
+    pthread_mutex_destroy(&manager->lock);
+}
@@ -28,15 +28,95 @@ extern "C"
 #include "libav_utils.h"
 #include "push_stream_thread.h"
 #include "video_record_thread.h"
+#include "thread_utils.h"
+#include "supervisor.h"
+#include "metrics.h"
 #include "logger.h"
+// 数据包的读出时间按 pts 记录; 解码器有缓存(B 帧、帧级多线程)时据此找到帧对应的读包时间
+#define DEMUX_CLOCK_SIZE 64
+typedef struct
+{
+    int64_t pts[DEMUX_CLOCK_SIZE];
+    uint64_t stamps[DEMUX_CLOCK_SIZE];
+    int next;
+    uint64_t seq; // 下一帧的序号
+} DemuxClock;
+
+static void demux_clock_push(DemuxClock *clock, int64_t pts)
+{
+    if (!latency_trace_enabled() || pts == AV_NOPTS_VALUE)
+    {
+        return;
+    }
+    clock->pts[clock->next] = pts;
+    clock->stamps[clock->next] = trace_now();
+    clock->next = (clock->next + 1) % DEMUX_CLOCK_SIZE;
+}
+
+// realtime 模式: 按数据包时间戳限速, 本地文件按原始帧率读出
+typedef struct
+{
+    int64_t first_us; // 第一个数据包的时间戳(微秒), AV_NOPTS_VALUE 表示尚未开始
+    int64_t start_us; // 读到第一个数据包时的本地时间
+} ReadPacer;
+
+// 等到数据包的时间戳对应的本地时间; 分段休眠, 流水线停止时及时返回
+static void pace_packet(ReadPacer *pacer, const AVPacket *packet, AVRational time_base, const Context *ctx)
+{
+    int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (ts == AV_NOPTS_VALUE)
+    {
+        return;
+    }
+    int64_t ts_us = av_rescale_q(ts, time_base, AV_TIME_BASE_Q);
+    if (pacer->first_us == AV_NOPTS_VALUE)
+    {
+        pacer->first_us = ts_us;
+        pacer->start_us = av_gettime_relative();
+        return;
+    }
+    int64_t due = pacer->start_us + (ts_us - pacer->first_us);
+    int64_t wait;
+    while (!ctx->is_cancelled && (wait = due - av_gettime_relative()) > 0)
+    {
+        av_usleep((unsigned)(wait < 100000 ? wait : 100000));
+    }
+}
+
+// 为解码出的帧建立跟踪记录, 并统计解码耗时
+static void begin_frame_trace(DemuxClock *clock, const AVFrame *frame, FrameTrace *trace)
+{
+    memset(trace, 0, sizeof(FrameTrace));
+    trace->seq = clock->seq++;
+    if (!latency_trace_enabled())
+    {
+        return;
+    }
+    for (int i = 0; i < DEMUX_CLOCK_SIZE && frame->pts != AV_NOPTS_VALUE; i++)
+    {
+        if (clock->stamps[i] && clock->pts[i] == frame->pts)
+        {
+            trace->stamps[TRACE_DEMUX] = clock->stamps[i];
+            break;
+        }
+    }
+    trace_stamp(trace, TRACE_DECODE);
+    trace_record(SPAN_DECODE, trace, TRACE_DEMUX, TRACE_DECODE);
+}
+
 // 克隆帧并加入队列
-void clone_and_enqueue(AVFrame *src_frame, FrameQueue *queue)
+void clone_and_enqueue(AVFrame *src_frame, FrameQueue *queue, const FrameTrace *trace)
 {
     AVFrame *output_frame = av_frame_clone(src_frame);
     QueueItem outputItem;
+    memset(&outputItem, 0, sizeof(QueueItem));
     outputItem.type = ONLY_FRAME;
     outputItem.data = output_frame;
-    memset(outputItem.Boxes, 0, sizeof(outputItem.Boxes));
+    if (trace)
+    {
+        outputItem.trace = *trace;
+        trace_stamp(&outputItem.trace, TRACE_ENQUEUE);
+    }
     if (!enqueue(queue, outputItem))
     {
         av_frame_free(&output_frame);
@@ -68,6 +148,92 @@ void handle_error(const char *message, int ret, AVFormatContext **fmt_ctx, AVPac
     }
     pthread_exit(NULL);
 }
+// 把解码后的帧分发给渲染、推流、录像和检测
+static void dispatch_frame(const ThreadArgs *args, AVFrame *frame, AVRational time_base, DemuxClock *clock,
+                           Metric *decoded)
+{
+    metric_add(decoded, 1);
+    // 解码器不填 time_base, 这里补上, 下游据此把 pts 换算成秒
+    frame->time_base = time_base;
+    FrameTrace trace;
+    begin_frame_trace(clock, frame, &trace);
+    // 不显示的视频流没有渲染队列
+    if (args->video_queue)
+    {
+        clone_and_enqueue(frame, args->video_queue, &trace);
+    }
+    clone_and_enqueue(frame, args->origin_frame_queue, &trace);
+    clone_and_enqueue(frame, args->record_frame_queue, &trace);
+    clone_and_enqueue(frame, args->detection_queue, &trace);
+}
+// 停止拉流后冲刷解码器, 把解码器内缓存的帧也分发出去
+static void flush_decoder(const ThreadArgs *args, AVCodecContext *codec_ctx, AVRational time_base, DemuxClock *clock,
+                          Metric *decoded)
+{
+    if (avcodec_send_packet(codec_ctx, NULL) < 0)
+    {
+        return;
+    }
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+    {
+        return;
+    }
+    while (avcodec_receive_frame(codec_ctx, frame) >= 0)
+    {
+        dispatch_frame(args, frame, time_base, clock, decoded);
+        av_frame_unref(frame);
+    }
+    av_frame_free(&frame);
+}
+// 销毁子线程的上下文
+static void destroy_child_context(Context *ctx)
+{
+    pthread_cond_destroy(&ctx->cond);
+    pthread_mutex_destroy(&ctx->mtx);
+    free(ctx);
+}
+// 推流或录像线程停滞时取消它, 退出后按退避换一个新的上下文重启
+static void supervise_encoder(const ThreadArgs *args, SupervisedStage *stage, ThreadArgs *child_args,
+                              void *(*start_routine)(void *))
+{
+    const SupervisorConfig *config = &args->config->supervisor;
+    if (!config->enabled)
+    {
+        return;
+    }
+    if (supervised_stage_stalled(stage, config))
+    {
+        CancelContext(child_args->ctx);
+    }
+    if (!supervised_stage_due(stage, config))
+    {
+        return;
+    }
+    Context *ctx = CreateContext();
+    if (!ctx)
+    {
+        return;
+    }
+    destroy_child_context(child_args->ctx);
+    child_args->ctx = ctx;
+    supervised_stage_start(stage, STAGE_ENCODE, &args->config->threads, start_routine, child_args);
+}
+// 排空的截止时间: 流水线停止时用 pipeline_cancel 确定的那一个, 拉流自行结束或被监管中断重连时从现在算起
+static void drain_deadline(const ThreadArgs *args, struct timespec *deadline)
+{
+    pthread_mutex_lock(&args->ctx->mtx);
+    int set = args->drain_deadline && args->drain_deadline->tv_sec != 0;
+    if (set)
+    {
+        *deadline = *args->drain_deadline;
+    }
+    pthread_mutex_unlock(&args->ctx->mtx);
+    if (!set)
+    {
+        deadline_after_ms(deadline, args->config->shutdown.drain_timeout_ms);
+    }
+}
 void *pull_stream_handler_thread(void *arg)
 {
     const ThreadArgs *args = (ThreadArgs *)arg;
@@ -75,8 +241,16 @@ void *pull_stream_handler_thread(void *arg)
     AVPacket *origin_packet = NULL;
     AVCodecContext *codec_ctx = NULL;
     int ret;
+    fmt_ctx = avformat_alloc_context();
+    if (!fmt_ctx)
+    {
+        handle_error("Error: Failed to allocate format context", AVERROR(ENOMEM), &fmt_ctx, &origin_packet, &codec_ctx);
+    }
+    // 流水线被停止或拉流停滞时中断阻塞中的打开和读包操作
+    fmt_ctx->interrupt_callback.callback = context_interrupt_callback;
+    fmt_ctx->interrupt_callback.opaque = args->ctx;
     // Open Stream input stream
-    if ((ret = avformat_open_input(&fmt_ctx, args->input_stream_url, NULL, NULL)) < 0)
+    if ((ret = open_input_stream(&fmt_ctx, args->input_stream_url)) < 0)
     {
         handle_error("Error: Could not open Stream stream", ret, &fmt_ctx, &origin_packet, &codec_ctx);
     }
@@ -99,9 +273,10 @@ void *pull_stream_handler_thread(void *arg)
             audio_stream_index = i;
         }
     }
+    // 音频不参与处理, 没有音轨的输入(如本地测试文件、lavfi 测试源)同样可用
     if (audio_stream_index == -1)
     {
-        handle_error("Error: No audio stream found", AVERROR_STREAM_NOT_FOUND, &fmt_ctx, &origin_packet, &codec_ctx);
+        log_info("No audio stream in %s", args->input_stream_url);
     }
     if (video_stream_index == -1)
     {
@@ -136,6 +311,8 @@ void *pull_stream_handler_thread(void *arg)
     {
         handle_error("Error: Failed to copy codec parameters to codec context", ret, &fmt_ctx, &origin_packet, &codec_ctx);
     }
+    // 解码器内部线程数, 内部线程继承本线程的 CPU 亲和性
+    codec_ctx->thread_count = args->config->threads.decoder_threads;
     // Open the codec
     if ((ret = avcodec_open2(codec_ctx, decoder, NULL)) < 0)
     {
@@ -161,54 +338,37 @@ void *pull_stream_handler_thread(void *arg)
     {
         handle_error("Error: Failed to create context", AVERROR(ENOMEM), &fmt_ctx, &origin_packet, &codec_ctx);
     }
-    // 启动保存 MP4 的线程
-    {
-        ThreadArgs record_mp4_thread_args = *args;
-        record_mp4_thread_args.ctx = record_mp4_thread_ctx;
-        record_mp4_thread_args.input_stream = fmt_ctx->streams[video_stream_index];
-        pthread_t record_mp4_thread;
-        AVCodecParameters *params = avcodec_parameters_alloc();
-        if (!params)
-        {
-            handle_error("Error: Failed to allocate codec parameters", AVERROR(ENOMEM), &fmt_ctx, &origin_packet, &codec_ctx);
-        }
-        ret = avcodec_parameters_from_context(params, codec_ctx);
-        if (ret < 0)
-        {
-            avcodec_parameters_free(&params);
-            handle_error("Error: Failed to copy codec parameters", ret, &fmt_ctx, &origin_packet, &codec_ctx);
-        }
-        if (pthread_create(&record_mp4_thread, NULL, save_mp4_handler_thread, (void *)&record_mp4_thread_args) != 0)
-        {
-            avcodec_parameters_free(&params);
-            handle_error("Failed to create save_mp4_handler thread", AVERROR(EAGAIN), &fmt_ctx, &origin_packet, &codec_ctx);
-        }
-        pthread_detach(record_mp4_thread);
-    }
-    // 启动推流的线程
-    {
-        ThreadArgs push_stream_thread_args = *args;
-        push_stream_thread_args.ctx = push_stream_thread_ctx;
-        push_stream_thread_args.input_stream = fmt_ctx->streams[video_stream_index];
-        pthread_t push_stream_thread;
-        AVCodecParameters *params = avcodec_parameters_alloc();
-        if (!params)
-        {
-            handle_error("Error: Failed to allocate codec parameters", AVERROR(ENOMEM), &fmt_ctx, &origin_packet, &codec_ctx);
-        }
-        ret = avcodec_parameters_from_context(params, codec_ctx);
-        if (ret < 0)
-        {
-            avcodec_parameters_free(&params);
-            handle_error("Error: Failed to copy codec parameters", ret, &fmt_ctx, &origin_packet, &codec_ctx);
-        }
-        if (pthread_create(&push_stream_thread, NULL, push_rtmp_handler_thread, (void *)&push_stream_thread_args) != 0)
-        {
-            avcodec_parameters_free(&params);
-            handle_error("Failed to create push_rtmp_handler thread", AVERROR(EAGAIN), &fmt_ctx, &origin_packet, &codec_ctx);
-        }
-        pthread_detach(push_stream_thread);
-    }
+    // 推流和录像线程的参数在本线程栈上, 本线程退出前等待它们结束;
+    // 两者由本线程监管, 退出或停滞时单独重启, 拉流和检测不受影响
+    ThreadArgs record_mp4_thread_args = *args;
+    ThreadArgs push_stream_thread_args = *args;
+    SupervisedStage record_stage;
+    SupervisedStage push_stage;
+    char stage_name[32];
+    snprintf(stage_name, sizeof(stage_name), "%s/record", args->config->name);
+    supervised_stage_init(&record_stage, stage_name);
+    snprintf(stage_name, sizeof(stage_name), "%s/push", args->config->name);
+    supervised_stage_init(&push_stage, stage_name);
+    record_mp4_thread_args.ctx = record_mp4_thread_ctx;
+    record_mp4_thread_args.input_stream = fmt_ctx->streams[video_stream_index];
+    record_mp4_thread_args.health = &record_stage;
+    push_stream_thread_args.ctx = push_stream_thread_ctx;
+    push_stream_thread_args.input_stream = fmt_ctx->streams[video_stream_index];
+    push_stream_thread_args.health = &push_stage;
+    // 创建失败时由 supervise_encoder 按退避重试
+    supervised_stage_start(&record_stage, STAGE_ENCODE, &args->config->threads, save_mp4_handler_thread,
+                           &record_mp4_thread_args);
+    supervised_stage_start(&push_stage, STAGE_ENCODE, &args->config->threads, push_rtmp_handler_thread,
+                           &push_stream_thread_args);
+    DemuxClock demux_clock;
+    memset(&demux_clock, 0, sizeof(DemuxClock));
+    ReadPacer pacer = {AV_NOPTS_VALUE, 0};
+    AVRational video_time_base = fmt_ctx->streams[video_stream_index]->time_base;
+    char labels[96];
+    snprintf(labels, sizeof(labels), "stream=\"%s\"", args->config->name);
+    Metric *decoded = metrics_counter("pipeline_frames_decoded_total", "Frames decoded from the input", labels);
+    Metric *input_bytes = metrics_counter("pipeline_input_bytes_total", "Bytes of video packets read from the input",
+                                          labels);
     // Read frames from the stream
     while (av_read_frame(fmt_ctx, origin_packet) >= 0)
     {
@@ -216,8 +376,17 @@ void *pull_stream_handler_thread(void *arg)
         {
             break;
         }
+        stage_heartbeat(args->health);
+        supervise_encoder(args, &record_stage, &record_mp4_thread_args, save_mp4_handler_thread);
+        supervise_encoder(args, &push_stage, &push_stream_thread_args, push_rtmp_handler_thread);
         if (origin_packet->stream_index == video_stream_index)
         {
+            if (args->config->realtime)
+            {
+                pace_packet(&pacer, origin_packet, video_time_base, args->ctx);
+            }
+            demux_clock_push(&demux_clock, origin_packet->pts);
+            metric_add(input_bytes, origin_packet->size);
             // Send the packet to the decoder
             ret = avcodec_send_packet(codec_ctx, origin_packet);
             if (ret < 0)
@@ -251,28 +420,34 @@ void *pull_stream_handler_thread(void *arg)
             }
             else
             {
-
-                clone_and_enqueue(origin_frame, args->video_queue);
-                clone_and_enqueue(origin_frame, args->origin_frame_queue);
-                clone_and_enqueue(origin_frame, args->record_frame_queue);
-                clone_and_enqueue(origin_frame, args->detection_queue);
+                dispatch_frame(args, origin_frame, video_time_base, &demux_clock, decoded);
             }
             av_frame_free(&origin_frame);
         }
         av_packet_unref(origin_packet);
     }
     log_info( "push_stream_thread ended.");
-    // 取消上下文并销毁互斥锁
-    if (push_stream_thread_ctx)
-    {
-        CancelContext(push_stream_thread_ctx);
-        pthread_mutex_destroy(&push_stream_thread_ctx->mtx);
-    }
-    if (record_mp4_thread_ctx)
+    // 有序停止: 冲刷解码器, 关闭下游队列, 推流和录像线程取完剩余的帧后冲刷编码器并写入文件尾;
+    // 检测队列由流水线在本线程结束后关闭, 拉流重启时检测线程继续运行
+    flush_decoder(args, codec_ctx, video_time_base, &demux_clock, decoded);
+    frame_queue_close(args->origin_frame_queue);
+    frame_queue_close(args->record_frame_queue);
+    struct timespec deadline;
+    drain_deadline(args, &deadline);
+    int push_joined = supervised_stage_join(&push_stage, &deadline) == 0;
+    int record_joined = supervised_stage_join(&record_stage, &deadline) == 0;
+    if (!push_joined || !record_joined)
     {
-        CancelContext(record_mp4_thread_ctx);
-        pthread_mutex_destroy(&record_mp4_thread_ctx->mtx);
+        // 排空超时: 丢弃剩余的帧并中断阻塞的网络写入
+        log_warn("Drain timeout (%dms) reached on %s, dropping queued frames",
+                 args->config->shutdown.drain_timeout_ms, args->input_stream_url);
+        CancelContext(push_stream_thread_args.ctx);
+        CancelContext(record_mp4_thread_args.ctx);
     }
+    supervised_stage_join(&push_stage, NULL);
+    supervised_stage_join(&record_stage, NULL);
+    destroy_child_context(push_stream_thread_args.ctx);
+    destroy_child_context(record_mp4_thread_args.ctx);
     // 释放资源
     avcodec_free_context(&codec_ctx);
     av_packet_free(&origin_packet);
@@ -16,6 +16,8 @@
 #include "push_stream_thread.h"
 #include "libav_utils.h"
 #include "logger.h"
+#include "supervisor.h"
+#include "metrics.h"
 // 初始化 RTMP 流上下文
 int init_rtmp_stream(RtmpStreamContext *ctx, const char *output_url, int width, int height, int fps)
 {
@@ -28,12 +30,18 @@ int init_rtmp_stream(RtmpStreamContext *ctx, const char *output_url, int width,
     log_info( "init_rtmp_stream === output_url=%s,width=%d,height=%d,fps=%d",
                 output_url, width, height, fps);
     // 创建输出上下文
-    int ret = avformat_alloc_output_context2(&ctx->output_ctx, NULL, "flv", output_url);
+    int ret = avformat_alloc_output_context2(&ctx->output_ctx, NULL, output_format_name(output_url), output_url);
     if (ret < 0 || !ctx->output_ctx)
     {
         log_info( "Failed to create output context: %s", get_av_error(ret));
         return -1;
     }
+    // 取消后中断阻塞的网络写入, 推流停滞时监管方可以让本线程退出
+    if (ctx->interrupt_ctx)
+    {
+        ctx->output_ctx->interrupt_callback.callback = context_interrupt_callback;
+        ctx->output_ctx->interrupt_callback.opaque = ctx->interrupt_ctx;
+    }
     // 查找编码器
     const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
     if (!codec)
@@ -82,6 +90,7 @@ int init_rtmp_stream(RtmpStreamContext *ctx, const char *output_url, int width,
         goto cleanup_codec_context;
     }
     // 打开编码器
+    ctx->codec_ctx->thread_count = ctx->thread_count;
     ret = avcodec_open2(ctx->codec_ctx, codec, NULL);
     if (ret < 0)
     {
@@ -91,7 +100,7 @@ int init_rtmp_stream(RtmpStreamContext *ctx, const char *output_url, int width,
     // 打开网络输出
     if (!(ctx->output_ctx->oformat->flags & AVFMT_NOFILE))
     {
-        ret = avio_open(&ctx->output_ctx->pb, output_url, AVIO_FLAG_WRITE);
+        ret = avio_open2(&ctx->output_ctx->pb, output_url, AVIO_FLAG_WRITE, &ctx->output_ctx->interrupt_callback, NULL);
         if (ret < 0)
         {
             log_info( "Failed to open output URL: %s", get_av_error(ret));
@@ -118,15 +127,15 @@ cleanup_output_context:
     return -1;
 }
 // 优化后的 push_stream 函数
-void push_stream(RtmpStreamContext *ctx, AVFrame *frame)
+void push_stream(RtmpStreamContext *ctx, AVFrame *frame, FrameTrace *trace)
 {
-    if (!ctx || !frame)
+    if (!ctx || !ctx->codec_ctx)
     {
-        log_info( "Invalid input parameters: RtmpStreamContext or AVFrame is NULL");
+        log_info( "Invalid input parameters: RtmpStreamContext is NULL");
         return;
     }
     int ret = 0;
-    // 发送帧到编码器
+    // 发送帧到编码器, frame 为 NULL 时进入冲刷模式, 取出编码器内缓存的全部数据包
     ret = avcodec_send_frame(ctx->codec_ctx, frame);
     if (ret < 0)
     {
@@ -153,6 +162,11 @@ void push_stream(RtmpStreamContext *ctx, AVFrame *frame)
             log_info( "Error encoding frame: %s", get_av_error(ret));
             break;
         }
+        // 低延迟编码时数据包对应刚送入的帧
+        if (trace && !trace->stamps[TRACE_ENCODE])
+        {
+            trace_stamp(trace, TRACE_ENCODE);
+        }
 
         av_packet_rescale_ts(pkt, ctx->input_stream->time_base, ctx->video_stream->time_base);
         ret = av_interleaved_write_frame(ctx->output_ctx, pkt);
@@ -160,6 +174,10 @@ void push_stream(RtmpStreamContext *ctx, AVFrame *frame)
         {
             log_info( "Error writing packet: %d, %s", ret, get_av_error(ret));
         }
+        else
+        {
+            trace_stamp(trace, TRACE_MUX);
+        }
         // 释放数据包
         av_packet_unref(pkt);
     }
@@ -174,30 +192,47 @@ void *push_rtmp_handler_thread(void *arg)
     RtmpStreamContext ctx;
     memset(&ctx, 0, sizeof(RtmpStreamContext));
     ctx.input_stream = args->input_stream;
+    ctx.thread_count = args->config->threads.encoder_threads;
+    ctx.interrupt_ctx = args->ctx;
     // 初始化输出流
     if (init_rtmp_stream(&ctx, args->output_stream_url, 1920, 1080, 25) < 0)
     {
         log_info( "Failed to initialize RTMP stream");
         return NULL;
     }
+    char labels[128];
+    snprintf(labels, sizeof(labels), "stream=\"%s\",output=\"push\"", args->config->name);
+    Metric *encoded = metrics_counter("pipeline_frames_encoded_total", "Frames sent to the encoder", labels);
 
     // Main processing loop
-    while (1)
+    while (!args->ctx->is_cancelled)
     {
         QueueItem item;
         memset(&item, 0, sizeof(QueueItem));
 
-        if (dequeue(args->origin_frame_queue, &item))
+        // 拉流线程停止后关闭队列, 取完剩余的帧后退出
+        stage_wait(args->health);
+        if (!dequeue(args->origin_frame_queue, &item))
+        {
+            break;
+        }
+        stage_heartbeat(args->health);
+        trace_stamp(&item.trace, TRACE_DEQUEUE);
+        trace_record(SPAN_QUEUE_PUSH, &item.trace, TRACE_ENQUEUE, TRACE_DEQUEUE);
+        if (item.type == ONLY_FRAME && item.data)
         {
-            if (item.type == ONLY_FRAME && item.data)
-            {
-                AVFrame *frame = (AVFrame *)item.data;
-                push_stream(&ctx, frame);
-                av_frame_free(&frame);
-            }
+            AVFrame *frame = (AVFrame *)item.data;
+            push_stream(&ctx, frame, &item.trace);
+            metric_add(encoded, 1);
+            trace_record(SPAN_PUSH_ENCODE, &item.trace, TRACE_DEQUEUE, TRACE_ENCODE);
+            trace_record(SPAN_PUSH_MUX, &item.trace, TRACE_ENCODE, TRACE_MUX);
+            trace_record(SPAN_E2E_PUSH, &item.trace, TRACE_DEMUX, TRACE_MUX);
+            trace_report_slow(args->config->name, &item.trace, TRACE_MUX);
+            av_frame_free(&frame);
         }
     }
     log_info( "push_rtmp_handler_thread exit");
+    push_stream(&ctx, NULL, NULL);
     av_write_trailer(ctx.output_ctx);
     avcodec_free_context(&ctx.codec_ctx);
     avio_closep(&ctx.output_ctx->pb);
@@ -0,0 +1,303 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "rate_controller.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <algorithm>
+#include "logger.h"
+
+// 相邻两帧时间戳间隔超过该值时不计入帧率估计
+#define MAX_FRAME_GAP_SECONDS 5.0
+
+// 全局状态, 所有摄像头共享
+static RateControlConfig global_config;
+static RateStream streams[MAX_RATE_STREAMS];
+static pthread_mutex_t rate_lock = PTHREAD_MUTEX_INITIALIZER;
+static double budget_ms;        // 每秒允许花在推理上的时间(毫秒)
+static double last_update_time; // 上次重新分配的时间
+static double last_cpu_load = -1;
+static unsigned long long last_cpu_total;
+static unsigned long long last_cpu_idle;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 读取 /proc/stat 计算自上次调用以来的整机 CPU 占用率, 失败返回 -1
+static double read_cpu_load()
+{
+    FILE *file = fopen("/proc/stat", "r");
+    if (!file)
+    {
+        return -1;
+    }
+    unsigned long long user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+    int n = fscanf(file, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+    fclose(file);
+    if (n < 4)
+    {
+        return -1;
+    }
+    unsigned long long total = user + nice + system + idle + iowait + irq + softirq + steal;
+    unsigned long long idle_all = idle + iowait;
+    double load = -1;
+    if (last_cpu_total > 0 && total > last_cpu_total)
+    {
+        load = 1.0 - (double)(idle_all - last_cpu_idle) / (total - last_cpu_total);
+    }
+    last_cpu_total = total;
+    last_cpu_idle = idle_all;
+    return load;
+}
+
+// 每路的最大步长: 保证不低于最低检测帧率
+static int max_stride(const RateStream *stream)
+{
+    if (stream->fps <= 0 || stream->config.min_fps <= 0)
+    {
+        return 1;
+    }
+    return std::max(1, (int)(stream->fps / stream->config.min_fps));
+}
+
+// 按 CPU 余量调整总预算, 再按权重把预算分给各路; 调用方持有 rate_lock
+static void rebalance(double now)
+{
+    last_update_time = now;
+    double load = read_cpu_load();
+    if (load >= 0)
+    {
+        last_cpu_load = load;
+    }
+    double rates[MAX_RATE_STREAMS];
+    double weights[MAX_RATE_STREAMS];
+    int capped[MAX_RATE_STREAMS];
+    double min_cost = 0, max_cost = 0;
+    for (int i = 0; i < MAX_RATE_STREAMS; i++)
+    {
+        RateStream *s = &streams[i];
+        capped[i] = 1;
+        if (!s->active || s->fps <= 0 || s->latency_ms <= 0)
+        {
+            continue;
+        }
+        // 先满足每路的最低检测帧率
+        rates[i] = std::min((double)s->config.min_fps, s->fps);
+        min_cost += rates[i] * s->latency_ms;
+        max_cost += s->fps * s->latency_ms;
+        int boosted = s->last_hit_time > 0 && now - s->last_hit_time < s->config.boost_seconds;
+        weights[i] = boosted ? s->config.boost_factor : 1.0;
+        capped[i] = rates[i] >= s->fps;
+    }
+    if (max_cost <= 0)
+    {
+        return;
+    }
+    // CPU 占用高于目标时缩减预算, 低于时放宽; 上限为全部摄像头逐帧推理的开销, 避免积分饱和
+    if (budget_ms <= 0)
+    {
+        budget_ms = 1000.0 * global_config.target_load;
+    }
+    if (load > 0)
+    {
+        budget_ms *= std::min(1.25, std::max(0.8, global_config.target_load / load));
+    }
+    budget_ms = std::max(min_cost, std::min(budget_ms, max_cost));
+    // 剩余预算按权重分配, 到达输入帧率的摄像头把多余的份额让给其他摄像头
+    double remaining = budget_ms - min_cost;
+    for (int pass = 0; pass < MAX_RATE_STREAMS && remaining > 1e-6; pass++)
+    {
+        double total_weight = 0;
+        for (int i = 0; i < MAX_RATE_STREAMS; i++)
+        {
+            if (!capped[i])
+            {
+                total_weight += weights[i];
+            }
+        }
+        if (total_weight <= 0)
+        {
+            break;
+        }
+        double spent = 0;
+        int newly_capped = 0;
+        for (int i = 0; i < MAX_RATE_STREAMS; i++)
+        {
+            if (capped[i])
+            {
+                continue;
+            }
+            RateStream *s = &streams[i];
+            double share = remaining * weights[i] / total_weight;
+            double rate = rates[i] + share / s->latency_ms;
+            if (rate >= s->fps)
+            {
+                spent += (s->fps - rates[i]) * s->latency_ms;
+                rates[i] = s->fps;
+                capped[i] = 1;
+                newly_capped = 1;
+            }
+            else
+            {
+                rates[i] = rate;
+                spent += share;
+            }
+        }
+        remaining -= spent;
+        if (!newly_capped)
+        {
+            break;
+        }
+    }
+    for (int i = 0; i < MAX_RATE_STREAMS; i++)
+    {
+        RateStream *s = &streams[i];
+        if (!s->active || s->fps <= 0 || s->latency_ms <= 0)
+        {
+            continue;
+        }
+        int stride = (int)ceil(s->fps / rates[i] - 1e-6);
+        s->stride = std::max(1, std::min(stride, max_stride(s)));
+    }
+}
+
+void rate_controller_init(const RateControlConfig *config)
+{
+    pthread_mutex_lock(&rate_lock);
+    global_config = *config;
+    budget_ms = 1000.0 * config->target_load;
+    last_update_time = now_seconds();
+    read_cpu_load();
+    pthread_mutex_unlock(&rate_lock);
+}
+
+RateStream *rate_controller_register(const char *name, const RateControlConfig *config, int fallback_stride)
+{
+    RateStream *stream = NULL;
+    pthread_mutex_lock(&rate_lock);
+    for (int i = 0; i < MAX_RATE_STREAMS; i++)
+    {
+        if (!streams[i].active)
+        {
+            stream = &streams[i];
+            memset(stream, 0, sizeof(RateStream));
+            snprintf(stream->name, sizeof(stream->name), "%s", name);
+            stream->config = *config;
+            stream->fallback_stride = fallback_stride > 0 ? fallback_stride : 1;
+            stream->stride = stream->fallback_stride;
+            // 第一帧总是推理
+            stream->frames_since_detect = stream->stride;
+            stream->active = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rate_lock);
+    if (!stream)
+    {
+        log_error("Rate controller is full, stream %s is not registered", name);
+    }
+    return stream;
+}
+
+void rate_controller_unregister(RateStream *stream)
+{
+    if (!stream)
+    {
+        return;
+    }
+    pthread_mutex_lock(&rate_lock);
+    stream->active = 0;
+    pthread_mutex_unlock(&rate_lock);
+}
+
+int rate_controller_should_detect(RateStream *stream, double timestamp)
+{
+    if (!stream)
+    {
+        return 1;
+    }
+    pthread_mutex_lock(&rate_lock);
+    double now = now_seconds();
+    // 按帧时间戳的间隔估计输入帧率, 检测线程排队或卡顿不会拉低估计;
+    // 间隔过大视为断流重连或时间戳跳变, 只更新基准不计入估计
+    double frame_time = timestamp >= 0 ? timestamp : now;
+    double delta = frame_time - stream->last_frame_time;
+    if (stream->frames_total > 0 && delta > 0 && delta < MAX_FRAME_GAP_SECONDS)
+    {
+        double instant = 1.0 / delta;
+        stream->fps = stream->fps > 0 ? stream->fps * 0.95 + instant * 0.05 : instant;
+    }
+    stream->last_frame_time = frame_time;
+    stream->frames_total++;
+    if (global_config.enabled && now - last_update_time >= global_config.update_interval_ms / 1000.0)
+    {
+        rebalance(now);
+    }
+    int stride = global_config.enabled ? stream->stride : stream->fallback_stride;
+    int detect = ++stream->frames_since_detect >= stride;
+    if (detect)
+    {
+        stream->frames_since_detect = 0;
+        stream->frames_detected++;
+    }
+    pthread_mutex_unlock(&rate_lock);
+    return detect;
+}
+
+void rate_controller_report(RateStream *stream, double latency_ms, int detections)
+{
+    if (!stream)
+    {
+        return;
+    }
+    pthread_mutex_lock(&rate_lock);
+    if (latency_ms >= 0)
+    {
+        stream->latency_ms = stream->latency_ms > 0 ? stream->latency_ms * 0.8 + latency_ms * 0.2 : latency_ms;
+    }
+    if (detections > 0)
+    {
+        stream->last_hit_time = now_seconds();
+    }
+    pthread_mutex_unlock(&rate_lock);
+}
+
+void rate_controller_dump_stats()
+{
+    pthread_mutex_lock(&rate_lock);
+    log_info("Rate controller: enabled=%d, budget=%.0fms/s, cpu_load=%.2f, target_load=%.2f",
+             global_config.enabled, budget_ms, last_cpu_load, global_config.target_load);
+    for (int i = 0; i < MAX_RATE_STREAMS; i++)
+    {
+        const RateStream *s = &streams[i];
+        if (!s->active)
+        {
+            continue;
+        }
+        int stride = global_config.enabled ? s->stride : s->fallback_stride;
+        log_info("  %s: input=%.1ffps, latency=%.1fms, stride=%d, detect=%.2ffps, frames=%llu, detected=%llu",
+                 s->name, s->fps, s->latency_ms, stride, stride > 0 ? s->fps / stride : 0,
+                 (unsigned long long)s->frames_total, (unsigned long long)s->frames_detected);
+    }
+    pthread_mutex_unlock(&rate_lock);
+}
@@ -0,0 +1,101 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "roi.h"
+#include <algorithm>
+
+// 归一化多边形转换为像素坐标
+static std::vector<cv::Point2f> polygon_to_pixels(const RoiPolygon *polygon, int width, int height)
+{
+    std::vector<cv::Point2f> points(polygon->count);
+    for (int i = 0; i < polygon->count; i++)
+    {
+        points[i] = cv::Point2f(polygon->x[i] * width, polygon->y[i] * height);
+    }
+    return points;
+}
+
+void roi_compute_crops(const RoiConfig *roi, int width, int height, std::vector<cv::Rect> &crops)
+{
+    crops.clear();
+    cv::Rect frame_rect(0, 0, width, height);
+    for (int i = 0; i < roi->include_count; i++)
+    {
+        cv::Rect rect = cv::boundingRect(polygon_to_pixels(&roi->include[i], width, height)) & frame_rect;
+        if (rect.area() > 0)
+        {
+            crops.push_back(rect);
+        }
+    }
+    // 合并相互重叠的矩形, 避免同一目标在两个裁剪区域中重复检测
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (size_t i = 0; i < crops.size() && !merged; i++)
+        {
+            for (size_t j = i + 1; j < crops.size(); j++)
+            {
+                if ((crops[i] & crops[j]).area() > 0)
+                {
+                    crops[i] = crops[i] | crops[j];
+                    crops.erase(crops.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void roi_filter_detections(const RoiConfig *roi, int width, int height, std::vector<Box> &boxes)
+{
+    if (roi->include_count == 0 && roi->exclude_count == 0)
+    {
+        return;
+    }
+    std::vector<std::vector<cv::Point2f>> include, exclude;
+    for (int i = 0; i < roi->include_count; i++)
+    {
+        include.push_back(polygon_to_pixels(&roi->include[i], width, height));
+    }
+    for (int i = 0; i < roi->exclude_count; i++)
+    {
+        exclude.push_back(polygon_to_pixels(&roi->exclude[i], width, height));
+    }
+    boxes.erase(std::remove_if(boxes.begin(), boxes.end(),
+                               [&](const Box &box)
+                               {
+                                   cv::Point2f center(box.x + box.w / 2.0f, box.y + box.h / 2.0f);
+                                   bool inside = include.empty();
+                                   for (const auto &polygon : include)
+                                   {
+                                       if (cv::pointPolygonTest(polygon, center, false) >= 0)
+                                       {
+                                           inside = true;
+                                           break;
+                                       }
+                                   }
+                                   for (const auto &polygon : exclude)
+                                   {
+                                       if (cv::pointPolygonTest(polygon, center, false) >= 0)
+                                       {
+                                           return true;
+                                       }
+                                   }
+                                   return !inside;
+                               }),
+                boxes.end());
+}
@@ -16,6 +16,7 @@
 #include "sdl_utils.h"
 #include "frame_queue.h"
 #include "logger.h"
+#include <string.h>
 void NV12ToRGB(uint8_t *y_plane, uint8_t *uv_plane, int width,
                int height, int y_pitch, int uv_pitch, uint8_t *rgb_buffer)
 {
@@ -90,71 +91,151 @@ void SDLDisplayNV12Frame(SDL_Renderer *renderer, SDL_Texture *texture, AVFrame *
     free(rgb_buffer);
 }
 
+int glyph_atlas_init(GlyphAtlas *atlas, SDL_Renderer *renderer, TTF_Font *font)
+{
+    memset(atlas, 0, sizeof(GlyphAtlas));
+    atlas->height = TTF_FontHeight(font);
+    // 先排版: 按前进量依次排列, 超过最大宽度换行
+    SDL_Surface *glyph_surfaces[GLYPH_ATLAS_COUNT];
+    int pen_x = 0, pen_y = 0, atlas_width = 0;
+    for (int i = 0; i < GLYPH_ATLAS_COUNT; i++)
+    {
+        Uint16 ch = (Uint16)(GLYPH_ATLAS_FIRST + i);
+        SDL_Color white = {255, 255, 255, 255};
+        int minx, maxx, miny, maxy;
+        glyph_surfaces[i] = TTF_RenderGlyph_Blended(font, ch, white);
+        if (TTF_GlyphMetrics(font, ch, &minx, &maxx, &miny, &maxy, &atlas->advance[i]) != 0)
+        {
+            atlas->advance[i] = glyph_surfaces[i] ? glyph_surfaces[i]->w : 0;
+        }
+        int w = glyph_surfaces[i] ? glyph_surfaces[i]->w : 0;
+        if (pen_x + w > GLYPH_ATLAS_MAX_WIDTH)
+        {
+            pen_x = 0;
+            pen_y += atlas->height;
+        }
+        atlas->glyphs[i].x = pen_x;
+        atlas->glyphs[i].y = pen_y;
+        atlas->glyphs[i].w = w;
+        atlas->glyphs[i].h = glyph_surfaces[i] ? glyph_surfaces[i]->h : 0;
+        pen_x += w;
+        atlas_width = pen_x > atlas_width ? pen_x : atlas_width;
+    }
+    int ret = -1;
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, atlas_width > 0 ? atlas_width : 1,
+                                                          pen_y + atlas->height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!surface)
+    {
+        log_info( "Failed to create glyph atlas surface: %s", SDL_GetError());
+    }
+    else
+    {
+        // 整张透明, 字形按原样(含 alpha)拷入
+        SDL_FillRect(surface, NULL, SDL_MapRGBA(surface->format, 0, 0, 0, 0));
+        for (int i = 0; i < GLYPH_ATLAS_COUNT; i++)
+        {
+            if (glyph_surfaces[i])
+            {
+                SDL_SetSurfaceBlendMode(glyph_surfaces[i], SDL_BLENDMODE_NONE);
+                SDL_BlitSurface(glyph_surfaces[i], NULL, surface, &atlas->glyphs[i]);
+            }
+        }
+        atlas->texture = SDL_CreateTextureFromSurface(renderer, surface);
+        if (!atlas->texture)
+        {
+            log_info( "Failed to create glyph atlas texture: %s", SDL_GetError());
+        }
+        else
+        {
+            SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+            ret = 0;
+        }
+        SDL_FreeSurface(surface);
+    }
+    for (int i = 0; i < GLYPH_ATLAS_COUNT; i++)
+    {
+        if (glyph_surfaces[i])
+        {
+            SDL_FreeSurface(glyph_surfaces[i]);
+        }
+    }
+    return ret;
+}
+
+void glyph_atlas_destroy(GlyphAtlas *atlas)
+{
+    if (atlas->texture)
+    {
+        SDL_DestroyTexture(atlas->texture);
+        atlas->texture = NULL;
+    }
+}
+
+// 字符在图集中的序号, 图集外的字符用 '?'
+static int glyph_index(char c)
+{
+    int index = (unsigned char)c - GLYPH_ATLAS_FIRST;
+    return index >= 0 && index < GLYPH_ATLAS_COUNT ? index : '?' - GLYPH_ATLAS_FIRST;
+}
+
+int glyph_atlas_text_width(const GlyphAtlas *atlas, const char *text)
+{
+    int width = 0;
+    for (const char *p = text; *p; p++)
+    {
+        width += atlas->advance[glyph_index(*p)];
+    }
+    return width;
+}
+
+void glyph_atlas_draw(GlyphAtlas *atlas, SDL_Renderer *renderer, const char *text, int x, int y, SDL_Color color)
+{
+    if (!atlas->texture)
+    {
+        return;
+    }
+    SDL_SetTextureColorMod(atlas->texture, color.r, color.g, color.b);
+    SDL_SetTextureAlphaMod(atlas->texture, color.a);
+    int pen_x = x;
+    for (const char *p = text; *p; p++)
+    {
+        int index = glyph_index(*p);
+        const SDL_Rect *src = &atlas->glyphs[index];
+        if (src->w > 0)
+        {
+            SDL_Rect dst = {pen_x, y, src->w, src->h};
+            SDL_RenderCopy(renderer, atlas->texture, src, &dst);
+        }
+        pen_x += atlas->advance[index];
+    }
+}
+
 // 绘制文本
 // @param renderer 渲染器
-// @param texture 纹理
+// @param atlas 字形图集
 // @param text 文本
 // @param x 文本的x坐标
 // @param y 文本的y坐标
-void SDLDrawText(SDL_Renderer *renderer, SDL_Texture *texture, TTF_Font *font, const char *text, int x, int y)
+void SDLDrawText(SDL_Renderer *renderer, GlyphAtlas *atlas, const char *text, int x, int y)
 {
     // 设置文本颜色
     SDL_Color textColor = {255, 0, 0, 255};
-    // 创建文本表面
-    SDL_Surface *textSurface = TTF_RenderText_Solid(font, text, textColor);
-    if (textSurface == NULL)
-    {
-        log_info( "Failed to render text: %s", TTF_GetError());
-        return;
-    }
-    // 创建纹理
-    SDL_Texture *textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    if (textTexture == NULL)
-    {
-        log_info( "Failed to create texture from surface: %s", SDL_GetError());
-        SDL_FreeSurface(textSurface);
-        return;
-    }
-    // 绘制文本
-    SDL_Rect textRect = {x, y, textSurface->w, textSurface->h};
-    SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-    // 释放资源
-    SDL_FreeSurface(textSurface);
-    SDL_DestroyTexture(textTexture);
+    glyph_atlas_draw(atlas, renderer, text, x, y, textColor);
 }
 // 绘制标签
-void SDLDrawLabel(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x, int y, SDL_Color textColor, SDL_Color backgroundColor)
+void SDLDrawLabel(SDL_Renderer *renderer, GlyphAtlas *atlas, const char *text, int x, int y, SDL_Color textColor, SDL_Color backgroundColor)
 {
-    // 创建文本表面
-    SDL_Surface *textSurface = TTF_RenderText_Solid(font, text, textColor);
-    if (!textSurface)
-    {
-        log_info( "Unable to render text surface! SDL_ttf Error: %s", TTF_GetError());
-        return;
-    }
     // 创建一个矩形作为背景
-    SDL_Rect backgroundRect = {x, y, textSurface->w, textSurface->h};
+    SDL_Rect backgroundRect = {x, y, glyph_atlas_text_width(atlas, text), atlas->height};
 
     // 绘制背景色
     SDL_SetRenderDrawColor(renderer, backgroundColor.r, backgroundColor.g, backgroundColor.b, backgroundColor.a);
     SDL_RenderFillRect(renderer, &backgroundRect);
-    // 创建一个纹理用于渲染文本
-    SDL_Texture *textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    SDL_FreeSurface(textSurface);
-
-    if (!textTexture)
-    {
-        log_info( "Unable to create texture from rendered text! SDL_Error: %s", SDL_GetError());
-        return;
-    }
-
     // 绘制文本
-    SDL_Rect textRect = {x, y, textSurface->w, textSurface->h};
-    SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-    SDL_DestroyTexture(textTexture);
+    glyph_atlas_draw(atlas, renderer, text, x, y, textColor);
 }
 
-void SDLDrawBox(SDL_Renderer *renderer, TTF_Font *font, const char *text,
+void SDLDrawBox(SDL_Renderer *renderer, GlyphAtlas *atlas, const char *text,
                 int x, int y, int w, int h, int thickness)
 {
     // Draw the rectangle with the specified thickness
@@ -179,20 +260,8 @@ void SDLDrawBox(SDL_Renderer *renderer, TTF_Font *font, const char *text,
     // Render text above the rectangle
     if (text != NULL)
     {
-        SDL_Color textColor = {255, 0, 0, 0};
-        SDL_Surface *textSurface = TTF_RenderText_Solid(font, text, textColor);
-        SDL_Texture *textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-
-        SDL_Rect textRect;
-        textRect.x = x;
-        textRect.y = y - 24;
-        textRect.w = textSurface->w;
-        textRect.h = textSurface->h;
-
-        SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-
-        SDL_FreeSurface(textSurface);
-        SDL_DestroyTexture(textTexture);
+        SDL_Color textColor = {255, 0, 0, 255};
+        glyph_atlas_draw(atlas, renderer, text, x, y - 24, textColor);
     }
 }
 void RenderBox(SDL_Renderer *renderer, Box *box)
@@ -0,0 +1,196 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "supervisor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "thread_utils.h"
+#include "logger.h"
+
+static double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void supervised_stage_init(SupervisedStage *stage, const char *name)
+{
+    memset(stage, 0, sizeof(SupervisedStage));
+    snprintf(stage->name, sizeof(stage->name), "%s", name);
+    // "cam1/decode" 拆为 stream 和 stage 两个标签
+    char labels[96];
+    const char *slash = strrchr(name, '/');
+    if (slash)
+    {
+        snprintf(labels, sizeof(labels), "stream=\"%.*s\",stage=\"%s\"", (int)(slash - name), name, slash + 1);
+    }
+    else
+    {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", name);
+    }
+    stage->restarts_total = metrics_counter("pipeline_stage_restarts_total",
+                                            "Stage restarts after the thread exited, including stream reconnects",
+                                            labels);
+    stage->stalls_total = metrics_counter("pipeline_stage_stalls_total", "Stages that stopped making progress", labels);
+}
+
+typedef struct
+{
+    SupervisedStage *stage;
+    void *(*start_routine)(void *);
+    void *arg;
+} SupervisedStart;
+
+static void mark_exited(void *arg)
+{
+    ((SupervisedStage *)arg)->running = 0;
+}
+
+static void *supervised_entry(void *arg)
+{
+    SupervisedStart start = *(SupervisedStart *)arg;
+    free(arg);
+    void *ret = NULL;
+    // 线程函数中的 pthread_exit 也会执行清理函数
+    pthread_cleanup_push(mark_exited, start.stage);
+    ret = start.start_routine(start.arg);
+    pthread_cleanup_pop(1);
+    return ret;
+}
+
+int supervised_stage_start(SupervisedStage *stage, PipelineStage pipeline_stage, const ThreadConfig *config,
+                           void *(*start_routine)(void *), void *arg)
+{
+    double now = monotonic_seconds();
+    stage->started_at = now;
+    stage->last_beat = now;
+    stage->restart_at = 0;
+    stage->idle = 0;
+    stage->stalled = 0;
+    SupervisedStart *start = (SupervisedStart *)malloc(sizeof(SupervisedStart));
+    if (!start)
+    {
+        return -1;
+    }
+    start->stage = stage;
+    start->start_routine = start_routine;
+    start->arg = arg;
+    stage->running = 1;
+    if (create_stage_thread(&stage->thread, pipeline_stage, config, supervised_entry, start) != 0)
+    {
+        stage->running = 0;
+        free(start);
+        log_error("Failed to create %s thread", stage->name);
+        return -1;
+    }
+    stage->joinable = 1;
+    return 0;
+}
+
+void stage_heartbeat(SupervisedStage *stage)
+{
+    if (!stage)
+    {
+        return;
+    }
+    stage->last_beat = monotonic_seconds();
+    stage->idle = 0;
+    stage->stalled = 0;
+}
+
+void stage_wait(SupervisedStage *stage)
+{
+    if (!stage)
+    {
+        return;
+    }
+    stage->last_beat = monotonic_seconds();
+    stage->idle = 1;
+}
+
+int supervised_stage_stalled(SupervisedStage *stage, const SupervisorConfig *config)
+{
+    if (!stage->running || stage->idle || stage->stalled || config->stall_timeout_ms <= 0)
+    {
+        return 0;
+    }
+    double silent_ms = (monotonic_seconds() - stage->last_beat) * 1000.0;
+    if (silent_ms < config->stall_timeout_ms)
+    {
+        return 0;
+    }
+    stage->stalled = 1;
+    metric_add(stage->stalls_total, 1);
+    log_warn("Stage %s stalled: no progress for %.0f ms", stage->name, silent_ms);
+    return 1;
+}
+
+int supervised_stage_due(SupervisedStage *stage, const SupervisorConfig *config)
+{
+    if (stage->running)
+    {
+        return 0;
+    }
+    supervised_stage_join(stage, NULL);
+    double now = monotonic_seconds();
+    if (stage->restart_at == 0)
+    {
+        // 稳定运行过一段时间的阶段从头开始退避, 频繁失败的阶段等待时间加倍
+        if (stage->backoff_ms <= 0 || (now - stage->started_at) * 1000.0 >= config->backoff_max_ms)
+        {
+            stage->backoff_ms = config->backoff_initial_ms;
+        }
+        else
+        {
+            stage->backoff_ms = stage->backoff_ms * 2 < config->backoff_max_ms ? stage->backoff_ms * 2
+                                                                               : config->backoff_max_ms;
+        }
+        stage->restart_at = now + stage->backoff_ms / 1000.0;
+        log_warn("Stage %s exited after %.1f s, restarting in %d ms", stage->name, now - stage->started_at,
+                 stage->backoff_ms);
+    }
+    if (now < stage->restart_at)
+    {
+        return 0;
+    }
+    stage->restarts++;
+    metric_add(stage->restarts_total, 1);
+    log_info("Restarting stage %s (restart #%d)", stage->name, stage->restarts);
+    return 1;
+}
+
+int supervised_stage_join(SupervisedStage *stage, const struct timespec *deadline)
+{
+    if (!stage->joinable)
+    {
+        return 0;
+    }
+    if (deadline)
+    {
+        if (join_thread_until(stage->thread, deadline) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        pthread_join(stage->thread, NULL);
+    }
+    stage->joinable = 0;
+    return 0;
+}
@@ -0,0 +1,305 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "thread_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include "logger.h"
+
+// set_mempolicy 的策略值, 与 <numaif.h> 一致, 避免依赖 libnuma
+#define NUMA_MPOL_PREFERRED 1
+// sysfs 中 NUMA 节点信息所在目录
+#define NUMA_SYSFS_PATH "/sys/devices/system/node"
+// 各节点上运行中的摄像头数, 分配时加一, 流水线停止时减一
+static int numa_node_streams[NUMA_MAX_NODES];
+static pthread_mutex_t numa_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int parse_cpu_list(const char *list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    const char *p = list;
+    int count = 0;
+    while (*p)
+    {
+        while (*p == ' ' || *p == ',')
+        {
+            p++;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        char *end = NULL;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+        {
+            return -1;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE)
+            {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET(cpu, set);
+            count++;
+        }
+        if (*p != '\0' && *p != ',' && *p != ' ')
+        {
+            return -1;
+        }
+    }
+    return count > 0 ? 0 : -1;
+}
+
+int numa_node_count()
+{
+    int count = 0;
+    char path[128];
+    for (;;)
+    {
+        snprintf(path, sizeof(path), NUMA_SYSFS_PATH "/node%d", count);
+        if (access(path, F_OK) != 0)
+        {
+            break;
+        }
+        count++;
+    }
+    return count > 0 ? count : 1;
+}
+
+int numa_node_cpus(int node, cpu_set_t *set)
+{
+    char path[128];
+    snprintf(path, sizeof(path), NUMA_SYSFS_PATH "/node%d/cpulist", node);
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return -1;
+    }
+    char list[1024] = {0};
+    char *line = fgets(list, sizeof(list), file);
+    fclose(file);
+    if (!line)
+    {
+        return -1;
+    }
+    list[strcspn(list, "\n")] = '\0';
+    return parse_cpu_list(list, set);
+}
+
+int numa_assign_node(int requested)
+{
+    if (requested == -1)
+    {
+        return -1;
+    }
+    int count = std::min(numa_node_count(), NUMA_MAX_NODES);
+    int node = requested;
+    pthread_mutex_lock(&numa_lock);
+    if (requested == NUMA_NODE_AUTO)
+    {
+        // 选当前摄像头最少的节点; 手动指定节点的摄像头也计入, 重启的流水线不会在节点间漂移堆积
+        node = count > 1 ? 0 : -1;
+        for (int i = 1; i < count; i++)
+        {
+            if (numa_node_streams[i] < numa_node_streams[node])
+            {
+                node = i;
+            }
+        }
+    }
+    else if (requested < 0 || requested >= count)
+    {
+        log_warn("NUMA node %d does not exist (%d nodes), placement disabled", requested, count);
+        node = -1;
+    }
+    if (node >= 0)
+    {
+        numa_node_streams[node]++;
+    }
+    pthread_mutex_unlock(&numa_lock);
+    return node;
+}
+
+void numa_release_node(int node)
+{
+    if (node < 0 || node >= NUMA_MAX_NODES)
+    {
+        return;
+    }
+    pthread_mutex_lock(&numa_lock);
+    if (numa_node_streams[node] > 0)
+    {
+        numa_node_streams[node]--;
+    }
+    pthread_mutex_unlock(&numa_lock);
+}
+
+// 让当前线程优先从 node 分配内存; 用 PREFERRED 而不是 BIND, 节点内存不足时仍可退回其他节点
+static int numa_prefer_memory(int node)
+{
+    unsigned long mask[16];
+    memset(mask, 0, sizeof(mask));
+    if (node < 0 || node >= (int)(sizeof(mask) * 8))
+    {
+        return -1;
+    }
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    return (int)syscall(SYS_set_mempolicy, NUMA_MPOL_PREFERRED, mask, sizeof(mask) * 8);
+}
+
+// 只有随摄像头走的阶段和各节点的推理线程绑定 NUMA 节点, 渲染和后台任务是全局的
+static int stage_follows_numa_node(PipelineStage stage)
+{
+    return stage == STAGE_DECODE || stage == STAGE_DETECT || stage == STAGE_INFERENCE || stage == STAGE_ENCODE;
+}
+
+void apply_stage_to_current_thread(PipelineStage stage, const ThreadConfig *config)
+{
+    const char *name = pipeline_stage_name(stage);
+    // 线程名最长 15 个字符, 便于 top -H / perf 中区分各阶段
+    pthread_setname_np(pthread_self(), name);
+    if (!config)
+    {
+        return;
+    }
+    const ThreadStageConfig *stage_config = &config->stages[stage];
+    int numa_node = stage_follows_numa_node(stage) ? config->numa_node : -1;
+    if (numa_node >= 0)
+    {
+        // 阶段自己的 CPU 列表优先, 否则绑定到节点的全部 CPU
+        cpu_set_t set;
+        if (!stage_config->cpus[0])
+        {
+            if (numa_node_cpus(numa_node, &set) != 0)
+            {
+                log_warn("Failed to read cpus of NUMA node %d for %s", numa_node, name);
+            }
+            else if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            {
+                log_warn("Failed to bind %s to NUMA node %d", name, numa_node);
+            }
+        }
+        // 内存策略只影响之后的分配, 线程启动时设置即可覆盖帧缓冲和编解码器上下文
+        if (config->numa_memory && numa_prefer_memory(numa_node) != 0)
+        {
+            log_warn("Failed to set memory policy of %s to NUMA node %d: %s", name, numa_node, strerror(errno));
+        }
+    }
+    if (stage_config->cpus[0])
+    {
+        cpu_set_t set;
+        if (parse_cpu_list(stage_config->cpus, &set) != 0)
+        {
+            log_warn("Invalid cpu list for %s: %s", name, stage_config->cpus);
+        }
+        else if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        {
+            log_warn("Failed to set cpu affinity for %s to %s", name, stage_config->cpus);
+        }
+    }
+    if (stage_config->fifo_priority > 0)
+    {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = stage_config->fifo_priority;
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret != 0)
+        {
+            log_warn("Failed to set SCHED_FIFO %d for %s: %s, falling back to normal scheduling",
+                     stage_config->fifo_priority, name, strerror(ret));
+        }
+        else
+        {
+            return;
+        }
+    }
+    if (stage_config->nice != 0)
+    {
+        // Linux 上 nice 值按线程生效
+        pid_t tid = (pid_t)syscall(SYS_gettid);
+        if (setpriority(PRIO_PROCESS, tid, stage_config->nice) != 0)
+        {
+            log_warn("Failed to set nice %d for %s: %s", stage_config->nice, name, strerror(errno));
+        }
+    }
+}
+
+typedef struct
+{
+    PipelineStage stage;
+    const ThreadConfig *config;
+    void *(*start_routine)(void *);
+    void *arg;
+} StageThreadStart;
+
+static void *stage_thread_entry(void *arg)
+{
+    StageThreadStart start = *(StageThreadStart *)arg;
+    free(arg);
+    apply_stage_to_current_thread(start.stage, start.config);
+    return start.start_routine(start.arg);
+}
+
+int create_stage_thread(pthread_t *thread, PipelineStage stage, const ThreadConfig *config,
+                        void *(*start_routine)(void *), void *arg)
+{
+    StageThreadStart *start = (StageThreadStart *)malloc(sizeof(StageThreadStart));
+    if (!start)
+    {
+        return -1;
+    }
+    start->stage = stage;
+    start->config = config;
+    start->start_routine = start_routine;
+    start->arg = arg;
+    if (pthread_create(thread, NULL, stage_thread_entry, start) != 0)
+    {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+void deadline_after_ms(struct timespec *deadline, int timeout_ms)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+int join_thread_until(pthread_t thread, const struct timespec *deadline)
+{
+    return pthread_timedjoin_np(thread, NULL, deadline) == 0 ? 0 : -1;
+}
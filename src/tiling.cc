@@ -0,0 +1,108 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "tiling.h"
+#include "nms.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// 按切片数和重叠比例计算一个方向上的切片起点和长度
+static void split_axis(int start, int length, int count, float overlap, std::vector<int> &offsets, int *tile_length)
+{
+    // count 个切片、相邻重叠 overlap 时恰好覆盖 length
+    int tile = (int)ceilf(length / (count - (count - 1) * overlap));
+    tile = std::min(tile, length);
+    float step = count > 1 ? (float)(length - tile) / (count - 1) : 0;
+    offsets.clear();
+    for (int i = 0; i < count; i++)
+    {
+        offsets.push_back(start + (int)(i * step + 0.5f));
+    }
+    *tile_length = tile;
+}
+
+// 自动计算一个方向上需要的切片数
+static int auto_count(int length, int tile, float overlap)
+{
+    if (length <= tile)
+    {
+        return 1;
+    }
+    return (int)ceilf((length - overlap * tile) / (tile * (1 - overlap)));
+}
+
+void tiling_compute_tiles(const TilingConfig *config, cv::Rect area, int tile_width, int tile_height,
+                          std::vector<cv::Rect> &tiles)
+{
+    tiles.clear();
+    if (area.area() <= 0)
+    {
+        return;
+    }
+    int cols = config->cols > 0 ? config->cols : auto_count(area.width, tile_width, config->overlap);
+    int rows = config->rows > 0 ? config->rows : auto_count(area.height, tile_height, config->overlap);
+    std::vector<int> xs, ys;
+    int w, h;
+    split_axis(area.x, area.width, cols, config->overlap, xs, &w);
+    split_axis(area.y, area.height, rows, config->overlap, ys, &h);
+    for (int y : ys)
+    {
+        for (int x : xs)
+        {
+            tiles.push_back(cv::Rect(x, y, w, h) & area);
+        }
+    }
+}
+
+void tiling_select_active(const MotionGate *gate, const std::vector<Box> &previous, std::vector<cv::Rect> &tiles)
+{
+    tiles.erase(std::remove_if(tiles.begin(), tiles.end(),
+                               [&](const cv::Rect &tile)
+                               {
+                                   if (motion_gate_region_active(gate, tile.x, tile.y, tile.width, tile.height))
+                                   {
+                                       return false;
+                                   }
+                                   for (const Box &box : previous)
+                                   {
+                                       if ((tile & cv::Rect(box.x, box.y, box.w, box.h)).area() > 0)
+                                       {
+                                           return false;
+                                       }
+                                   }
+                                   return true;
+                               }),
+                tiles.end());
+}
+
+void tiling_merge_detections(std::vector<Box> &boxes, float nms_threshold)
+{
+    // 按类别抑制, 不同类别的框互不影响
+    NmsCandidates candidates;
+    for (const Box &box : boxes)
+    {
+        nms_candidates_add(&candidates, box.x, box.y, box.w, box.h, box.prop, box.class_id, 0);
+    }
+    std::vector<int> keep;
+    nms_run(&candidates, nms_threshold, keep);
+    std::vector<Box> merged;
+    merged.reserve(keep.size());
+    for (int k : keep)
+    {
+        merged.push_back(boxes[k]);
+    }
+    boxes.swap(merged);
+}
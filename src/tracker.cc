@@ -0,0 +1,237 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "tracker.h"
+#include <string.h>
+#include <algorithm>
+#include "logger.h"
+
+void tracker_init(Tracker *tracker, const TrackerConfig *config)
+{
+    tracker->config = *config;
+    tracker->tracks.clear();
+    tracker->next_id = 1;
+    tracker->rounds = 0;
+}
+
+// 初始化匀速模型的卡尔曼滤波器, 噪声参数参考 SORT
+static void init_kalman(cv::KalmanFilter &kf, const Box &box)
+{
+    kf.init(8, 4, 0, CV_32F);
+    cv::setIdentity(kf.transitionMatrix);
+    for (int i = 0; i < 4; i++)
+    {
+        kf.transitionMatrix.at<float>(i, i + 4) = 1.0f;
+    }
+    kf.measurementMatrix = cv::Mat::zeros(4, 8, CV_32F);
+    for (int i = 0; i < 4; i++)
+    {
+        kf.measurementMatrix.at<float>(i, i) = 1.0f;
+    }
+    cv::setIdentity(kf.processNoiseCov, cv::Scalar::all(1.0f));
+    for (int i = 4; i < 8; i++)
+    {
+        kf.processNoiseCov.at<float>(i, i) = 0.01f;
+    }
+    cv::setIdentity(kf.measurementNoiseCov, cv::Scalar::all(1.0f));
+    kf.measurementNoiseCov.at<float>(2, 2) = 10.0f;
+    kf.measurementNoiseCov.at<float>(3, 3) = 10.0f;
+    cv::setIdentity(kf.errorCovPost, cv::Scalar::all(10.0f));
+    for (int i = 4; i < 8; i++)
+    {
+        // 初始速度未知, 给较大的不确定度
+        kf.errorCovPost.at<float>(i, i) = 1000.0f;
+    }
+    kf.statePost = cv::Mat::zeros(8, 1, CV_32F);
+    kf.statePost.at<float>(0) = box.x + box.w / 2.0f;
+    kf.statePost.at<float>(1) = box.y + box.h / 2.0f;
+    kf.statePost.at<float>(2) = box.w;
+    kf.statePost.at<float>(3) = box.h;
+}
+
+static cv::Mat box_to_measurement(const Box &box)
+{
+    cv::Mat measurement(4, 1, CV_32F);
+    measurement.at<float>(0) = box.x + box.w / 2.0f;
+    measurement.at<float>(1) = box.y + box.h / 2.0f;
+    measurement.at<float>(2) = box.w;
+    measurement.at<float>(3) = box.h;
+    return measurement;
+}
+
+// 从滤波器状态还原检测框
+static Box track_to_box(const Track &track, const cv::Mat &state)
+{
+    Box box;
+    memset(&box, 0, sizeof(Box));
+    float w = std::max(state.at<float>(2), 1.0f);
+    float h = std::max(state.at<float>(3), 1.0f);
+    box.x = (int)(state.at<float>(0) - w / 2);
+    box.y = (int)(state.at<float>(1) - h / 2);
+    box.w = (int)w;
+    box.h = (int)h;
+    box.prop = track.prop;
+    box.track_id = track.id;
+    memcpy(box.label, track.label, sizeof(box.label));
+    box.class_id = track.class_id;
+    return box;
+}
+
+static float box_iou(const Box &a, const Box &b)
+{
+    int x1 = std::max(a.x, b.x);
+    int y1 = std::max(a.y, b.y);
+    int x2 = std::min(a.x + a.w, b.x + b.w);
+    int y2 = std::min(a.y + a.h, b.y + b.h);
+    float inter = (float)std::max(0, x2 - x1) * std::max(0, y2 - y1);
+    float uni = (float)a.w * a.h + (float)b.w * b.h - inter;
+    return uni > 0 ? inter / uni : 0;
+}
+
+// 目标在最近一轮检测中被匹配且已确认时才输出
+static int track_is_visible(const Tracker *tracker, const Track &track)
+{
+    return track.misses == 0 &&
+           (track.hits >= tracker->config.min_hits || tracker->rounds <= tracker->config.min_hits);
+}
+
+void tracker_update(Tracker *tracker, const std::vector<Box> &detections, std::vector<Box> &tracked)
+{
+    tracked.clear();
+    tracker->rounds++;
+    // 预测所有目标在当前帧的位置
+    std::vector<Box> predicted;
+    predicted.reserve(tracker->tracks.size());
+    for (Track &track : tracker->tracks)
+    {
+        predicted.push_back(track_to_box(track, track.kf.predict()));
+    }
+    // 计算同类别目标与检测之间的 IoU, 按 IoU 从大到小贪心匹配
+    typedef struct
+    {
+        float iou;
+        int track;
+        int detection;
+    } Candidate;
+    std::vector<Candidate> candidates;
+    for (size_t t = 0; t < predicted.size(); t++)
+    {
+        for (size_t d = 0; d < detections.size(); d++)
+        {
+            if (predicted[t].class_id != detections[d].class_id)
+            {
+                continue;
+            }
+            float iou = box_iou(predicted[t], detections[d]);
+            if (iou >= tracker->config.iou_threshold)
+            {
+                candidates.push_back({iou, (int)t, (int)d});
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate &a, const Candidate &b)
+              { return a.iou > b.iou; });
+    std::vector<int> track_matched(tracker->tracks.size(), 0);
+    std::vector<int> detection_matched(detections.size(), 0);
+    for (const Candidate &candidate : candidates)
+    {
+        if (track_matched[candidate.track] || detection_matched[candidate.detection])
+        {
+            continue;
+        }
+        track_matched[candidate.track] = 1;
+        detection_matched[candidate.detection] = 1;
+        Track &track = tracker->tracks[candidate.track];
+        track.kf.correct(box_to_measurement(detections[candidate.detection]));
+        track.prop = detections[candidate.detection].prop;
+        track.hits++;
+        track.misses = 0;
+    }
+    // 未匹配的目标累计丢失次数, 超过上限后删除
+    for (size_t t = 0; t < tracker->tracks.size(); t++)
+    {
+        if (!track_matched[t])
+        {
+            Track &track = tracker->tracks[t];
+            track.kf.statePre.copyTo(track.kf.statePost);
+            track.kf.errorCovPre.copyTo(track.kf.errorCovPost);
+            track.misses++;
+        }
+    }
+    tracker->tracks.erase(std::remove_if(tracker->tracks.begin(), tracker->tracks.end(),
+                                         [tracker](const Track &track)
+                                         { return track.misses > tracker->config.max_misses; }),
+                          tracker->tracks.end());
+    // 未匹配的检测创建新目标
+    for (size_t d = 0; d < detections.size(); d++)
+    {
+        if (detection_matched[d])
+        {
+            continue;
+        }
+        Track track;
+        track.id = tracker->next_id++;
+        init_kalman(track.kf, detections[d]);
+        memcpy(track.label, detections[d].label, sizeof(track.label));
+        track.class_id = detections[d].class_id;
+        track.prop = detections[d].prop;
+        track.hits = 1;
+        track.misses = 0;
+        track.warned = 0;
+        tracker->tracks.push_back(track);
+    }
+    for (const Track &track : tracker->tracks)
+    {
+        if (track_is_visible(tracker, track))
+        {
+            tracked.push_back(track_to_box(track, track.kf.statePost));
+        }
+    }
+}
+
+void tracker_predict(Tracker *tracker, std::vector<Box> &tracked)
+{
+    tracked.clear();
+    for (Track &track : tracker->tracks)
+    {
+        // 没有观测时把预测值作为后验, 下一帧在此基础上继续外推
+        track.kf.predict();
+        track.kf.statePre.copyTo(track.kf.statePost);
+        track.kf.errorCovPre.copyTo(track.kf.errorCovPost);
+        if (track_is_visible(tracker, track))
+        {
+            tracked.push_back(track_to_box(track, track.kf.statePost));
+        }
+    }
+}
+
+int tracker_claim_warning(Tracker *tracker, int track_id)
+{
+    for (Track &track : tracker->tracks)
+    {
+        if (track.id == track_id)
+        {
+            // 启动阶段未确认的目标也会显示, 但只有确认后才告警
+            if (track.warned || track.hits < tracker->config.min_hits)
+            {
+                return 0;
+            }
+            track.warned = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -16,6 +16,8 @@
 #include "video_record_thread.h"
 #include "libav_utils.h"
 #include "logger.h"
+#include "supervisor.h"
+#include "metrics.h"
 // 初始化 RTMP 流上下文
 int init_mp4_stream(Mp4StreamContext *ctx, const char *output_url, int width, int height, int fps)
 {
@@ -28,7 +30,7 @@ int init_mp4_stream(Mp4StreamContext *ctx, const char *output_url, int width, in
     log_info( "init_rtmp_stream === output_url=%s,width=%d,height=%d,fps=%d",
                 output_url, width, height, fps);
     // 创建输出上下文
-    int ret = avformat_alloc_output_context2(&ctx->output_ctx, NULL, "flv", output_url);
+    int ret = avformat_alloc_output_context2(&ctx->output_ctx, NULL, output_format_name(output_url), output_url);
     if (ret < 0 || !ctx->output_ctx)
     {
         log_info( "Failed to create output context: %s", get_av_error(ret));
@@ -82,6 +84,7 @@ int init_mp4_stream(Mp4StreamContext *ctx, const char *output_url, int width, in
         goto cleanup_codec_context;
     }
     // 打开编码器
+    ctx->codec_ctx->thread_count = ctx->thread_count;
     ret = avcodec_open2(ctx->codec_ctx, codec, NULL);
     if (ret < 0)
     {
@@ -121,15 +124,15 @@ cleanup_output_context:
     return -1;
 }
 // 优化后的 push_stream 函数
-void save_mp4(Mp4StreamContext *ctx, AVFrame *frame)
+void save_mp4(Mp4StreamContext *ctx, AVFrame *frame, FrameTrace *trace)
 {
-    if (!ctx || !frame)
+    if (!ctx || !ctx->codec_ctx)
     {
-        log_info( "Invalid input parameters: RtmpStreamContext or AVFrame is NULL");
+        log_info( "Invalid input parameters: Mp4StreamContext is NULL");
         return;
     }
     int ret = 0;
-    // 发送帧到编码器
+    // 发送帧到编码器, frame 为 NULL 时进入冲刷模式, 取出编码器内缓存的全部数据包
     ret = avcodec_send_frame(ctx->codec_ctx, frame);
     if (ret < 0)
     {
@@ -156,6 +159,11 @@ void save_mp4(Mp4StreamContext *ctx, AVFrame *frame)
             log_info( "Error encoding frame: %s", get_av_error(ret));
             break;
         }
+        // 低延迟编码时数据包对应刚送入的帧
+        if (trace && !trace->stamps[TRACE_ENCODE])
+        {
+            trace_stamp(trace, TRACE_ENCODE);
+        }
         av_packet_rescale_ts(pkt, ctx->input_stream->time_base, ctx->video_stream->time_base);
 
         ret = av_interleaved_write_frame(ctx->output_ctx, pkt);
@@ -163,6 +171,10 @@ void save_mp4(Mp4StreamContext *ctx, AVFrame *frame)
         {
             log_info( "Error writing packet: %d, %s", ret, get_av_error(ret));
         }
+        else
+        {
+            trace_stamp(trace, TRACE_MUX);
+        }
         // 释放数据包
         av_packet_unref(pkt);
     }
@@ -176,19 +188,23 @@ void *save_mp4_handler_thread(void *arg)
     Mp4StreamContext ctx;
     memset(&ctx, 0, sizeof(Mp4StreamContext));
     ctx.input_stream = args->input_stream;
+    ctx.thread_count = args->config->threads.encoder_threads;
 
     // 初始化输出流
     log_info( "Start save mp4 record thread");
     // 获取当前时间戳作为文件名
     time_t current_time = time(NULL);
-    char file_name[100];
-    strftime(file_name, sizeof(file_name), "./local_%Y%m%d_%H%M%S.mp4", localtime(&current_time));
+    char file_name[256];
+    strftime(file_name, sizeof(file_name), args->config->record_path, localtime(&current_time));
     if (init_mp4_stream(&ctx, file_name, 1920, 1080, 25) < 0)
     {
         log_info( "Failed to initialize RTMP stream");
         return NULL;
     }
 
+    char labels[128];
+    snprintf(labels, sizeof(labels), "stream=\"%s\",output=\"record\"", args->config->name);
+    Metric *encoded = metrics_counter("pipeline_frames_encoded_total", "Frames sent to the encoder", labels);
     // 记录开始时间
     time_t start_time = time(NULL);
     int file_index = 0;
@@ -199,43 +215,56 @@ void *save_mp4_handler_thread(void *arg)
         QueueItem item;
         memset(&item, 0, sizeof(QueueItem));
 
-        if (dequeue(args->record_frame_queue, &item))
+        // 拉流线程停止后关闭队列, 取完剩余的帧后退出
+        stage_wait(args->health);
+        if (!dequeue(args->record_frame_queue, &item))
         {
-            if (item.type == ONLY_FRAME && item.data)
+            break;
+        }
+        stage_heartbeat(args->health);
+        trace_stamp(&item.trace, TRACE_DEQUEUE);
+        trace_record(SPAN_QUEUE_RECORD, &item.trace, TRACE_ENQUEUE, TRACE_DEQUEUE);
+        if (item.type == ONLY_FRAME && item.data)
+        {
+            AVFrame *frame = (AVFrame *)item.data;
+            // 检查是否超过 30 分钟
+            current_time = time(NULL);
+            double elapsed_time = difftime(current_time, start_time);
+            if (elapsed_time >= 30 * 60)
             {
-                AVFrame *frame = (AVFrame *)item.data;
-                // 检查是否超过 30 分钟
+                // 冲刷编码器后关闭当前文件
+                save_mp4(&ctx, NULL, NULL);
+                av_write_trailer(ctx.output_ctx);
+                avio_closep(&ctx.output_ctx->pb);
+                avcodec_free_context(&ctx.codec_ctx);
+                avformat_free_context(ctx.output_ctx);
+
+                // 新建文件
+                file_index++;
+                // 获取新的时间戳作为文件名
                 current_time = time(NULL);
-                double elapsed_time = difftime(current_time, start_time);
-                if (elapsed_time >= 30 * 60)
+                strftime(file_name, sizeof(file_name), args->config->record_path, localtime(&current_time));
+                memset(&ctx, 0, sizeof(Mp4StreamContext));
+                ctx.input_stream = args->input_stream;
+                ctx.thread_count = args->config->threads.encoder_threads;
+                if (init_mp4_stream(&ctx, file_name, 1920, 1080, 25) < 0)
                 {
-                    // 关闭当前文件
-                    av_write_trailer(ctx.output_ctx);
-                    avio_closep(&ctx.output_ctx->pb);
-                    avcodec_free_context(&ctx.codec_ctx);
-                    avformat_free_context(ctx.output_ctx);
-
-                    // 新建文件
-                    file_index++;
-                    // 获取新的时间戳作为文件名
-                    current_time = time(NULL);
-                    strftime(file_name, sizeof(file_name), "./local_%Y%m%d_%H%M%S.mp4", localtime(&current_time));
-                    memset(&ctx, 0, sizeof(Mp4StreamContext));
-                    ctx.input_stream = args->input_stream;
-                    if (init_mp4_stream(&ctx, file_name, 1920, 1080, 25) < 0)
-                    {
-                        log_info( "Failed to initialize new MP4 stream");
-                        return NULL;
-                    }
-                    start_time = time(NULL);
+                    log_info( "Failed to initialize new MP4 stream");
+                    av_frame_free(&frame);
+                    return NULL;
                 }
-                save_mp4(&ctx, frame);
-                av_frame_free(&frame);
+                start_time = time(NULL);
             }
+            save_mp4(&ctx, frame, &item.trace);
+            metric_add(encoded, 1);
+            trace_record(SPAN_RECORD_ENCODE, &item.trace, TRACE_DEQUEUE, TRACE_ENCODE);
+            trace_record(SPAN_RECORD_MUX, &item.trace, TRACE_ENCODE, TRACE_MUX);
+            av_frame_free(&frame);
         }
     }
 
     log_info( "Stop save mp4 record thread");
+    save_mp4(&ctx, NULL, NULL);
     av_write_trailer(ctx.output_ctx);
     avio_closep(&ctx.output_ctx->pb);
     avcodec_free_context(&ctx.codec_ctx);
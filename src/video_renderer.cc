@@ -1,5 +1,7 @@
 #include "video_renderer.h"
 #include "logger.h"
+#include "latency_trace.h"
+#include "metrics.h"
 #define TARGET_FPS 25                  // 目标帧率
 #define FRAME_TIME (1000 / TARGET_FPS) // 每帧目标时间 (毫秒)
 
@@ -75,9 +77,23 @@ void *video_renderer_thread(void *arg)
         SDL_Quit();
         return NULL;
     }
+    // 标签和帧率文字都从字形图集绘制, 每帧不再渲染字体、创建纹理
+    GlyphAtlas atlas;
+    if (glyph_atlas_init(&atlas, renderer, font) != 0)
+    {
+        TTF_CloseFont(font);
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        TTF_Quit();
+        SDL_Quit();
+        return NULL;
+    }
 
     int frameCount = 0;
     float fps = 0;
+    // 导出渲染帧数, 由 Prometheus 按 rate() 计算帧率
+    Metric *rendered = metrics_counter("render_frames_total", "Frames drawn by the renderer", NULL);
     char fpsLabel[20] = "FPS:00";
     Uint64 currentFrameTime = 0;
     Uint64 lastFrameTime = SDL_GetPerformanceCounter();
@@ -104,6 +120,8 @@ void *video_renderer_thread(void *arg)
 
         if (dequeue(args->video_queue, &frame_item))
         {
+            trace_stamp(&frame_item.trace, TRACE_DEQUEUE);
+            trace_record(SPAN_QUEUE_RENDER, &frame_item.trace, TRACE_ENQUEUE, TRACE_DEQUEUE);
             if (frame_item.type == ONLY_FRAME && frame_item.data != NULL)
             {
                 AVFrame *newFrame = (AVFrame *)frame_item.data;
@@ -122,7 +140,7 @@ void *video_renderer_thread(void *arg)
 
         // 处理检测结果队列
         QueueItem boxes_item;
-        if (async_dequeue(args->box_queue, &boxes_item))
+        if (async_dequeue(args->box_queue, &boxes_item) == 1)
         {
             if (boxes_item.type == ONLY_BOXES)
             {
@@ -131,7 +149,17 @@ void *video_renderer_thread(void *arg)
                     // 检查边界框数据是否有效
                     if (boxes_item.Boxes != NULL)
                     {
-                        SDLDrawBox(renderer, font, boxes_item.Boxes[i].label,
+                        // 跟踪目标显示跟踪 ID
+                        char label[64];
+                        if (boxes_item.Boxes[i].track_id > 0)
+                        {
+                            snprintf(label, sizeof(label), "%s #%d", boxes_item.Boxes[i].label, boxes_item.Boxes[i].track_id);
+                        }
+                        else
+                        {
+                            snprintf(label, sizeof(label), "%s", boxes_item.Boxes[i].label);
+                        }
+                        SDLDrawBox(renderer, &atlas, label,
                                    boxes_item.Boxes[i].x, boxes_item.Boxes[i].y,
                                    boxes_item.Boxes[i].w, boxes_item.Boxes[i].h, 1);
                     }
@@ -141,6 +169,7 @@ void *video_renderer_thread(void *arg)
 
         // 计算FPS并显示
         frameCount++;
+        metric_add(rendered, 1);
         currentFrameTime = SDL_GetPerformanceCounter();
         float elapsedTime = (currentFrameTime - lastFrameTime) / (float)performanceFrequency;
         if (elapsedTime >= 1.0f)
@@ -153,7 +182,7 @@ void *video_renderer_thread(void *arg)
 
         SDL_Color textColor = {255, 0, 0, 255};       // 红色文本
         SDL_Color backgroundColor = {0, 255, 0, 255}; // 绿色背景
-        SDLDrawLabel(renderer, font, (const char *)fpsLabel, 2, 2, textColor, backgroundColor);
+        SDLDrawLabel(renderer, &atlas, (const char *)fpsLabel, 2, 2, textColor, backgroundColor);
 
         // 更新屏幕
         SDL_RenderPresent(renderer);
@@ -186,6 +215,7 @@ void *video_renderer_thread(void *arg)
     }
 
     // 资源释放
+    glyph_atlas_destroy(&atlas);
     if (texture)
     {
         SDL_DestroyTexture(texture);
@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include "http_api.h"
 #include "libav_utils.h"
+#include "metrics.h"
 #include "logger.h"
 // 全局变量
 static uint32_t interval_ms;
@@ -32,6 +33,11 @@ static volatile int running = 0;
 static int latest_warning_timestamp;
 static char last_coco_types[40];
 static AVFrame *last_frame;
+// 保护 last_frame 等告警状态, 检测线程写入、计时器线程读取
+static pthread_mutex_t warning_lock = PTHREAD_MUTEX_INITIALIZER;
+// 导出的告警计数
+static Metric *warnings_total;
+static Metric *warning_events_total;
 //
 void print_warning_info(WarningInfo *info)
 {
@@ -51,24 +57,33 @@ static void *timer_thread_func(void *arg)
 
         if (elapsed_ms >= interval_ms)
         {
-            if (warning_count >= threshold)
+            pthread_mutex_lock(&warning_lock);
+            int triggered = warning_count >= threshold && event_callback != NULL;
+            WarningInfo info;
+            if (triggered)
             {
-                if (event_callback != NULL)
-                {
-                    WarningInfo info;
-                    info.warning_count = warning_count;
-                    info.interval_ms = interval_ms;
-                    memcpy(info.coco_types, last_coco_types, 40);
-                    info.latest_warning_timestamp = latest_warning_timestamp;
-                    info.frame = last_frame;
-                    event_callback(&info);
-                }
+                info.warning_count = warning_count;
+                info.interval_ms = interval_ms;
+                memcpy(info.coco_types, last_coco_types, 40);
+                info.latest_warning_timestamp = latest_warning_timestamp;
+                info.frame = last_frame ? av_frame_clone(last_frame) : NULL;
             }
             warning_count = 0;
+            pthread_mutex_unlock(&warning_lock);
+            if (triggered)
+            {
+                metric_add(warning_events_total, 1);
+                event_callback(&info);
+                av_frame_free(&info.frame);
+            }
             clock_gettime(CLOCK_MONOTONIC, &start);
         }
 
-        usleep(1000000 * 5); // 每 10 毫秒检查一次
+        // 每 5 秒检查一次, 分段休眠使 warning_timer_stop 能及时返回
+        for (int i = 0; i < 50 && running; i++)
+        {
+            usleep(100000);
+        }
     }
 
     return NULL;
@@ -81,24 +96,44 @@ int warning_timer_init(uint32_t interval_ms_param, uint32_t threshold_param, voi
     threshold = threshold_param;
     event_callback = callback;
     warning_count = 0;
+    warnings_total = metrics_counter("warning_detections_total", "Detections of a warning class", NULL);
+    warning_events_total = metrics_counter("warning_events_total",
+                                           "Warning events fired after the threshold was reached", NULL);
     running = 1;
 
     if (pthread_create(&timer_thread, NULL, timer_thread_func, NULL) != 0)
     {
         log_error( "Failed to create timer thread");
-        exit(EXIT_FAILURE);
+        running = 0;
+        return -1;
     }
     log_info( "Warning timer initialized!");
     return 0;
 }
 
-// 记录一次告警
-void warning_timer_record_warning(char label[40], int timestamp, AVFrame *frame)
+// 累加告警次数; 调用方随后会释放 frame, 这里保留一份引用
+static void record_warning(char label[40], int timestamp, AVFrame *frame, uint32_t count)
 {
-    warning_count++;
+    metric_add(warnings_total, 1);
+    pthread_mutex_lock(&warning_lock);
+    warning_count += count;
     latest_warning_timestamp = timestamp;
     memcpy(last_coco_types, label, 40);
-    last_frame = frame;
+    av_frame_free(&last_frame);
+    last_frame = av_frame_clone(frame);
+    pthread_mutex_unlock(&warning_lock);
+}
+
+// 记录一次告警
+void warning_timer_record_warning(char label[40], int timestamp, AVFrame *frame)
+{
+    record_warning(label, timestamp, frame, 1);
+}
+
+// 跟踪器已经过滤了单帧误检, 一个确认的目标直接计满阈值
+void warning_timer_record_confirmed(char label[40], int timestamp, AVFrame *frame)
+{
+    record_warning(label, timestamp, frame, threshold > 0 ? threshold : 1);
 }
 
 // 停止告警计时器
@@ -106,6 +141,7 @@ void warning_timer_stop()
 {
     running = 0;
     pthread_join(timer_thread, NULL);
+    av_frame_free(&last_frame);
     log_info( "Warning timer stopped!");
 }
 // 触发事件的回调函数
@@ -14,17 +14,332 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "yolov8.h"
-int init_yolov8_model()
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "opencv_utils.h"
+#include "latency_trace.h"
+#include "logger.h"
+
+// 允许列表为空时全部类别参与打分, class_thresholds 覆盖单个类别的阈值
+int yolov8_build_class_filter(const DetectorConfig *config, const LabelMap *labels, int num_classes,
+                              ClassFilter *filter)
+{
+    std::vector<int> ids(MAX_DETECTION_CLASSES);
+    int count = label_map_parse_class_list(labels, config->classes, num_classes, ids.data(), MAX_DETECTION_CLASSES);
+    if (count < 0)
+    {
+        return -1;
+    }
+    if (count == 0)
+    {
+        for (int i = 0; i < num_classes; i++)
+        {
+            ids[i] = i;
+        }
+        count = num_classes;
+    }
+    // 升序去重
+    std::sort(ids.begin(), ids.begin() + count);
+    count = std::unique(ids.begin(), ids.begin() + count) - ids.begin();
+    filter->count = count;
+    for (int i = 0; i < count; i++)
+    {
+        filter->ids[i] = ids[i];
+        filter->thresholds[i] = config->conf_threshold;
+    }
+    // 形如 person:0.5, car:0.4
+    char buffer[sizeof(config->class_thresholds)];
+    snprintf(buffer, sizeof(buffer), "%s", config->class_thresholds);
+    char *saveptr = NULL;
+    for (char *token = strtok_r(buffer, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr))
+    {
+        char *colon = strrchr(token, ':');
+        if (!colon)
+        {
+            log_error("Invalid class threshold: %s", token);
+            return -1;
+        }
+        *colon = '\0';
+        int id = -1;
+        if (label_map_parse_class_list(labels, token, num_classes, &id, 1) != 1)
+        {
+            return -1;
+        }
+        float threshold = atof(colon + 1);
+        for (int i = 0; i < count; i++)
+        {
+            if (filter->ids[i] == id)
+            {
+                filter->thresholds[i] = threshold;
+            }
+        }
+    }
+    return 0;
+}
+
+// 用全零输入做一次前向, 检查输出形状为 [batch, 4 + 类别数, 锚点数], 返回类别数
+static int validate_model_output(Yolov8Model *model, int batch)
+{
+    int shape[] = {batch, 3, model->input_height, model->input_width};
+    cv::Mat blob(4, shape, CV_32F, cv::Scalar(0));
+    std::vector<cv::Mat> outs;
+    if (model->backend->infer(model->backend, blob, outs) != 0 || outs.empty())
+    {
+        return -1;
+    }
+    const cv::Mat &output = outs[0];
+    if (output.dims != 3 || output.size[0] != batch || output.size[1] <= 4 ||
+        output.size[1] - 4 > MAX_DETECTION_CLASSES)
+    {
+        log_error("Unexpected model output shape: dims=%d, batch=%d, channels=%d", output.dims,
+                  output.dims > 0 ? output.size[0] : 0, output.dims > 1 ? output.size[1] : 0);
+        return -1;
+    }
+    return output.size[1] - 4;
+}
+
+int init_yolov8_model(const DetectorConfig *config, Yolov8Model *model)
+{
+    memset(model, 0, sizeof(Yolov8Model));
+    model->input_width = config->input_width;
+    model->input_height = config->input_height;
+    model->nms_threshold = config->nms_threshold;
+    if (label_map_load(&model->labels, config->labels_path, config->model_path) != 0)
+    {
+        return -1;
+    }
+    label_map_dump(&model->labels);
+    model->backend = create_inference_backend(config->backend);
+    if (!model->backend)
+    {
+        label_map_free(&model->labels);
+        return -1;
+    }
+    if (model->backend->load(model->backend, config) != 0)
+    {
+        log_error("Failed to load model %s with backend %s", config->model_path, config->backend);
+        destroy_inference_backend(model->backend);
+        model->backend = NULL;
+        label_map_free(&model->labels);
+        return -1;
+    }
+    model->backend->get_capabilities(model->backend, &model->caps);
+    if (model->caps.max_batch_size <= 0)
+    {
+        model->caps.max_batch_size = 1;
+    }
+    log_info("Inference backend %s: device=%s, precision=%s, max_batch=%d, dynamic_input=%d, fp16=%d, int8=%d, input=%dx%d",
+             model->backend->name, model->caps.device, model->caps.precision, model->caps.max_batch_size,
+             model->caps.dynamic_input, model->caps.supports_fp16, model->caps.supports_int8,
+             model->input_width, model->input_height);
+    // 校验必定执行一次, 且覆盖运行时会出现的批量: 静态形状导出的模型在输入尺寸或批量不匹配时在加载阶段失败,
+    // 而不是在第一次合批推理时
+    int batches[] = {1, model->caps.max_batch_size};
+    for (int i = 0; i < 2; i++)
+    {
+        if (i == 1 && batches[1] == batches[0])
+        {
+            break;
+        }
+        int num_classes = validate_model_output(model, batches[i]);
+        if (num_classes < 0)
+        {
+            log_error("Model validation failed with batch %d and input %dx%d, export the model with dynamic=True "
+                      "or a matching imgsz/batch, or lower max_batch",
+                      batches[i], model->input_width, model->input_height);
+            release_yolov8_model(model);
+            return -1;
+        }
+        model->num_classes = num_classes;
+    }
+    if (model->num_classes != model->labels.count)
+    {
+        log_warn("Model outputs %d classes but label map %s has %d names",
+                 model->num_classes, model->labels.source, model->labels.count);
+    }
+    // 类别过滤按模型的实际类别数生成, 配置中越界的类别 ID 在加载时报错
+    if (yolov8_build_class_filter(config, &model->labels, model->num_classes, &model->filter) != 0)
+    {
+        release_yolov8_model(model);
+        return -1;
+    }
+    // 以最大批量预热, 避免第一次满批推理的初始化开销落在实时流上; 上面的校验已算作一次
+    for (int i = 1; i < config->warmup_runs; i++)
+    {
+        if (model->backend->warmup(model->backend, model->caps.max_batch_size, model->input_width,
+                                   model->input_height) != 0)
+        {
+            log_error("Warmup failed with batch %d and input %dx%d", model->caps.max_batch_size,
+                      model->input_width, model->input_height);
+            release_yolov8_model(model);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int release_yolov8_model(Yolov8Model *model)
+{
+    label_map_free(&model->labels);
+    if (model->backend)
+    {
+        destroy_inference_backend(model->backend);
+        model->backend = NULL;
+    }
+    return 0;
+}
+
+// 把 NMS 保留的候选框映射回各自的原图, 追加到对应图像的结果
+static void append_detections(const Yolov8Model *model, const cv::Mat *frames, const NmsCandidates &candidates,
+                              const std::vector<int> &keep, cv::Size input_size, std::vector<Box> *results)
 {
+    for (int idx : keep)
+    {
+        int i = candidates.image[idx];
+        cv::Rect box_in_letterbox(candidates.x1[idx], candidates.y1[idx],
+                                  candidates.x2[idx] - candidates.x1[idx], candidates.y2[idx] - candidates.y1[idx]);
+        cv::Rect box_in_original = map_box_to_original(box_in_letterbox, frames[i].size(), input_size);
+        Box box = {
+            .x = box_in_original.x,
+            .y = box_in_original.y,
+            .w = box_in_original.width,
+            .h = box_in_original.height,
+            .prop = candidates.score[idx],
+            .class_id = candidates.class_id[idx],
+        };
+        snprintf(box.label, sizeof(box.label), "%s", label_map_name(&model->labels, box.class_id));
+        results[i].push_back(box);
+    }
+}
+
+// 对一批图像做 letterbox + 前向 + 后处理; post 为每张图像的后处理参数, 为 NULL 时使用模型的默认值
+static int inference_yolov8_chunk(Yolov8Model *model, const cv::Mat *frames, int count, const Yolov8Postprocess *post,
+                                  std::vector<Box> *results)
+{
+    cv::Size input_size(model->input_width, model->input_height);
+    cv::Mat blob;
+    uint64_t start = trace_now();
+    yolov8_preprocess(frames, count, model->input_width, model->input_height, blob);
+    uint64_t preprocessed = trace_now();
+    std::vector<cv::Mat> outs;
+    if (model->backend->infer(model->backend, blob, outs) != 0)
+    {
+        log_info( "Error: No output from the network.");
+        return -1;
+    }
+    uint64_t inferred = trace_now();
+    model->timing.preprocess_ticks += preprocessed - start;
+    model->timing.infer_ticks += inferred - preprocessed;
+    // 输出形状为 [N, 4 + 类别数, 锚点数], 按批次拆分, 锚点数从形状推导
+    const cv::Mat &output = outs[0];
+    // NMS 阈值相同的图像的候选框一起做一次 NMS, 按图片和类别分桶, 互不抑制; 通常整个批次只有一组
+    std::vector<unsigned char> done(count, 0);
+    NmsCandidates candidates;
+    std::vector<int> keep;
+    for (int first = 0; first < count; first++)
+    {
+        if (done[first])
+        {
+            continue;
+        }
+        float nms_threshold = post ? post[first].nms_threshold : model->nms_threshold;
+        nms_candidates_clear(&candidates);
+        for (int i = first; i < count; i++)
+        {
+            if (done[i] || (post ? post[i].nms_threshold : model->nms_threshold) != nms_threshold)
+            {
+                continue;
+            }
+            done[i] = 1;
+            cv::Mat image_out(output.size[1], output.size[2], CV_32F, (void *)output.ptr<float>(i));
+            yolov8_collect_candidates(image_out, post ? post[i].filter : &model->filter, i, &candidates);
+        }
+        keep.clear();
+        nms_run(&candidates, nms_threshold, keep);
+        append_detections(model, frames, candidates, keep, input_size, results);
+    }
+    model->timing.postprocess_ticks += trace_now() - inferred;
     return 0;
 }
 
-int release_yolov8_model()
+int inference_yolov8_regions(Yolov8Model *model, const cv::Mat &frame, const std::vector<cv::Rect> &regions,
+                             std::vector<Box> &boxes)
 {
+    return inference_yolov8_batch_regions(model, &frame, &regions, 1, NULL, &boxes);
+}
+
+// 按后端支持的最大批量分块执行; post 为每张图像的后处理参数, 为 NULL 时使用模型的默认值
+static int run_chunks(Yolov8Model *model, const cv::Mat *frames, int count, const Yolov8Postprocess *post,
+                      std::vector<Box> *results)
+{
+    if (!model || !model->backend)
+    {
+        log_info( "Error: Model is not initialized.");
+        return -1;
+    }
+    memset(&model->timing, 0, sizeof(Yolov8Timing));
+    for (int start = 0; start < count; start += model->caps.max_batch_size)
+    {
+        int n = std::min(model->caps.max_batch_size, count - start);
+        if (inference_yolov8_chunk(model, frames + start, n, post ? post + start : NULL, results + start) != 0)
+        {
+            return -1;
+        }
+    }
     return 0;
 }
 
-int inference_yolov8_model()
+int inference_yolov8_batch_regions(Yolov8Model *model, const cv::Mat *frames, const std::vector<cv::Rect> *regions,
+                                   int count, const Yolov8Postprocess *post, std::vector<Box> *boxes)
 {
+    // 裁剪只是引用原图的子区域, 不复制像素; owners / offsets 记录每个裁剪属于哪张图像及其偏移
+    std::vector<cv::Mat> crops;
+    std::vector<int> owners;
+    std::vector<cv::Point> offsets;
+    for (int i = 0; i < count; i++)
+    {
+        if (regions[i].empty())
+        {
+            crops.push_back(frames[i]);
+            owners.push_back(i);
+            offsets.push_back(cv::Point(0, 0));
+            continue;
+        }
+        for (const cv::Rect &region : regions[i])
+        {
+            crops.push_back(frames[i](region));
+            owners.push_back(i);
+            offsets.push_back(region.tl());
+        }
+    }
+    // 裁剪沿用所属图像的后处理参数
+    std::vector<Yolov8Postprocess> crop_post;
+    if (post)
+    {
+        for (int owner : owners)
+        {
+            crop_post.push_back(post[owner]);
+        }
+    }
+    std::vector<std::vector<Box>> results(crops.size());
+    if (run_chunks(model, crops.data(), (int)crops.size(), post ? crop_post.data() : NULL, results.data()) != 0)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < crops.size(); i++)
+    {
+        for (Box box : results[i])
+        {
+            box.x += offsets[i].x;
+            box.y += offsets[i].y;
+            boxes[owners[i]].push_back(box);
+        }
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+int inference_yolov8_model(Yolov8Model *model, const cv::Mat *frames, int count, std::vector<Box> *results)
+{
+    return run_chunks(model, frames, count, NULL, results);
+}
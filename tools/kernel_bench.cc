@@ -0,0 +1,307 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// 热点函数的微基准(Google Benchmark): 每个函数在多个分辨率下运行, 用于评估优化效果和发现性能回退。
+// 用法: yolov8-kernel-bench [--benchmark_filter=<正则>] [--benchmark_format=json]
+// 后处理默认使用固定种子生成的网络输出; 设置 YOLOV8_BENCH_TENSOR 为 640 输入下
+// [84, 8400] 的 float32 原始数据文件时改用录制的输出。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <benchmark/benchmark.h>
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+#include "frame_queue.h"
+#include "opencv_utils.h"
+#ifndef HEADLESS
+#include "sdl_utils.h"
+#endif
+#include "libav_utils.h"
+#include "nms.h"
+#include "logger.h"
+
+// 常见的摄像头分辨率
+#define RESOLUTIONS(b) b->Args({640, 360})->Args({1280, 720})->Args({1920, 1080})->Args({3840, 2160})
+// 网络输入尺寸和对应的锚点数: (s/8)^2 + (s/16)^2 + (s/32)^2
+#define INPUT_SIZES(b) b->Arg(320)->Arg(640)->Arg(1280)
+#define YOLOV8_CLASSES 80
+#define NETWORK_INPUT 640
+
+// 分配一帧并填充渐变, 避免全零数据让某些路径走捷径
+static AVFrame *make_frame(int width, int height, AVPixelFormat format)
+{
+    AVFrame *frame = av_frame_alloc();
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    if (av_frame_get_buffer(frame, 32) < 0)
+    {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane]; plane++)
+    {
+        int rows = plane == 0 ? height : (height + 1) / 2;
+        for (int y = 0; y < rows; y++)
+        {
+            uint8_t *row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+            for (int x = 0; x < frame->linesize[plane]; x++)
+            {
+                row[x] = (uint8_t)(x + y * 3 + plane * 64);
+            }
+        }
+    }
+    return frame;
+}
+
+static cv::Mat make_rgb(int width, int height)
+{
+    cv::Mat image(height, width, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    return image;
+}
+
+static void set_pixels_processed(benchmark::State &state, int width, int height)
+{
+    state.SetItemsProcessed(state.iterations() * (int64_t)width * height);
+    state.counters["fps"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate);
+}
+
+static void BM_AVFrameToCVMat(benchmark::State &state)
+{
+    int width = (int)state.range(0), height = (int)state.range(1);
+    AVFrame *frame = make_frame(width, height, AV_PIX_FMT_YUV420P);
+    for (auto _ : state)
+    {
+        cv::Mat mat = AVFrameToCVMat(frame);
+        benchmark::DoNotOptimize(mat.data);
+    }
+    set_pixels_processed(state, width, height);
+    av_frame_free(&frame);
+}
+RESOLUTIONS(BENCHMARK(BM_AVFrameToCVMat));
+
+static void BM_Letterbox(benchmark::State &state)
+{
+    int width = (int)state.range(0), height = (int)state.range(1);
+    cv::Mat src = make_rgb(width, height);
+    cv::Mat dst;
+    for (auto _ : state)
+    {
+        letterbox(&src, &dst, NETWORK_INPUT, NETWORK_INPUT, cv::Scalar(114, 114, 114));
+        benchmark::DoNotOptimize(dst.data);
+    }
+    set_pixels_processed(state, width, height);
+}
+RESOLUTIONS(BENCHMARK(BM_Letterbox));
+
+// letterbox + 归一化 + NCHW 打包, 相当于 blobFromImage
+static void BM_Preprocess(benchmark::State &state)
+{
+    int width = (int)state.range(0), height = (int)state.range(1);
+    cv::Mat src = make_rgb(width, height);
+    cv::Mat blob;
+    for (auto _ : state)
+    {
+        yolov8_preprocess(&src, 1, NETWORK_INPUT, NETWORK_INPUT, blob);
+        benchmark::DoNotOptimize(blob.data);
+    }
+    set_pixels_processed(state, width, height);
+}
+RESOLUTIONS(BENCHMARK(BM_Preprocess));
+
+static int anchor_count(int input_size)
+{
+    return (input_size / 8) * (input_size / 8) + (input_size / 16) * (input_size / 16) +
+           (input_size / 32) * (input_size / 32);
+}
+
+// 生成 [1, 4 + 类别数, 锚点数] 的网络输出: 约 2% 的锚点有高分类别, 且成簇分布产生需要抑制的重叠框
+static cv::Mat make_output_tensor(int input_size)
+{
+    int anchors = anchor_count(input_size);
+    int sizes[3] = {1, 4 + YOLOV8_CLASSES, anchors};
+    cv::Mat out(3, sizes, CV_32F);
+    float *data = (float *)out.data;
+    const char *recorded = getenv("YOLOV8_BENCH_TENSOR");
+    if (recorded && input_size == NETWORK_INPUT)
+    {
+        FILE *file = fopen(recorded, "rb");
+        size_t expected = (size_t)(4 + YOLOV8_CLASSES) * anchors;
+        if (file && fread(data, sizeof(float), expected, file) == expected)
+        {
+            fclose(file);
+            return out;
+        }
+        if (file)
+        {
+            fclose(file);
+        }
+        fprintf(stderr, "Failed to read %s, using a synthetic tensor\n", recorded);
+    }
+    cv::RNG rng(0x5eed);
+    for (int a = 0; a < anchors; a++)
+    {
+        // 20 个目标中心, 每个周围聚集若干锚点
+        int object = a % 20;
+        float cx = (object * 37 % 20 + 0.5f) * input_size / 20 + rng.uniform(-8.f, 8.f);
+        float cy = (object * 11 % 20 + 0.5f) * input_size / 20 + rng.uniform(-8.f, 8.f);
+        data[0 * anchors + a] = cx;
+        data[1 * anchors + a] = cy;
+        data[2 * anchors + a] = input_size / 10.f + rng.uniform(-4.f, 4.f);
+        data[3 * anchors + a] = input_size / 8.f + rng.uniform(-4.f, 4.f);
+        int hot = rng.uniform(0, 50) == 0;
+        for (int c = 0; c < YOLOV8_CLASSES; c++)
+        {
+            float score = rng.uniform(0.f, 0.05f);
+            if (hot && c == object % 4)
+            {
+                score = rng.uniform(0.3f, 0.95f);
+            }
+            data[(4 + c) * anchors + a] = score;
+        }
+    }
+    return out;
+}
+
+static void BM_Postprocess(benchmark::State &state)
+{
+    int input_size = (int)state.range(0);
+    std::vector<cv::Mat> outs(1, make_output_tensor(input_size));
+    cv::Mat frame = make_rgb(input_size, input_size);
+    ClassFilter filter;
+    filter.count = YOLOV8_CLASSES;
+    for (int c = 0; c < YOLOV8_CLASSES; c++)
+    {
+        filter.ids[c] = c;
+        filter.thresholds[c] = 0.25f;
+    }
+    size_t detections = 0;
+    for (auto _ : state)
+    {
+        std::vector<DnnResult> results = postprocess(frame, outs, &filter, 0.5f);
+        detections = results.size();
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * anchor_count(input_size));
+    state.counters["detections"] = (double)detections;
+}
+INPUT_SIZES(BENCHMARK(BM_Postprocess));
+
+// 单独测 NMS: 候选框数随输入尺寸增长
+static void BM_NMSBoxes(benchmark::State &state)
+{
+    int count = (int)state.range(0);
+    NmsCandidates candidates;
+    cv::RNG rng(0x5eed);
+    for (int i = 0; i < count; i++)
+    {
+        int object = i % 50;
+        float x = (object % 10) * 190.f + rng.uniform(-10.f, 10.f);
+        float y = (object / 10) * 210.f + rng.uniform(-10.f, 10.f);
+        nms_candidates_add(&candidates, x, y, 120 + rng.uniform(-8.f, 8.f), 160 + rng.uniform(-8.f, 8.f),
+                           rng.uniform(0.25f, 0.95f), object % 4, 0);
+    }
+    std::vector<int> keep;
+    for (auto _ : state)
+    {
+        nms_run(&candidates, 0.5f, keep);
+        benchmark::DoNotOptimize(keep.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_NMSBoxes)->Arg(100)->Arg(1000)->Arg(5000);
+
+// NV12ToRGB 属于渲染窗口, 无显示构建中没有
+#ifndef HEADLESS
+static void BM_NV12ToRGB(benchmark::State &state)
+{
+    int width = (int)state.range(0), height = (int)state.range(1);
+    AVFrame *frame = make_frame(width, height, AV_PIX_FMT_NV12);
+    std::vector<uint8_t> rgb((size_t)width * height * 3);
+    for (auto _ : state)
+    {
+        NV12ToRGB(frame->data[0], frame->data[1], width, height, frame->linesize[0], frame->linesize[1], rgb.data());
+        benchmark::DoNotOptimize(rgb.data());
+    }
+    set_pixels_processed(state, width, height);
+    av_frame_free(&frame);
+}
+RESOLUTIONS(BENCHMARK(BM_NV12ToRGB));
+#endif
+
+// 多个线程在同一个队列上入队和出队; 元素不带帧, 只测队列本身的开销和锁竞争
+static FrameQueue contended_queue;
+
+static void BM_QueueContention(benchmark::State &state)
+{
+    QueueItem item;
+    memset(&item, 0, sizeof(QueueItem));
+    item.type = ONLY_BOXES;
+    QueueItem out;
+    for (auto _ : state)
+    {
+        // 每个线程先入队再出队, 队列中始终有本线程放入的元素, dequeue 不会阻塞
+        enqueue(&contended_queue, item);
+        dequeue(&contended_queue, &out);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueueContention)->ThreadRange(1, 16)->UseRealTime();
+
+static void BM_SaveFrameAsBmp(benchmark::State &state)
+{
+    int width = (int)state.range(0), height = (int)state.range(1);
+    AVFrame *frame = make_frame(width, height, AV_PIX_FMT_YUV420P);
+    char path[] = "/tmp/yolov8-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        state.SkipWithError("mkstemp failed");
+        av_frame_free(&frame);
+        return;
+    }
+    close(fd);
+    for (auto _ : state)
+    {
+        save_frame_as_bmp(frame, path);
+    }
+    set_pixels_processed(state, width, height);
+    unlink(path);
+    av_frame_free(&frame);
+}
+RESOLUTIONS(BENCHMARK(BM_SaveFrameAsBmp))->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv)
+{
+    set_log_level(LOG_WARN);
+    // 队列容量大于线程数, 不会触发丢弃
+    frame_queue_init(&contended_queue, 1024);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    frame_queue_destroy(&contended_queue);
+    return 0;
+}
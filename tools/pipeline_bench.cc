@@ -0,0 +1,421 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// 离线压测工具: 从本地文件或 lavfi 测试源读入, 以空输出(或文件)代替推流和渲染窗口运行完整流水线,
+// 输出各阶段吞吐、延迟分位数、CPU 时间和峰值内存(JSON), 用于对比不同版本的性能。
+// 用法: yolov8-bench [-c config.ini] [-t 秒] [-r] [-o 推流输出] [-w 录像输出] [-j 报告.json]
+//                    [-R 记录.det] [-V 基准.det] [-T min_iou,score_delta] <输入>
+//   输入: 本地文件, 或 lavfi:testsrc2=size=1920x1080:rate=25:duration=60
+//   -r 按输入的时间戳限速(原始帧率), 默认尽快读
+//   -t 运行时长上限, 到时停止读包并排空队列; 0 表示读到输入结束
+//   -o / -w 推流和录像的输出, 默认 null(完整编码后丢弃)
+//   -R 把逐帧检测结果按 PTS 记录到文件, 作为回放基准; 记录和回放时队列满则反压拉流, 每帧都被检测
+//   -V 回放: 对同一输入重新检测, 与基准逐帧对比检测结果和推理耗时, 有不一致或只在一边出现的帧时返回失败
+//   -T 框一致的条件, 默认 1,0 即坐标、类别和置信度完全相同
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "config.h"
+#include "pipeline.h"
+#include "inference_service.h"
+#include "rate_controller.h"
+#include "latency_trace.h"
+#include "metrics.h"
+#include "detection_log.h"
+#include "logger.h"
+
+#define BENCH_STREAM "bench"
+// 检查输入是否读完的间隔(微秒)
+#define BENCH_POLL_US 100000
+// 读完后等待各阶段排空的最长时间, 推理跟不上解码时检测队列里可能还有一整队列的帧
+#define BENCH_DRAIN_TIMEOUT_MS 600000
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double timeval_seconds(const struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+// 输出 JSON 字符串, 转义引号、反斜杠和控制字符
+static void write_json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// 各阶段的帧数, 来自流水线导出的指标
+typedef struct
+{
+    const char *stage;
+    const char *metric;
+    const char *labels;
+} StageCounter;
+
+static const StageCounter stage_counters[] = {
+    {"decode", "pipeline_frames_decoded_total", "stream=\"" BENCH_STREAM "\""},
+    {"detect", "detection_frames_total", "stream=\"" BENCH_STREAM "\""},
+    {"infer", "detection_inferred_total", "stream=\"" BENCH_STREAM "\""},
+    {"push_encode", "pipeline_frames_encoded_total", "stream=\"" BENCH_STREAM "\",output=\"push\""},
+    {"record_encode", "pipeline_frames_encoded_total", "stream=\"" BENCH_STREAM "\",output=\"record\""},
+};
+
+static const char *queue_names[PIPELINE_QUEUE_COUNT] = {"detect", "push", "record", "infer"};
+
+// 读完输入时各队列的统计; 此后不再有入队, 丢弃数已是最终值
+typedef struct
+{
+    uint64_t enqueued[PIPELINE_QUEUE_COUNT];
+    uint64_t dropped[PIPELINE_QUEUE_COUNT];
+} QueueStats;
+
+typedef struct
+{
+    const char *input;
+    int realtime;
+    double duration_s;
+    double decode_s; // 开始到读完输入
+    double wall_s;   // 开始到全部阶段排空
+    struct rusage usage_start;
+    struct rusage usage_end;
+    QueueStats queues;
+} BenchResult;
+
+// 回放对比的结果, 写在报告的 replay 节
+static void write_replay(FILE *out, const char *golden, const DetectionLogTolerance *tolerance,
+                         const DetectionLogDiff *diff)
+{
+    fprintf(out, "  \"replay\": {\n    \"golden\": ");
+    write_json_string(out, golden);
+    fprintf(out, ",\n    \"min_iou\": %.3f,\n    \"score_delta\": %.4f,\n", tolerance->min_iou,
+            tolerance->score_delta);
+    fprintf(out, "    \"frames\": {\"compared\": %llu, \"mismatched\": %llu, \"only_golden\": %llu, "
+                 "\"only_run\": %llu},\n",
+            (unsigned long long)diff->frames_compared, (unsigned long long)diff->frames_mismatched,
+            (unsigned long long)diff->frames_only_golden, (unsigned long long)diff->frames_only_run);
+    fprintf(out, "    \"boxes\": {\"golden\": %llu, \"run\": %llu, \"missing\": %llu, \"extra\": %llu},\n",
+            (unsigned long long)diff->boxes_golden, (unsigned long long)diff->boxes_run,
+            (unsigned long long)diff->boxes_missing, (unsigned long long)diff->boxes_extra);
+    fprintf(out, "    \"latency_ms\": {\"frames\": %llu, \"golden_mean\": %.3f, \"run_mean\": %.3f, "
+                 "\"delta_p50\": %.3f, \"delta_p95\": %.3f},\n",
+            (unsigned long long)diff->latency_frames, diff->golden_latency_ms, diff->run_latency_ms,
+            diff->latency_delta_p50_ms, diff->latency_delta_p95_ms);
+    fprintf(out, "    \"mismatches\": [");
+    for (size_t i = 0; i < diff->mismatches.size(); i++)
+    {
+        const DetectionLogMismatch *m = &diff->mismatches[i];
+        fprintf(out, "%s\n      {\"pts\": %lld, \"golden_boxes\": %d, \"run_boxes\": %d, \"unmatched\": %d}",
+                i ? "," : "", (long long)m->pts, m->golden_boxes, m->run_boxes, m->unmatched);
+    }
+    fprintf(out, "%s]\n  },\n", diff->mismatches.empty() ? "" : "\n    ");
+}
+
+static void write_report(FILE *out, const BenchResult *result, const char *golden,
+                         const DetectionLogTolerance *tolerance, const DetectionLogDiff *diff)
+{
+    fprintf(out, "{\n  \"input\": ");
+    write_json_string(out, result->input);
+    fprintf(out, ",\n  \"realtime\": %d,\n  \"duration_limit_s\": %.3f,\n", result->realtime, result->duration_s);
+    fprintf(out, "  \"decode_seconds\": %.3f,\n  \"wall_seconds\": %.3f,\n", result->decode_s, result->wall_s);
+
+    fprintf(out, "  \"throughput\": {\n");
+    size_t stage_count = sizeof(stage_counters) / sizeof(stage_counters[0]);
+    for (size_t i = 0; i < stage_count; i++)
+    {
+        const StageCounter *counter = &stage_counters[i];
+        int64_t frames = metric_value(metrics_find(counter->metric, counter->labels));
+        fprintf(out, "    \"%s\": {\"frames\": %lld, \"fps\": %.2f}%s\n", counter->stage, (long long)frames,
+                result->wall_s > 0 ? frames / result->wall_s : 0, i + 1 < stage_count ? "," : "");
+    }
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"queues\": {\n");
+    for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++)
+    {
+        fprintf(out, "    \"%s\": {\"enqueued\": %llu, \"dropped\": %llu}%s\n", queue_names[i],
+                (unsigned long long)result->queues.enqueued[i], (unsigned long long)result->queues.dropped[i],
+                i + 1 < PIPELINE_QUEUE_COUNT ? "," : "");
+    }
+    fprintf(out, "  },\n");
+
+    TraceHistogram spans[TRACE_SPAN_COUNT];
+    latency_trace_snapshot(spans);
+    fprintf(out, "  \"latency_ms\": {\n");
+    int first = 1;
+    for (int i = 0; i < TRACE_SPAN_COUNT; i++)
+    {
+        const TraceHistogram *h = &spans[i];
+        if (h->count == 0)
+        {
+            continue;
+        }
+        fprintf(out, "%s    \"%s\": {\"count\": %llu, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+                     "\"max\": %.3f}",
+                first ? "" : ",\n", trace_span_name((TraceSpan)i), (unsigned long long)h->count,
+                h->sum_us / 1000.0 / h->count, trace_histogram_quantile(h, 0.5) / 1000.0,
+                trace_histogram_quantile(h, 0.9) / 1000.0, trace_histogram_quantile(h, 0.99) / 1000.0,
+                h->max_us / 1000.0);
+        first = 0;
+    }
+    fprintf(out, "%s  },\n", first ? "" : "\n");
+    if (golden)
+    {
+        write_replay(out, golden, tolerance, diff);
+    }
+
+    // CPU 时间不含模型加载, 峰值内存为整个进程
+    double user_s = timeval_seconds(&result->usage_end.ru_utime) - timeval_seconds(&result->usage_start.ru_utime);
+    double system_s = timeval_seconds(&result->usage_end.ru_stime) - timeval_seconds(&result->usage_start.ru_stime);
+    fprintf(out, "  \"cpu\": {\"user_seconds\": %.3f, \"system_seconds\": %.3f, \"cores_used\": %.2f},\n", user_s,
+            system_s, result->wall_s > 0 ? (user_s + system_s) / result->wall_s : 0);
+    fprintf(out, "  \"peak_rss_kb\": %ld\n}\n", result->usage_end.ru_maxrss);
+}
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [-c config.ini] [-t seconds] [-r] [-o push_output] [-w record_output] [-j report.json]\n"
+           "       [-R record.det] [-V golden.det] [-T min_iou,score_delta] <input>\n",
+           program);
+    printf("  input: local file or lavfi:<filtergraph>, e.g. lavfi:testsrc2=size=1920x1080:rate=25:duration=60\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *config_path = NULL;
+    const char *push_output = "null";
+    const char *record_output = "null";
+    const char *report_path = NULL;
+    const char *record_log = NULL;
+    const char *golden_log = NULL;
+    DetectionLogTolerance tolerance = {1.0f, 0.0f};
+    BenchResult result;
+    memset(&result, 0, sizeof(result));
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:ro:w:j:R:V:T:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            config_path = optarg;
+            break;
+        case 't':
+            result.duration_s = atof(optarg);
+            break;
+        case 'r':
+            result.realtime = 1;
+            break;
+        case 'o':
+            push_output = optarg;
+            break;
+        case 'w':
+            record_output = optarg;
+            break;
+        case 'j':
+            report_path = optarg;
+            break;
+        case 'R':
+            record_log = optarg;
+            break;
+        case 'V':
+            golden_log = optarg;
+            break;
+        case 'T':
+            if (sscanf(optarg, "%f,%f", &tolerance.min_iou, &tolerance.score_delta) != 2)
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    result.input = argv[optind];
+    set_log_level(LOG_WARN);
+
+    StreamConfig config;
+    config_set_defaults(&config);
+    if (config_path && config_load_file(config_path, &config) != 0)
+    {
+        printf("Failed to load config file %s\n", config_path);
+        return EXIT_FAILURE;
+    }
+    snprintf(config.name, sizeof(config.name), "%s", BENCH_STREAM);
+    snprintf(config.input_url, sizeof(config.input_url), "%s", result.input);
+    snprintf(config.output_url, sizeof(config.output_url), "%s", push_output);
+    snprintf(config.record_path, sizeof(config.record_path), "%s", record_output);
+    config.realtime = result.realtime;
+    // 报告需要各区间的延迟; 读完输入后等所有阶段处理完剩余的帧
+    config.trace.enabled = 1;
+    config.trace.slow_frame_ms = 0;
+    config.shutdown.drain_timeout_ms = BENCH_DRAIN_TIMEOUT_MS;
+    // 记录和回放: 没有指定 -R 时本次结果写入临时文件
+    char run_log[64] = "";
+    if (golden_log && !record_log)
+    {
+        snprintf(run_log, sizeof(run_log), "/tmp/yolov8-bench-XXXXXX");
+        int fd = mkstemp(run_log);
+        if (fd < 0)
+        {
+            printf("Failed to create temporary detection log\n");
+            return EXIT_FAILURE;
+        }
+        close(fd);
+        record_log = run_log;
+    }
+    if (record_log)
+    {
+        snprintf(config.detection_log, sizeof(config.detection_log), "%s", record_log);
+        // 每帧都推理, 且结果只取决于该帧本身: 关闭依赖时间、历史帧或队列丢帧情况的跳帧和复用
+        config.detector.detect_interval = 1;
+        config.rate.enabled = 0;
+        config.motion.enabled = 0;
+        config.cache.enabled = 0;
+        config.tiling.adaptive = 0;
+        // 队列满时反压而不是丢弃最旧的帧, 两次运行检测的是同一组帧
+        config.lossless = 1;
+    }
+    rate_controller_init(&config.rate);
+    latency_trace_init(&config.trace);
+
+    InferencePool inference;
+    if (inference_pool_init(&inference, &config.detector, &config.threads) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    // 不经过管理器, 没有监管线程: 输入结束后拉流线程退出而不是重连
+    Pipeline *pipeline = (Pipeline *)calloc(1, sizeof(Pipeline));
+    if (!pipeline)
+    {
+        inference_pool_stop(&inference);
+        return EXIT_FAILURE;
+    }
+    pipeline->source = config;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    getrusage(RUSAGE_SELF, &result.usage_start);
+    double start = now_seconds();
+    if (pipeline_start(pipeline, &inference, NULL, NULL) != 0)
+    {
+        free(pipeline);
+        inference_pool_stop(&inference);
+        return EXIT_FAILURE;
+    }
+    int cancelled = 0;
+    while (pipeline->decode.running)
+    {
+        usleep(BENCH_POLL_US);
+        if (!cancelled && (interrupted || (result.duration_s > 0 && now_seconds() - start >= result.duration_s)))
+        {
+            pipeline_cancel(pipeline, NULL);
+            cancelled = 1;
+        }
+    }
+    result.decode_s = now_seconds() - start;
+    for (int i = 0; i < PIPELINE_QUEUE_COUNT; i++)
+    {
+        result.queues.enqueued[i] = __atomic_load_n(&pipeline->queues[i].enqueued, __ATOMIC_RELAXED);
+        result.queues.dropped[i] = __atomic_load_n(&pipeline->queues[i].dropped, __ATOMIC_RELAXED);
+    }
+    pipeline_cancel(pipeline, NULL);
+    pipeline_join(pipeline);
+    result.wall_s = now_seconds() - start;
+    getrusage(RUSAGE_SELF, &result.usage_end);
+    free(pipeline);
+    inference_pool_stop(&inference);
+
+    // 按 PTS 对比两次的检测结果; 只在一边出现的帧(队列仍然丢帧或 -t 截断)同样算失败, 两次必须检测同一组帧
+    DetectionLogDiff diff;
+    int replay_failed = 0;
+    if (golden_log)
+    {
+        DetectionLog golden, run;
+        int loaded = detection_log_load(golden_log, &golden) == 0 && detection_log_load(record_log, &run) == 0;
+        if (run_log[0])
+        {
+            unlink(run_log);
+        }
+        if (!loaded)
+        {
+            return EXIT_FAILURE;
+        }
+        detection_log_compare(&golden, &run, &tolerance, &diff);
+        for (const DetectionLogMismatch &m : diff.mismatches)
+        {
+            fprintf(stderr, "Mismatch at pts %lld: golden %d boxes, run %d boxes, %d unmatched\n", (long long)m.pts,
+                    m.golden_boxes, m.run_boxes, m.unmatched);
+        }
+        fprintf(stderr, "Replay: %llu frames compared, %llu mismatched, %llu only in golden, %llu only in run\n",
+                (unsigned long long)diff.frames_compared, (unsigned long long)diff.frames_mismatched,
+                (unsigned long long)diff.frames_only_golden, (unsigned long long)diff.frames_only_run);
+        replay_failed = diff.frames_compared == 0 || diff.frames_mismatched > 0 || diff.frames_only_golden > 0 ||
+                        diff.frames_only_run > 0;
+    }
+
+    FILE *out = report_path ? fopen(report_path, "w") : stdout;
+    if (!out)
+    {
+        printf("Failed to open %s\n", report_path);
+        return EXIT_FAILURE;
+    }
+    write_report(out, &result, golden_log, &tolerance, &diff);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return replay_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
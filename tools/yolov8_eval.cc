@@ -0,0 +1,319 @@
+// Copyright (C) 2025 wwhai
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// 精度/速度对比工具: 在本地图片集上分别运行参考模型和候选模型(如 INT8/FP16),
+// 输出 mAP 漂移和推理耗时。
+// 用法: yolov8-eval <image_dir> <reference.ini> <candidate.ini> [label_dir]
+// 提供 label_dir(YOLO txt 格式标注)时以标注为真值, 否则以参考模型在其部署阈值(conf_threshold)下的检测结果为真值。
+// 与常见的 YOLO 评估一致, mAP 在极低的置信度阈值下计算, 保留完整的 PR 曲线, 不受部署阈值影响;
+// 因此耗时中的后处理部分比部署阈值下略高。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "config.h"
+#include "yolov8.h"
+#include "logger.h"
+
+// 计算 mAP 时使用的置信度阈值, 与部署阈值无关
+#define EVAL_CONF_THRESHOLD 0.001f
+
+typedef struct
+{
+    std::vector<std::vector<Box>> detections; // 每张图片在 EVAL_CONF_THRESHOLD 下的检测结果
+    std::vector<double> latencies_ms;         // 每张图片的推理耗时
+    float conf_threshold;                     // 配置文件中的部署阈值
+    BackendCapabilities caps;
+} EvalRun;
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static double box_iou(const Box &a, const Box &b)
+{
+    int x1 = std::max(a.x, b.x);
+    int y1 = std::max(a.y, b.y);
+    int x2 = std::min(a.x + a.w, b.x + b.w);
+    int y2 = std::min(a.y + a.h, b.y + b.h);
+    double inter = (double)std::max(0, x2 - x1) * std::max(0, y2 - y1);
+    double uni = (double)a.w * a.h + (double)b.w * b.h - inter;
+    return uni > 0 ? inter / uni : 0;
+}
+
+// 读取 YOLO txt 格式的标注: class cx cy w h (归一化坐标)
+static std::vector<Box> load_labels(const std::string &path, int width, int height)
+{
+    std::vector<Box> labels;
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file)
+    {
+        return labels;
+    }
+    int class_id;
+    float cx, cy, w, h;
+    while (fscanf(file, "%d %f %f %f %f", &class_id, &cx, &cy, &w, &h) == 5)
+    {
+        Box box;
+        memset(&box, 0, sizeof(Box));
+        box.x = (int)((cx - w / 2) * width);
+        box.y = (int)((cy - h / 2) * height);
+        box.w = (int)(w * width);
+        box.h = (int)(h * height);
+        box.prop = 1.0f;
+        box.class_id = class_id;
+        labels.push_back(box);
+    }
+    fclose(file);
+    return labels;
+}
+
+// 计算单个 IoU 阈值下的 mAP (VOC 全点插值)
+static double compute_map(const std::vector<std::vector<Box>> &truth,
+                          const std::vector<std::vector<Box>> &detections, double iou_threshold)
+{
+    std::map<int, int> truth_counts;
+    for (const auto &boxes : truth)
+    {
+        for (const Box &box : boxes)
+        {
+            truth_counts[box.class_id]++;
+        }
+    }
+    double ap_sum = 0;
+    for (const auto &entry : truth_counts)
+    {
+        int class_id = entry.first;
+        // 收集该类别的所有检测, 按置信度降序
+        std::vector<std::pair<float, std::pair<size_t, const Box *>>> candidates;
+        for (size_t i = 0; i < detections.size(); i++)
+        {
+            for (const Box &box : detections[i])
+            {
+                if (box.class_id == class_id)
+                {
+                    candidates.push_back({box.prop, {i, &box}});
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const auto &a, const auto &b)
+                  { return a.first > b.first; });
+        std::vector<std::vector<bool>> matched(truth.size());
+        for (size_t i = 0; i < truth.size(); i++)
+        {
+            matched[i].assign(truth[i].size(), false);
+        }
+        std::vector<double> precisions, recalls;
+        int tp = 0, fp = 0;
+        for (const auto &candidate : candidates)
+        {
+            size_t image = candidate.second.first;
+            const Box &det = *candidate.second.second;
+            double best_iou = 0;
+            int best = -1;
+            for (size_t j = 0; j < truth[image].size(); j++)
+            {
+                if (truth[image][j].class_id != class_id || matched[image][j])
+                {
+                    continue;
+                }
+                double iou = box_iou(det, truth[image][j]);
+                if (iou > best_iou)
+                {
+                    best_iou = iou;
+                    best = (int)j;
+                }
+            }
+            if (best >= 0 && best_iou >= iou_threshold)
+            {
+                matched[image][best] = true;
+                tp++;
+            }
+            else
+            {
+                fp++;
+            }
+            precisions.push_back((double)tp / (tp + fp));
+            recalls.push_back((double)tp / entry.second);
+        }
+        // 全点插值: 从后向前取精度包络
+        double ap = 0, prev_recall = 0;
+        for (size_t k = 0; k < precisions.size(); k++)
+        {
+            double max_precision = *std::max_element(precisions.begin() + k, precisions.end());
+            ap += (recalls[k] - prev_recall) * max_precision;
+            prev_recall = recalls[k];
+        }
+        ap_sum += ap;
+    }
+    return truth_counts.empty() ? 0 : ap_sum / truth_counts.size();
+}
+
+// mAP@0.5:0.95
+static double compute_map_range(const std::vector<std::vector<Box>> &truth,
+                                const std::vector<std::vector<Box>> &detections)
+{
+    double sum = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        sum += compute_map(truth, detections, 0.5 + 0.05 * i);
+    }
+    return sum / 10;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static double mean(const std::vector<double> &values)
+{
+    double sum = 0;
+    for (double v : values)
+    {
+        sum += v;
+    }
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static int run_model(const char *config_path, const std::vector<cv::Mat> &images, EvalRun *run)
+{
+    StreamConfig config;
+    config_set_defaults(&config);
+    if (config_load_file(config_path, &config) != 0)
+    {
+        return -1;
+    }
+    // 按类别的阈值同样会截断 PR 曲线, 评估时只保留类别允许列表
+    run->conf_threshold = config.detector.conf_threshold;
+    config.detector.conf_threshold = EVAL_CONF_THRESHOLD;
+    memset(config.detector.class_thresholds, 0, sizeof(config.detector.class_thresholds));
+    Yolov8Model model;
+    if (init_yolov8_model(&config.detector, &model) != 0)
+    {
+        return -1;
+    }
+    run->caps = model.caps;
+    run->detections.resize(images.size());
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        double start = now_ms();
+        inference_yolov8_model(&model, &images[i], 1, &run->detections[i]);
+        run->latencies_ms.push_back(now_ms() - start);
+    }
+    release_yolov8_model(&model);
+    return 0;
+}
+
+static void print_run(const char *name, const char *config_path, const EvalRun *run, double map50, double map50_95)
+{
+    printf("%-10s %-28s %-6s %-6s %8.4f %10.4f %9.2f %9.2f %9.2f\n",
+           name, config_path, run->caps.device, run->caps.precision, map50, map50_95,
+           mean(run->latencies_ms), percentile(run->latencies_ms, 0.5), percentile(run->latencies_ms, 0.95));
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        printf("Usage: %s <image_dir> <reference.ini> <candidate.ini> [label_dir]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    set_log_level(LOG_WARN);
+    const char *image_dir = argv[1];
+    const char *label_dir = argc > 4 ? argv[4] : NULL;
+
+    std::vector<cv::String> files, png_files;
+    cv::glob(cv::String(image_dir) + "/*.jpg", files, false);
+    cv::glob(cv::String(image_dir) + "/*.png", png_files, false);
+    files.insert(files.end(), png_files.begin(), png_files.end());
+    std::vector<cv::Mat> images;
+    std::vector<std::vector<Box>> labels;
+    for (const cv::String &file : files)
+    {
+        cv::Mat image = cv::imread(file);
+        if (image.empty())
+        {
+            continue;
+        }
+        // 与流水线保持一致, 使用 RGB 输入
+        cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+        images.push_back(image);
+        if (label_dir)
+        {
+            std::string base = file.substr(file.find_last_of('/') + 1);
+            base = base.substr(0, base.find_last_of('.'));
+            labels.push_back(load_labels(std::string(label_dir) + "/" + base + ".txt", image.cols, image.rows));
+        }
+    }
+    if (images.empty())
+    {
+        printf("No images found in %s\n", image_dir);
+        return EXIT_FAILURE;
+    }
+
+    EvalRun reference, candidate;
+    if (run_model(argv[2], images, &reference) != 0 || run_model(argv[3], images, &candidate) != 0)
+    {
+        printf("Failed to run models\n");
+        return EXIT_FAILURE;
+    }
+    // 没有标注时, 参考模型在部署阈值下的检测结果作为真值
+    std::vector<std::vector<Box>> reference_truth;
+    for (const std::vector<Box> &boxes : reference.detections)
+    {
+        std::vector<Box> kept;
+        for (const Box &box : boxes)
+        {
+            if (box.prop >= reference.conf_threshold)
+            {
+                kept.push_back(box);
+            }
+        }
+        reference_truth.push_back(kept);
+    }
+    const std::vector<std::vector<Box>> &truth = label_dir ? labels : reference_truth;
+    double ref_map50 = compute_map(truth, reference.detections, 0.5);
+    double ref_map = compute_map_range(truth, reference.detections);
+    double cand_map50 = compute_map(truth, candidate.detections, 0.5);
+    double cand_map = compute_map_range(truth, candidate.detections);
+
+    printf("images: %d, ground truth: %s, eval conf: %.3f\n", (int)images.size(),
+           label_dir ? label_dir : "reference detections", EVAL_CONF_THRESHOLD);
+    printf("%-10s %-28s %-6s %-6s %8s %10s %9s %9s %9s\n",
+           "model", "config", "device", "prec", "mAP50", "mAP50-95", "mean(ms)", "p50(ms)", "p95(ms)");
+    print_run("reference", argv[2], &reference, ref_map50, ref_map);
+    print_run("candidate", argv[3], &candidate, cand_map50, cand_map);
+    double ref_mean = mean(reference.latencies_ms);
+    double cand_mean = mean(candidate.latencies_ms);
+    printf("mAP50 drift: %+.4f, mAP50-95 drift: %+.4f, speedup: %.2fx\n",
+           cand_map50 - ref_map50, cand_map - ref_map, cand_mean > 0 ? ref_mean / cand_mean : 0);
+    return EXIT_SUCCESS;
+}